@@ -1,7 +1,10 @@
 #pragma once
 #include <cassert>
 
+#include <memory>
+
 #include "Math.h"
+#include "SIMD.h"
 #include "vector"
 
 namespace dae
@@ -54,6 +57,94 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Object space mesh data, shared (read-only) between every MeshInstance that uses it
+	struct MeshData
+	{
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+
+		void UpdateAABB()
+		{
+			if (positions.empty())
+				return;
+
+			minAABB = positions[0];
+			maxAABB = positions[0];
+			for (const Vector3& p : positions)
+			{
+				minAABB = Vector3::Min(p, minAABB);
+				maxAABB = Vector3::Max(p, maxAABB);
+			}
+		}
+
+		size_t GetMemoryUsage() const
+		{
+			return sizeof(MeshData)
+				+ positions.capacity() * sizeof(Vector3)
+				+ normals.capacity() * sizeof(Vector3)
+				+ indices.capacity() * sizeof(int);
+		}
+	};
+
+	//Quantized version of MeshData (see Utils::CompressMesh), decoded on the fly by the hit tests:
+	//positions are 16-bit per axis relative to the bounds, face normals are octahedral encoded (2x 16-bit snorm)
+	//and indices are 16-bit when the mesh has at most 65536 vertices
+	struct CompactMeshData
+	{
+		std::vector<uint16_t> positions{}; //x,y,z per vertex
+		std::vector<uint32_t> normals{}; //one per triangle
+		std::vector<uint16_t> indices16{};
+		std::vector<uint32_t> indices32{};
+
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		Vector3 dequantizeScale{}; //(max - min) / 65535
+
+		size_t GetNumTriangles() const { return normals.size(); }
+
+		uint32_t GetIndex(size_t i) const
+		{
+			return indices32.empty() ? indices16[i] : indices32[i];
+		}
+
+		Vector3 GetPosition(uint32_t vertex) const
+		{
+			const uint16_t* pQuantized = &positions[vertex * 3];
+			return {
+				minAABB.x + pQuantized[0] * dequantizeScale.x,
+				minAABB.y + pQuantized[1] * dequantizeScale.y,
+				minAABB.z + pQuantized[2] * dequantizeScale.z };
+		}
+
+		Vector3 GetNormal(size_t triangle) const
+		{
+			const uint32_t packed = normals[triangle];
+			const float x = static_cast<int16_t>(packed & 0xFFFF) / 32767.f;
+			const float y = static_cast<int16_t>(packed >> 16) / 32767.f;
+
+			Vector3 n{ x, y, 1.f - std::abs(x) - std::abs(y) };
+			if (n.z < 0.f)
+			{
+				n.x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+				n.y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+			}
+			return n.Normalized();
+		}
+
+		size_t GetMemoryUsage() const
+		{
+			return sizeof(CompactMeshData)
+				+ positions.capacity() * sizeof(uint16_t)
+				+ normals.capacity() * sizeof(uint32_t)
+				+ indices16.capacity() * sizeof(uint16_t)
+				+ indices32.capacity() * sizeof(uint32_t);
+		}
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -93,19 +184,31 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		//Set when a transform or the geometry changed, UpdateTransforms skips the mesh otherwise
+		bool isTransformDirty{ true };
+
 		void Translate(const Vector3& translation)
 		{
-			translationTransform = Matrix::CreateTranslation(translation);
+			SetTransform(translationTransform, Matrix::CreateTranslation(translation));
 		}
 
 		void RotateY(float yaw)
 		{
-			rotationTransform = Matrix::CreateRotationY(yaw);
+			SetTransform(rotationTransform, Matrix::CreateRotationY(yaw));
 		}
 
 		void Scale(const Vector3& scale)
 		{
-			scaleTransform = Matrix::CreateScale(scale);
+			SetTransform(scaleTransform, Matrix::CreateScale(scale));
+		}
+
+		void SetTransform(Matrix& transform, const Matrix& newTransform)
+		{
+			if (transform == newTransform)
+				return;
+
+			transform = newTransform;
+			isTransformDirty = true;
 		}
 
 		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
@@ -121,6 +224,7 @@ namespace dae
 			indices.push_back(++startIndex);
 
 			normals.push_back(triangle.normal);
+			isTransformDirty = true;
 
 			//Not ideal, but making sure all vertices are updated
 			if(!ignoreTransformUpdate)
@@ -143,36 +247,27 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		//Returns false when nothing had to be recomputed
+		bool UpdateTransforms()
 		{
-			//assert(false && "No Implemented Yet!");
-			//Calculate Final Transform 
-			//const auto finalTransform = ...
+			//Buffers that don't match the source were filled in directly (e.g. ParseOBJ), so they count as dirty too
+			if (!isTransformDirty && transformedPositions.size() == positions.size() && transformedNormals.size() == normals.size())
+				return false;
 
 			const Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
-			//const Matrix finalTransform = translationTransform * rotationTransform * scaleTransform;
-
-			transformedPositions.clear();
-			transformedNormals.clear();
-			int index{};
-			while (positions.size() > transformedPositions.size())
-			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(positions[index++]));
-			}
-
-			index = 0;
-			while (normals.size() > transformedNormals.size())
-			{
-				transformedNormals.emplace_back(finalTransform.TransformVector(normals[index++]));
-			}
+			//Normals need the inverse-transpose to stay perpendicular under non-uniform scale
+			const Matrix normalTransform = Matrix::Transpose(Matrix::Inverse(finalTransform));
 
-			for (Vector3& p : positions)
-			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(p));
-			}
+			//Only allocates when the vertex count grew, after that the same buffers are overwritten every update
+			transformedPositions.resize(positions.size());
+			transformedNormals.resize(normals.size());
+			TransformPoints(finalTransform, positions.data(), transformedPositions.data(), positions.size());
+			TransformNormals(normalTransform, normals.data(), transformedNormals.data(), normals.size());
 
 			// Update AABB
 			UpdateTransformedAABB(finalTransform);
+			isTransformDirty = false;
+			return true;
 		}
 		
 		void UpdateAABB()
@@ -189,6 +284,17 @@ namespace dae
 			}
 		}
 
+		//Bytes owned by this mesh (capacity, not size, so over-allocation shows up too)
+		size_t GetMemoryUsage() const
+		{
+			return sizeof(TriangleMesh)
+				+ positions.capacity() * sizeof(Vector3)
+				+ normals.capacity() * sizeof(Vector3)
+				+ indices.capacity() * sizeof(int)
+				+ transformedPositions.capacity() * sizeof(Vector3)
+				+ transformedNormals.capacity() * sizeof(Vector3);
+		}
+
 		void UpdateTransformedAABB(const Matrix& finalTransform)
 		{
 			// AABB update: be careful -> transform the 8 vertices of the AABB
@@ -228,22 +334,112 @@ namespace dae
 			transformedMaxAABB = tMaxAABB;
 		}
 	};
+	//Placed copy of shared MeshData with its own transform and material.
+	//Rays are moved into object space for the hit test, so no transformed copy of the vertices is needed.
+	struct MeshInstance
+	{
+		MeshInstance() = default;
+		MeshInstance(std::shared_ptr<const MeshData> _pData, TriangleCullMode _cullMode, unsigned char _materialIndex):
+			pData(std::move(_pData)), materialIndex(_materialIndex), cullMode(_cullMode)
+		{
+			UpdateTransforms();
+		}
+
+		MeshInstance(std::shared_ptr<const CompactMeshData> _pCompactData, TriangleCullMode _cullMode, unsigned char _materialIndex) :
+			pCompactData(std::move(_pCompactData)), materialIndex(_materialIndex), cullMode(_cullMode)
+		{
+			UpdateTransforms();
+		}
+
+		//Exactly one of these is set
+		std::shared_ptr<const MeshData> pData{};
+		std::shared_ptr<const CompactMeshData> pCompactData{};
+		unsigned char materialIndex{};
+
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		Matrix worldToObject{};
+		Matrix normalToWorld{}; //Transposed inverse (only the 3x3 part is used)
+
+		Vector3 transformedMinAABB{};
+		Vector3 transformedMaxAABB{};
+
+		//Set when a transform changed, UpdateTransforms skips the instance otherwise
+		bool isTransformDirty{ true };
+
+		void Translate(const Vector3& translation)
+		{
+			SetTransform(translationTransform, Matrix::CreateTranslation(translation));
+		}
+
+		void RotateY(float yaw)
+		{
+			SetTransform(rotationTransform, Matrix::CreateRotationY(yaw));
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			SetTransform(scaleTransform, Matrix::CreateScale(scale));
+		}
+
+		void SetTransform(Matrix& transform, const Matrix& newTransform)
+		{
+			if (transform == newTransform)
+				return;
+
+			transform = newTransform;
+			isTransformDirty = true;
+		}
+
+		//Returns false when nothing had to be recomputed
+		bool UpdateTransforms()
+		{
+			if (!isTransformDirty)
+				return false;
+			isTransformDirty = false;
+
+			const Matrix objectToWorld = scaleTransform * rotationTransform * translationTransform;
+			worldToObject = Matrix::Inverse(objectToWorld);
+			normalToWorld = Matrix::Transpose(worldToObject);
+
+			if (!pData && !pCompactData)
+				return true;
+
+			const Vector3& minAABB = pData ? pData->minAABB : pCompactData->minAABB;
+			const Vector3& maxAABB = pData ? pData->maxAABB : pCompactData->maxAABB;
+			objectToWorld.TransformAABB(minAABB, maxAABB, transformedMinAABB, transformedMaxAABB);
+			return true;
+		}
+	};
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
 	{
 		Point,
-		Directional
+		Directional,
+		Rect, //one-sided, emits towards direction (edgeU x edgeV) with a cosine falloff
+		Sphere
 	};
 
 	struct Light
 	{
-		Vector3 origin{};
+		Vector3 origin{}; //center of the area lights
 		Vector3 direction{};
 		ColorRGB color{};
 		float intensity{};
 
 		LightType type{};
+
+		//Area lights
+		Vector3 edgeU{}; //rect: full edges, the corners are origin +- edgeU / 2 +- edgeV / 2
+		Vector3 edgeV{};
+		float radius{}; //sphere
+
+		bool IsAreaLight() const { return type == LightType::Rect || type == LightType::Sphere; }
 	};
 #pragma endregion
 #pragma region MISC
@@ -264,6 +460,7 @@ namespace dae
 
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
+		uint32_t objectId{ 0 }; //which object of the scene was hit, see Scene::GetClosestHit
 	};
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "FileMapping.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace dae;
+
+FileMapping::~FileMapping()
+{
+	Close();
+}
+
+#if defined(_WIN32)
+bool FileMapping::Open(const std::string& filename)
+{
+	Close();
+
+	const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_FileHandle = file;
+	m_Size = static_cast<size_t>(fileSize.QuadPart);
+
+	//Mapping a zero sized file fails, but it is still a valid (empty) file
+	if (m_Size == 0)
+	{
+		m_IsEmptyFile = true;
+		return true;
+	}
+
+	m_MappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_MappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!m_pData)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void FileMapping::Close()
+{
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_MappingHandle)
+		CloseHandle(m_MappingHandle);
+	if (m_FileHandle)
+		CloseHandle(m_FileHandle);
+
+	m_pData = nullptr;
+	m_MappingHandle = nullptr;
+	m_FileHandle = nullptr;
+	m_Size = 0;
+	m_IsEmptyFile = false;
+}
+#else
+bool FileMapping::Open(const std::string& filename)
+{
+	Close();
+
+	m_FileDescriptor = open(filename.c_str(), O_RDONLY);
+	if (m_FileDescriptor < 0)
+		return false;
+
+	struct stat fileStat{};
+	if (fstat(m_FileDescriptor, &fileStat) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_Size = static_cast<size_t>(fileStat.st_size);
+	if (m_Size == 0)
+	{
+		m_IsEmptyFile = true;
+		return true;
+	}
+
+	void* pData = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_FileDescriptor, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	madvise(pData, m_Size, MADV_SEQUENTIAL);
+	m_pData = static_cast<const char*>(pData);
+	return true;
+}
+
+void FileMapping::Close()
+{
+	if (m_pData)
+		munmap(const_cast<char*>(m_pData), m_Size);
+	if (m_FileDescriptor >= 0)
+		close(m_FileDescriptor);
+
+	m_pData = nullptr;
+	m_FileDescriptor = -1;
+	m_Size = 0;
+	m_IsEmptyFile = false;
+}
+#endif
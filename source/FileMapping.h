@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+
+namespace dae
+{
+	//Read-only memory mapped view of a whole file
+	class FileMapping final
+	{
+	public:
+		FileMapping() = default;
+		~FileMapping();
+
+		FileMapping(const FileMapping&) = delete;
+		FileMapping(FileMapping&&) noexcept = delete;
+		FileMapping& operator=(const FileMapping&) = delete;
+		FileMapping& operator=(FileMapping&&) noexcept = delete;
+
+		bool Open(const std::string& filename);
+		void Close();
+
+		bool IsOpen() const { return m_pData != nullptr || m_IsEmptyFile; }
+		const char* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		const char* m_pData{ nullptr };
+		size_t m_Size{};
+		bool m_IsEmptyFile{ false };
+
+#if defined(_WIN32)
+		void* m_FileHandle{ nullptr };
+		void* m_MappingHandle{ nullptr };
+#else
+		int m_FileDescriptor{ -1 };
+#endif
+	};
+}
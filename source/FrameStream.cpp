@@ -0,0 +1,274 @@
+#include "FrameStream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+#include "ImageWriter.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr char g_Y4MFrameHeader[]{ "FRAME\n" };
+	constexpr size_t g_Y4MFrameHeaderSize{ sizeof(g_Y4MFrameHeader) - 1 };
+
+	//BT.601 studio range
+	uint8_t ToY(int r, int g, int b)
+	{
+		return static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+	}
+
+	uint8_t ToU(int r, int g, int b)
+	{
+		return static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + 128) / 256 + 128);
+	}
+
+	uint8_t ToV(int r, int g, int b)
+	{
+		return static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 128) / 256 + 128);
+	}
+}
+
+FrameStream::~FrameStream()
+{
+	Close();
+}
+
+bool FrameStream::Open(const std::string& target, StreamFormat format, uint32_t width, uint32_t height, uint32_t framesPerSecond)
+{
+	Close();
+
+	if (target == "-")
+	{
+#if defined(_WIN32)
+		//No "\n" -> "\r\n" translation in the pixel data
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		m_pFile = stdout;
+		m_OwnsFile = false;
+	}
+	else
+	{
+		m_pFile = std::fopen(target.c_str(), "wb");
+		m_OwnsFile = true;
+		if (!m_pFile)
+			return false;
+	}
+
+#if !defined(_WIN32)
+	//A closed reader should fail the write, not end the process
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+	m_Format = format;
+	m_Width = width;
+	m_Height = height;
+
+	size_t frameSize{};
+	switch (format)
+	{
+	case StreamFormat::RGB24:
+		frameSize = size_t(width) * height * 3;
+		break;
+	case StreamFormat::RGBA32:
+		frameSize = size_t(width) * height * 4;
+		break;
+	case StreamFormat::Y4M:
+	{
+		const size_t chromaSize = size_t((width + 1) / 2) * ((height + 1) / 2);
+		frameSize = g_Y4MFrameHeaderSize + size_t(width) * height + 2 * chromaSize;
+
+		const std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height)
+			+ " F" + std::to_string(framesPerSecond) + ":1 Ip A1:1 C420jpeg\n";
+		std::fwrite(header.data(), 1, header.size(), m_pFile);
+		break;
+	}
+	}
+
+	for (std::vector<uint8_t>& buffer : m_Buffers)
+		buffer.resize(frameSize);
+
+	m_NextBuffer = 0;
+	m_PendingBuffer = -1;
+	m_IsStopping = false;
+	m_HasFailed = false;
+	m_NumFramesWritten = 0;
+	m_Thread = std::thread([this] { Run(); });
+	return true;
+}
+
+void FrameStream::Close()
+{
+	if (!m_pFile)
+		return;
+
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_FrameAdded.notify_one();
+	m_Thread.join();
+
+	if (m_OwnsFile)
+		std::fclose(m_pFile);
+	else
+		std::fflush(m_pFile);
+	m_pFile = nullptr;
+}
+
+bool FrameStream::Submit(const Image& frame)
+{
+	if (!m_pFile || frame.width != m_Width || frame.height != m_Height)
+		return false;
+
+	{
+		//Only waits when the writer hasn't picked up the previous frame yet
+		std::unique_lock lock{ m_Mutex };
+		m_FrameTaken.wait(lock, [this] { return m_PendingBuffer < 0 || m_HasFailed; });
+		if (m_HasFailed)
+			return false;
+	}
+
+	//The writer only touches the other buffer now
+	std::vector<uint8_t>& buffer = m_Buffers[m_NextBuffer];
+	ConvertFrame(frame, buffer);
+
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_PendingBuffer = m_NextBuffer;
+	}
+	m_FrameAdded.notify_one();
+
+	m_NextBuffer = 1 - m_NextBuffer;
+	return true;
+}
+
+uint64_t FrameStream::GetNumFramesWritten() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_NumFramesWritten;
+}
+
+bool FrameStream::ParseFormat(const std::string& name, StreamFormat& format)
+{
+	if (name == "rgb")
+		format = StreamFormat::RGB24;
+	else if (name == "rgba")
+		format = StreamFormat::RGBA32;
+	else if (name == "y4m")
+		format = StreamFormat::Y4M;
+	else
+		return false;
+
+	return true;
+}
+
+void FrameStream::ConvertFrame(const Image& frame, std::vector<uint8_t>& buffer) const
+{
+	const size_t numPixels = size_t(m_Width) * m_Height;
+	const uint8_t* pRGB = frame.rgb.data();
+
+	switch (m_Format)
+	{
+	case StreamFormat::RGB24:
+		std::memcpy(buffer.data(), pRGB, numPixels * 3);
+		break;
+	case StreamFormat::RGBA32:
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			buffer[i * 4] = pRGB[i * 3];
+			buffer[i * 4 + 1] = pRGB[i * 3 + 1];
+			buffer[i * 4 + 2] = pRGB[i * 3 + 2];
+			buffer[i * 4 + 3] = 255;
+		}
+		break;
+	case StreamFormat::Y4M:
+	{
+		std::memcpy(buffer.data(), g_Y4MFrameHeader, g_Y4MFrameHeaderSize);
+		uint8_t* pY = buffer.data() + g_Y4MFrameHeaderSize;
+		for (size_t i = 0; i < numPixels; ++i)
+			pY[i] = ToY(pRGB[i * 3], pRGB[i * 3 + 1], pRGB[i * 3 + 2]);
+
+		//Chroma from the average of each 2x2 block (edge pixels repeat for odd sizes)
+		const uint32_t chromaWidth = (m_Width + 1) / 2;
+		const uint32_t chromaHeight = (m_Height + 1) / 2;
+		uint8_t* pU = pY + numPixels;
+		uint8_t* pV = pU + size_t(chromaWidth) * chromaHeight;
+		for (uint32_t cy = 0; cy < chromaHeight; ++cy)
+		{
+			for (uint32_t cx = 0; cx < chromaWidth; ++cx)
+			{
+				int r{}, g{}, b{};
+				for (uint32_t dy = 0; dy < 2; ++dy)
+				{
+					for (uint32_t dx = 0; dx < 2; ++dx)
+					{
+						const uint32_t x = std::min(cx * 2 + dx, m_Width - 1);
+						const uint32_t y = std::min(cy * 2 + dy, m_Height - 1);
+						const uint8_t* pPixel = pRGB + (size_t(y) * m_Width + x) * 3;
+						r += pPixel[0];
+						g += pPixel[1];
+						b += pPixel[2];
+					}
+				}
+
+				const size_t chromaIndex = size_t(cy) * chromaWidth + cx;
+				pU[chromaIndex] = ToU((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+				pV[chromaIndex] = ToV((r + 2) / 4, (g + 2) / 4, (b + 2) / 4);
+			}
+		}
+		break;
+	}
+	}
+}
+
+void FrameStream::Run()
+{
+	while (true)
+	{
+		int bufferIndex{};
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_FrameAdded.wait(lock, [this] { return m_PendingBuffer >= 0 || m_IsStopping; });
+			if (m_PendingBuffer < 0)
+				return;
+
+			bufferIndex = m_PendingBuffer;
+			m_PendingBuffer = -1;
+		}
+		m_FrameTaken.notify_one();
+
+		//This is where a slow reader blocks, on this thread only
+		const std::vector<uint8_t>& buffer = m_Buffers[bufferIndex];
+		const bool succeeded = std::fwrite(buffer.data(), 1, buffer.size(), m_pFile) == buffer.size()
+			&& std::fflush(m_pFile) == 0;
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			if (succeeded)
+			{
+				++m_NumFramesWritten;
+			}
+			else
+			{
+				m_HasFailed = true;
+				m_PendingBuffer = -1;
+			}
+		}
+
+		if (!succeeded)
+		{
+			std::cerr << "[FrameStream] Could not write frame, stopping the stream" << std::endl;
+			m_FrameTaken.notify_one();
+			return;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	struct Image;
+
+	enum class StreamFormat
+	{
+		RGB24, //raw, 3 bytes per pixel
+		RGBA32, //raw, 4 bytes per pixel (opaque alpha)
+		Y4M //YUV4MPEG2, 4:2:0 BT.601
+	};
+
+	/**
+	 * \brief Streams finished frames to stdout or a (named) pipe, e.g. for an encoder reading raw video.
+	 * Double buffered: while the writer thread pushes one frame into the pipe the next one is converted into the other buffer,
+	 * so only a pipe that stays slower than rendering makes Submit wait. Both buffers are allocated once in Open.
+	 */
+	class FrameStream final
+	{
+	public:
+		FrameStream() = default;
+		~FrameStream();
+
+		FrameStream(const FrameStream&) = delete;
+		FrameStream(FrameStream&&) noexcept = delete;
+		FrameStream& operator=(const FrameStream&) = delete;
+		FrameStream& operator=(FrameStream&&) noexcept = delete;
+
+		/**
+		 * \param target path of the file or pipe, "-" for stdout
+		 * \param framesPerSecond only used in the Y4M header, at least 1
+		 */
+		bool Open(const std::string& target, StreamFormat format, uint32_t width, uint32_t height, uint32_t framesPerSecond = 30);
+		//Writes the frames still pending, then closes the output
+		void Close();
+		bool IsOpen() const { return m_pFile != nullptr; }
+
+		//Returns false once writing failed (e.g. the reading end of the pipe was closed)
+		bool Submit(const Image& frame);
+
+		uint64_t GetNumFramesWritten() const;
+
+		//Format from a name like "rgb", "rgba" or "y4m", false if unknown
+		static bool ParseFormat(const std::string& name, StreamFormat& format);
+
+	private:
+		FILE* m_pFile{ nullptr };
+		bool m_OwnsFile{ false };
+		StreamFormat m_Format{};
+		uint32_t m_Width{};
+		uint32_t m_Height{};
+
+		std::vector<uint8_t> m_Buffers[2]{};
+		int m_NextBuffer{};
+		int m_PendingBuffer{ -1 };
+		bool m_IsStopping{ false };
+		bool m_HasFailed{ false };
+		uint64_t m_NumFramesWritten{};
+		mutable std::mutex m_Mutex{};
+		std::condition_variable m_FrameAdded{};
+		std::condition_variable m_FrameTaken{};
+
+		std::thread m_Thread{};
+
+		void ConvertFrame(const Image& frame, std::vector<uint8_t>& buffer) const;
+		void Run();
+	};
+}
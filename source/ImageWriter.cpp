@@ -0,0 +1,526 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace dae;
+
+namespace
+{
+#pragma region Helpers
+	void AppendU16LE(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	void AppendU32LE(std::vector<uint8_t>& out, uint32_t value)
+	{
+		AppendU16LE(out, value & 0xFFFF);
+		AppendU16LE(out, value >> 16);
+	}
+
+	void AppendU32BE(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	bool WriteFile(const std::string& filename, const void* pData, size_t size)
+	{
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+		return static_cast<bool>(file);
+	}
+
+	float GetFloatChannel(const Image& image, size_t index)
+	{
+		return image.rgbFloat.empty() ? image.rgb[index] / 255.f : image.rgbFloat[index];
+	}
+#pragma endregion
+
+#pragma region BMP/PPM/PFM
+	bool WriteBMP(const Image& image, const std::string& filename)
+	{
+		const uint32_t rowSize = (image.width * 3 + 3) & ~3u;
+		const uint32_t headerSize = 14 + 40;
+
+		std::vector<uint8_t> out{};
+		out.reserve(headerSize + size_t(rowSize) * image.height);
+		out.push_back('B');
+		out.push_back('M');
+		AppendU32LE(out, headerSize + rowSize * image.height);
+		AppendU32LE(out, 0);
+		AppendU32LE(out, headerSize);
+
+		//BITMAPINFOHEADER
+		AppendU32LE(out, 40);
+		AppendU32LE(out, image.width);
+		AppendU32LE(out, image.height);
+		AppendU16LE(out, 1); //planes
+		AppendU16LE(out, 24); //bits per pixel
+		AppendU32LE(out, 0); //no compression
+		AppendU32LE(out, rowSize * image.height);
+		AppendU32LE(out, 2835); //72 dpi
+		AppendU32LE(out, 2835);
+		AppendU32LE(out, 0);
+		AppendU32LE(out, 0);
+
+		//Bottom up, BGR
+		for (uint32_t y = image.height; y-- > 0;)
+		{
+			const uint8_t* pRow = &image.rgb[size_t(y) * image.width * 3];
+			for (uint32_t x = 0; x < image.width; ++x)
+			{
+				out.push_back(pRow[x * 3 + 2]);
+				out.push_back(pRow[x * 3 + 1]);
+				out.push_back(pRow[x * 3]);
+			}
+			out.resize(out.size() + rowSize - image.width * 3, 0);
+		}
+
+		return WriteFile(filename, out.data(), out.size());
+	}
+
+	bool WritePPM(const Image& image, const std::string& filename)
+	{
+		const std::string header = "P6\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n255\n";
+
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		file.write(reinterpret_cast<const char*>(image.rgb.data()), static_cast<std::streamsize>(image.rgb.size()));
+		return static_cast<bool>(file);
+	}
+
+	bool WritePFM(const Image& image, const std::string& filename)
+	{
+		//Negative scale means little endian
+		const std::string header = "PF\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n-1.0\n";
+
+		std::vector<float> row(size_t(image.width) * 3);
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+		//Bottom up
+		for (uint32_t y = image.height; y-- > 0;)
+		{
+			const size_t rowStart = size_t(y) * image.width * 3;
+			for (size_t i = 0; i < row.size(); ++i)
+				row[i] = GetFloatChannel(image, rowStart + i);
+
+			file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+		}
+		return static_cast<bool>(file);
+	}
+#pragma endregion
+
+#pragma region PNG
+	uint32_t UpdateCRC(uint32_t crc, const uint8_t* pData, size_t size)
+	{
+		static const std::array<uint32_t, 256> table = []
+			{
+				std::array<uint32_t, 256> result{};
+				for (uint32_t n = 0; n < 256; ++n)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; ++k)
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					result[n] = c;
+				}
+				return result;
+			}();
+
+		for (size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+		return crc;
+	}
+
+	uint32_t Adler32(const std::vector<uint8_t>& data)
+	{
+		constexpr uint32_t modulo{ 65521 };
+		//Largest block for which the sums can't overflow before taking the modulo
+		constexpr size_t blockSize{ 5552 };
+
+		uint32_t a{ 1 };
+		uint32_t b{ 0 };
+		for (size_t start = 0; start < data.size(); start += blockSize)
+		{
+			const size_t end = std::min(start + blockSize, data.size());
+			for (size_t i = start; i < end; ++i)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= modulo;
+			b %= modulo;
+		}
+		return (b << 16) | a;
+	}
+
+	void AppendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+	{
+		AppendU32BE(out, static_cast<uint32_t>(data.size()));
+		const size_t typeStart = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+
+		const uint32_t crc = UpdateCRC(0xFFFFFFFFu, &out[typeStart], out.size() - typeStart) ^ 0xFFFFFFFFu;
+		AppendU32BE(out, crc);
+	}
+
+	void DeflateStored(const std::vector<uint8_t>& data, std::vector<uint8_t>& out)
+	{
+		constexpr size_t maxBlockSize{ 65535 };
+
+		size_t start = 0;
+		do
+		{
+			const size_t size = std::min(maxBlockSize, data.size() - start);
+			const bool isFinal = start + size == data.size();
+
+			out.push_back(isFinal ? 1 : 0); //BFINAL, BTYPE 00
+			AppendU16LE(out, static_cast<uint32_t>(size));
+			AppendU16LE(out, static_cast<uint32_t>(~size & 0xFFFF));
+			out.insert(out.end(), data.begin() + start, data.begin() + start + size);
+			start += size;
+		} while (start < data.size());
+	}
+
+	class BitWriter final
+	{
+	public:
+		explicit BitWriter(std::vector<uint8_t>& out) : m_Out{ out } {}
+
+		//LSB first, as deflate stores everything but Huffman codes
+		void Write(uint32_t bits, int count)
+		{
+			m_Buffer |= static_cast<uint64_t>(bits) << m_Count;
+			m_Count += count;
+			while (m_Count >= 8)
+			{
+				m_Out.push_back(static_cast<uint8_t>(m_Buffer));
+				m_Buffer >>= 8;
+				m_Count -= 8;
+			}
+		}
+
+		//Huffman codes are stored MSB first
+		void WriteCode(uint32_t code, int length)
+		{
+			uint32_t reversed{};
+			for (int i = 0; i < length; ++i)
+				reversed |= ((code >> i) & 1) << (length - 1 - i);
+			Write(reversed, length);
+		}
+
+		void Finish()
+		{
+			if (m_Count > 0)
+				m_Out.push_back(static_cast<uint8_t>(m_Buffer));
+			m_Buffer = 0;
+			m_Count = 0;
+		}
+
+	private:
+		std::vector<uint8_t>& m_Out;
+		uint64_t m_Buffer{};
+		int m_Count{};
+	};
+
+	void WriteFixedLiteral(BitWriter& writer, uint32_t symbol)
+	{
+		if (symbol < 144)
+			writer.WriteCode(0x30 + symbol, 8);
+		else if (symbol < 256)
+			writer.WriteCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			writer.WriteCode(symbol - 256, 7);
+		else
+			writer.WriteCode(0xC0 + symbol - 280, 8);
+	}
+
+	void WriteMatch(BitWriter& writer, uint32_t length, uint32_t distance)
+	{
+		static constexpr uint16_t lengthBase[29]{ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static constexpr uint8_t lengthExtra[29]{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static constexpr uint16_t distanceBase[30]{ 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static constexpr uint8_t distanceExtra[30]{ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		int lengthCode = 28;
+		while (lengthBase[lengthCode] > length)
+			--lengthCode;
+		WriteFixedLiteral(writer, 257 + lengthCode);
+		writer.Write(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+		int distanceCode = 29;
+		while (distanceBase[distanceCode] > distance)
+			--distanceCode;
+		writer.WriteCode(distanceCode, 5);
+		writer.Write(distance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+	}
+
+	//Single block with the fixed Huffman table and greedy LZ77 matching against the last occurrence of each 3-byte hash
+	void DeflateFast(const std::vector<uint8_t>& data, std::vector<uint8_t>& out)
+	{
+		constexpr uint32_t windowSize{ 32768 };
+		constexpr uint32_t minMatch{ 3 };
+		constexpr uint32_t maxMatch{ 258 };
+		constexpr int hashBits{ 15 };
+
+		std::vector<int64_t> lastPosition(size_t(1) << hashBits, -1);
+		const auto hash = [&data](size_t i)
+		{
+			const uint32_t value = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+			return (value * 2654435761u) >> (32 - hashBits);
+		};
+
+		BitWriter writer{ out };
+		writer.Write(1, 1); //BFINAL
+		writer.Write(1, 2); //BTYPE 01, fixed Huffman
+
+		const size_t size = data.size();
+		size_t i = 0;
+		while (i < size)
+		{
+			uint32_t matchLength{};
+			size_t matchDistance{};
+			if (i + minMatch <= size)
+			{
+				const uint32_t h = hash(i);
+				const int64_t candidate = lastPosition[h];
+				lastPosition[h] = static_cast<int64_t>(i);
+
+				if (candidate >= 0 && i - candidate <= windowSize)
+				{
+					const size_t maxLength = std::min<size_t>(maxMatch, size - i);
+					uint32_t length = 0;
+					while (length < maxLength && data[candidate + length] == data[i + length])
+						++length;
+
+					if (length >= minMatch)
+					{
+						matchLength = length;
+						matchDistance = i - candidate;
+					}
+				}
+			}
+
+			if (matchLength == 0)
+			{
+				WriteFixedLiteral(writer, data[i]);
+				++i;
+				continue;
+			}
+
+			WriteMatch(writer, matchLength, static_cast<uint32_t>(matchDistance));
+
+			//Keep the hash table up to date inside the match, so the next match can start anywhere
+			const size_t end = i + matchLength;
+			for (++i; i < end; ++i)
+			{
+				if (i + minMatch <= size)
+					lastPosition[hash(i)] = static_cast<int64_t>(i);
+			}
+		}
+
+		WriteFixedLiteral(writer, 256); //end of block
+		writer.Finish();
+	}
+
+	bool WritePNG(const Image& image, const std::string& filename, bool compress)
+	{
+		//Every row starts with its filter type, Sub (difference to the left pixel) makes smooth gradients compress well
+		const size_t rowBytes = size_t(image.width) * 3;
+		std::vector<uint8_t> raw{};
+		raw.reserve((rowBytes + 1) * image.height);
+		for (uint32_t y = 0; y < image.height; ++y)
+		{
+			const uint8_t* pRow = &image.rgb[y * rowBytes];
+			raw.push_back(compress ? 1 : 0);
+			for (size_t x = 0; x < rowBytes; ++x)
+				raw.push_back(compress && x >= 3 ? static_cast<uint8_t>(pRow[x] - pRow[x - 3]) : pRow[x]);
+		}
+
+		//zlib stream: header, deflate data, Adler-32 of the uncompressed data
+		std::vector<uint8_t> idat{ 0x78, 0x01 };
+		if (compress)
+			DeflateFast(raw, idat);
+		else
+			DeflateStored(raw, idat);
+		AppendU32BE(idat, Adler32(raw));
+
+		std::vector<uint8_t> ihdr{};
+		AppendU32BE(ihdr, image.width);
+		AppendU32BE(ihdr, image.height);
+		ihdr.push_back(8); //bit depth
+		ihdr.push_back(2); //RGB
+		ihdr.push_back(0); //deflate
+		ihdr.push_back(0); //adaptive filtering
+		ihdr.push_back(0); //no interlace
+
+		std::vector<uint8_t> out{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendChunk(out, "IHDR", ihdr);
+		AppendChunk(out, "IDAT", idat);
+		AppendChunk(out, "IEND", {});
+
+		return WriteFile(filename, out.data(), out.size());
+	}
+#pragma endregion
+}
+
+ImageWriter::ImageWriter(size_t maxQueuedImages) :
+	m_MaxQueuedImages{ std::max<size_t>(maxQueuedImages, 1) }
+{
+	m_Thread = std::thread([this] { Run(); });
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_IsStopping = true;
+	}
+	m_JobAdded.notify_one();
+
+	//Pending images are still written
+	m_Thread.join();
+}
+
+void ImageWriter::Submit(Image&& image, const std::string& filename, ImageFormat format)
+{
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_JobDone.wait(lock, [this] { return m_Jobs.size() < m_MaxQueuedImages; });
+		m_Jobs.push_back({ std::move(image), filename, format });
+	}
+	m_JobAdded.notify_one();
+}
+
+std::string ImageWriter::SubmitFrame(Image&& image)
+{
+	char frameNumber[16]{};
+	std::snprintf(frameNumber, sizeof(frameNumber), "_%05u.", m_NextFrame++);
+
+	std::string filename = m_SequenceBaseName + frameNumber + GetExtension(m_SequenceFormat);
+	Submit(std::move(image), filename, m_SequenceFormat);
+	return filename;
+}
+
+void ImageWriter::Flush()
+{
+	std::unique_lock lock{ m_Mutex };
+	m_JobDone.wait(lock, [this] { return m_Jobs.empty() && !m_IsWriting; });
+}
+
+void ImageWriter::SetSequence(const std::string& baseName, ImageFormat format, uint32_t firstFrame)
+{
+	m_SequenceBaseName = baseName;
+	m_SequenceFormat = format;
+	m_NextFrame = firstFrame;
+}
+
+size_t ImageWriter::GetNumWritten() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_NumWritten;
+}
+
+size_t ImageWriter::GetNumFailed() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_NumFailed;
+}
+
+const char* ImageWriter::GetExtension(ImageFormat format)
+{
+	switch (format)
+	{
+	case ImageFormat::BMP:
+		return "bmp";
+	case ImageFormat::PPM:
+		return "ppm";
+	case ImageFormat::PFM:
+		return "pfm";
+	case ImageFormat::PNG:
+	case ImageFormat::PNG_Fast:
+	default:
+		return "png";
+	}
+}
+
+bool ImageWriter::ParseFormat(const std::string& name, ImageFormat& format)
+{
+	if (name == "bmp")
+		format = ImageFormat::BMP;
+	else if (name == "ppm")
+		format = ImageFormat::PPM;
+	else if (name == "pfm")
+		format = ImageFormat::PFM;
+	else if (name == "png")
+		format = ImageFormat::PNG_Fast;
+	else if (name == "png-stored")
+		format = ImageFormat::PNG;
+	else
+		return false;
+
+	return true;
+}
+
+bool ImageWriter::WriteImage(const Image& image, const std::string& filename, ImageFormat format)
+{
+	if (image.width == 0 || image.height == 0 || image.rgb.size() < size_t(image.width) * image.height * 3)
+		return false;
+
+	switch (format)
+	{
+	case ImageFormat::BMP:
+		return WriteBMP(image, filename);
+	case ImageFormat::PPM:
+		return WritePPM(image, filename);
+	case ImageFormat::PFM:
+		return WritePFM(image, filename);
+	case ImageFormat::PNG:
+		return WritePNG(image, filename, false);
+	case ImageFormat::PNG_Fast:
+		return WritePNG(image, filename, true);
+	}
+	return false;
+}
+
+void ImageWriter::Run()
+{
+	while (true)
+	{
+		Job job{};
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_JobAdded.wait(lock, [this] { return !m_Jobs.empty() || m_IsStopping; });
+			if (m_Jobs.empty())
+				return;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+			m_IsWriting = true;
+		}
+
+		const bool succeeded = WriteImage(job.image, job.filename, job.format);
+		if (!succeeded)
+			std::cout << "[ImageWriter] Could not write " << job.filename << std::endl;
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsWriting = false;
+			++(succeeded ? m_NumWritten : m_NumFailed);
+		}
+		m_JobDone.notify_all();
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	enum class ImageFormat
+	{
+		BMP, //24-bit
+		PPM, //binary 8-bit (P6)
+		PFM, //32-bit float, keeps the unclamped colors
+		PNG, //8-bit RGB, stored (uncompressed) deflate blocks
+		PNG_Fast //8-bit RGB, fast LZ77 + fixed Huffman deflate
+	};
+
+	//Copy of a finished frame, rows top to bottom
+	struct Image
+	{
+		uint32_t width{};
+		uint32_t height{};
+		std::vector<uint8_t> rgb{}; //3 per pixel
+		std::vector<float> rgbFloat{}; //3 per pixel, only filled in when the frame is captured for PFM
+	};
+
+	/**
+	 * \brief Writes images on a background thread, so saving a frame costs the render loop only the copy of the frame.
+	 * Frames submitted with SubmitFrame are numbered ("<baseName>_00042.png"), Submit writes to a given file.
+	 */
+	class ImageWriter final
+	{
+	public:
+		//maxQueuedImages bounds the memory held by pending images, submitting blocks while the queue is full
+		explicit ImageWriter(size_t maxQueuedImages = 8);
+		~ImageWriter();
+
+		ImageWriter(const ImageWriter&) = delete;
+		ImageWriter(ImageWriter&&) noexcept = delete;
+		ImageWriter& operator=(const ImageWriter&) = delete;
+		ImageWriter& operator=(ImageWriter&&) noexcept = delete;
+
+		void Submit(Image&& image, const std::string& filename, ImageFormat format);
+		//Numbered file in the current sequence, returns the file name it will be written to
+		std::string SubmitFrame(Image&& image);
+		//Waits until every submitted image has been written
+		void Flush();
+
+		void SetSequence(const std::string& baseName, ImageFormat format, uint32_t firstFrame = 0);
+		ImageFormat GetSequenceFormat() const { return m_SequenceFormat; }
+
+		size_t GetNumWritten() const;
+		size_t GetNumFailed() const;
+
+		static const char* GetExtension(ImageFormat format);
+		//Format from a name like "png" or "pfm", false if unknown
+		static bool ParseFormat(const std::string& name, ImageFormat& format);
+		static bool WriteImage(const Image& image, const std::string& filename, ImageFormat format);
+
+	private:
+		struct Job
+		{
+			Image image{};
+			std::string filename{};
+			ImageFormat format{};
+		};
+
+		std::deque<Job> m_Jobs{};
+		size_t m_MaxQueuedImages{};
+		bool m_IsWriting{ false };
+		bool m_IsStopping{ false };
+		size_t m_NumWritten{};
+		size_t m_NumFailed{};
+		mutable std::mutex m_Mutex{};
+		std::condition_variable m_JobAdded{};
+		std::condition_variable m_JobDone{};
+
+		std::string m_SequenceBaseName{ "RayTracing_Buffer" };
+		ImageFormat m_SequenceFormat{ ImageFormat::BMP };
+		uint32_t m_NextFrame{};
+
+		std::thread m_Thread{};
+
+		void Run();
+	};
+}
@@ -0,0 +1,151 @@
+#include "Kernels.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+using namespace dae;
+
+namespace
+{
+	struct CPUIDResult
+	{
+		uint32_t eax{};
+		uint32_t ebx{};
+		uint32_t ecx{};
+		uint32_t edx{};
+	};
+
+	CPUIDResult CPUID(uint32_t leaf, uint32_t subLeaf = 0)
+	{
+		CPUIDResult result{};
+#if defined(_MSC_VER)
+		int registers[4]{};
+		__cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subLeaf));
+		result = { uint32_t(registers[0]), uint32_t(registers[1]), uint32_t(registers[2]), uint32_t(registers[3]) };
+#else
+		__cpuid_count(leaf, subLeaf, result.eax, result.ebx, result.ecx, result.edx);
+#endif
+		return result;
+	}
+
+	//Which register states the OS saves on a context switch
+	uint64_t GetEnabledXSaveFeatures()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax{}, edx{};
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (uint64_t(edx) << 32) | eax;
+#endif
+	}
+
+	bool HasBit(uint32_t value, int bit)
+	{
+		return (value >> bit) & 1u;
+	}
+
+	KernelTable GetKernelTable(CPUPath path)
+	{
+		switch (path)
+		{
+		case CPUPath::SSE42:
+			return GetKernelTable_SSE42();
+		case CPUPath::AVX2:
+			return GetKernelTable_AVX2();
+		case CPUPath::AVX512:
+			return GetKernelTable_AVX512();
+		default:
+			return GetKernelTable_SSE2();
+		}
+	}
+}
+
+KernelTable dae::g_Kernels{ GetKernelTable(DetectCPUPath()) };
+
+CPUPath dae::DetectCPUPath()
+{
+	const uint32_t maxLeaf = CPUID(0).eax;
+	const CPUIDResult leaf1 = CPUID(1);
+	if (!HasBit(leaf1.ecx, 20)) //SSE4.2
+		return CPUPath::SSE2;
+
+	//AVX needs the OS to save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+	const bool hasOSXSave = HasBit(leaf1.ecx, 27);
+	const uint64_t xSaveFeatures = hasOSXSave ? GetEnabledXSaveFeatures() : 0;
+	const bool hasAVXState = (xSaveFeatures & 0x6) == 0x6;
+	const bool hasAVX512State = (xSaveFeatures & 0xE6) == 0xE6; //+ opmask and both ZMM halves
+	if (maxLeaf < 7 || !hasAVXState || !HasBit(leaf1.ecx, 28) || !HasBit(leaf1.ecx, 12)) //AVX, FMA
+		return CPUPath::SSE42;
+
+	const CPUIDResult leaf7 = CPUID(7);
+	if (!HasBit(leaf7.ebx, 5)) //AVX2
+		return CPUPath::SSE42;
+
+	//Kernels_AVX512.cpp is built with /arch:AVX512, the compiler may use any of F, CD, BW, DQ and VL there
+	const bool hasAVX512 = HasBit(leaf7.ebx, 16) && HasBit(leaf7.ebx, 17) && HasBit(leaf7.ebx, 28) //F, DQ, CD
+		&& HasBit(leaf7.ebx, 30) && HasBit(leaf7.ebx, 31); //BW, VL
+	if (hasAVX512State && hasAVX512)
+		return CPUPath::AVX512;
+
+	return CPUPath::AVX2;
+}
+
+bool dae::SelectKernels(CPUPath path)
+{
+	if (path > DetectCPUPath())
+		return false;
+
+	g_Kernels = GetKernelTable(path);
+	return true;
+}
+
+const char* dae::GetCPUPathName(CPUPath path)
+{
+	switch (path)
+	{
+	case CPUPath::SSE2:
+		return "SSE2";
+	case CPUPath::SSE42:
+		return "SSE4.2";
+	case CPUPath::AVX2:
+		return "AVX2";
+	case CPUPath::AVX512:
+		return "AVX-512";
+	}
+	return "Unknown";
+}
+
+bool dae::ParseCPUPath(const std::string& name, CPUPath& path)
+{
+	if (name == "sse2")
+		path = CPUPath::SSE2;
+	else if (name == "sse42")
+		path = CPUPath::SSE42;
+	else if (name == "avx2")
+		path = CPUPath::AVX2;
+	else if (name == "avx512")
+		path = CPUPath::AVX512;
+	else
+		return false;
+
+	return true;
+}
+
+void dae::TransformPoints(const Matrix& transform, const Vector3* pIn, Vector3* pOut, size_t count)
+{
+	g_Kernels.TransformPoints(transform, pIn, pOut, static_cast<uint32_t>(count));
+}
+
+void dae::TransformNormals(const Matrix& normalTransform, const Vector3* pIn, Vector3* pOut, size_t count)
+{
+	g_Kernels.TransformNormals(normalTransform, pIn, pOut, static_cast<uint32_t>(count));
+}
+
+void dae::DotBatch(const Vector3* pA, const Vector3* pB, float* pOut, size_t count)
+{
+	g_Kernels.DotBatch(pA, pB, pOut, static_cast<uint32_t>(count));
+}
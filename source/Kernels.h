@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Instruction set a kernel table was compiled for, from slowest to fastest
+	enum class CPUPath : uint8_t
+	{
+		SSE2, //always available on x64
+		SSE42,
+		AVX2, //+ FMA
+		AVX512 //AVX-512 F, CD, BW, DQ and VL (Skylake-SP and later)
+	};
+
+	//Everything the Cook-Torrance kernel needs from a Material, see Material::CreateCookTorrence
+	struct CookTorrenceParameters
+	{
+		ColorRGB diffuse{}; //albedo / PI, black for metals
+		ColorRGB baseReflectivity{}; //f0
+		float alphaSquared{}; //roughness^4
+		float geometryK{};
+		bool isMetal{};
+	};
+
+	//Where the color channels go in a 32-bit pixel, same as SDL_MapRGB: (c >> loss) << shift | alphaMask
+	struct PixelLayout
+	{
+		uint32_t shift[3]{}; //r, g, b
+		uint32_t loss[3]{};
+		uint32_t alphaMask{};
+	};
+
+	//One pass of the edge-aware a-trous denoiser over a frame, see Renderer::Denoise. Every buffer is a plane per channel
+	//(width * height floats), so the taps of neighbouring pixels are next to each other.
+	struct DenoiseInput
+	{
+		const float* pColors[3]{}; //r, g, b, output of the previous pass
+		//Guides, from the view ray's first hit
+		const float* pNormals[3]{}; //x, y, z
+		const float* pAlbedos[3]{}; //r, g, b
+		const float* pDepths{}; //FLT_MAX for pixels without a hit, those keep their color
+		uint32_t width{};
+		uint32_t height{};
+		uint32_t step{}; //pixels between the taps: 1, 2, 4...
+		//Differences that cut a tap's weight to 1 / e
+		float colorSigma{}; //luminance
+		float depthSigma{}; //relative to the depth, per pixel of distance
+		float albedoSigma{};
+	};
+
+	/**
+	 * \brief The hot loops, compiled once per CPUPath (Kernels_SSE2.cpp ... Kernels_AVX512.cpp, all from KernelsImpl.inl)
+	 * and picked once at startup, so one binary uses AVX-512 where it can and still runs on plain SSE2 machines.
+	 * Every kernel gives the same result as the scalar code it replaces (up to FMA contraction on the AVX paths).
+	 * "Stride" arguments are the distance in bytes between consecutive elements, so arrays of structs can be passed in place.
+	 */
+	struct KernelTable
+	{
+		CPUPath path{};
+
+		/**
+		 * \brief Same tests as GeometryUtils::HitTest_Triangle over indexed triangles (3 indices and 1 normal per triangle)
+		 * \param isAnyHit return the first hit instead of the closest (shadow rays, this also flips the culling)
+		 * \param t distance of the hit, only written when there is one
+		 * \return index of the triangle that was hit, -1 if none
+		 */
+		int (*IntersectTriangles)(const Ray& ray, const Vector3* pPositions, const int* pIndices, const Vector3* pNormals,
+			uint32_t numTriangles, TriangleCullMode cullMode, bool isAnyHit, float& t);
+
+		//Same as GeometryUtils::HitTest_Sphere over all spheres, returns the index of the (closest) hit or -1
+		int (*IntersectSpheres)(const Ray& ray, const Sphere* pSpheres, uint32_t numSpheres, bool isAnyHit, float& t);
+
+		//SlabTest_AABB for many boxes, pResults[i] is 1 when box i is hit
+		void (*SlabTest)(const Ray& ray, const Vector3* pMin, const Vector3* pMax, uint32_t stride, uint32_t count,
+			uint8_t* pResults);
+
+		//Material::ShadeBatch for Cook-Torrance
+		void (*ShadeCookTorrence)(const CookTorrenceParameters& parameters, uint32_t count, const Vector3* pNormals,
+			const Vector3* pLightDirections, const Vector3* pViewDirections, ColorRGB* pResults);
+
+		//ColorRGB::MaxToOne and SDL_MapRGB for a row of pixels, pixels whose pIsWritten is 0 keep their value
+		void (*ResolvePixels)(const ColorRGB* pColors, const uint8_t* pIsWritten, uint32_t count, const PixelLayout& layout,
+			uint32_t* pPixels);
+
+		/**
+		 * \brief 5x5 B3-spline taps, step pixels apart, around count pixels of row y starting at x, written to the same pixels
+		 * of the r, g and b planes of pResults. Every tap is weighted by how close its luminance, depth and albedo are to
+		 * the center and by (normal . center normal)^128. No scalar version.
+		 */
+		void (*DenoiseRow)(const DenoiseInput& input, uint32_t x, uint32_t y, uint32_t count, float* const* pResults);
+
+		//The batch functions of SIMD.h (TransformPoints, TransformNormals, DotBatch), over tightly packed Vector3's
+		void (*TransformPoints)(const Matrix& transform, const Vector3* pIn, Vector3* pOut, uint32_t count);
+		void (*TransformNormals)(const Matrix& normalTransform, const Vector3* pIn, Vector3* pOut, uint32_t count);
+		void (*DotBatch)(const Vector3* pA, const Vector3* pB, float* pOut, uint32_t count);
+	};
+
+	//The selected table, every hit test goes through it
+	extern KernelTable g_Kernels;
+
+	//Fastest path the CPU (and OS, for the AVX registers) supports, from cpuid
+	CPUPath DetectCPUPath();
+	//Switches g_Kernels, returns false (and keeps the current table) if the CPU doesn't support the path
+	bool SelectKernels(CPUPath path);
+
+	const char* GetCPUPathName(CPUPath path);
+	//Path from a name like "sse2", "sse42", "avx2" or "avx512", false if unknown
+	bool ParseCPUPath(const std::string& name, CPUPath& path);
+
+	//One per kernel file
+	KernelTable GetKernelTable_SSE2();
+	KernelTable GetKernelTable_SSE42();
+	KernelTable GetKernelTable_AVX2();
+	KernelTable GetKernelTable_AVX512();
+}
@@ -0,0 +1,868 @@
+//Shared source of the kernel files, each Kernels_<path>.cpp defines KERNEL_PATH_<path> and KERNEL_TABLE_FUNCTION, then includes this.
+//Those files are compiled with their own instruction set (see RayTracer.vcxproj), so everything the kernels run has to be
+//local to the file: intrinsics and the helpers in the anonymous namespace below, never an inline function of the shared headers
+//(the linker keeps a single copy of those, which could be the AVX-512 one) and nothing that runs during static initialization.
+//The types of the shared headers are fine, as long as only their fields are used.
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <immintrin.h>
+
+#include "Kernels.h"
+
+using namespace dae;
+
+namespace
+{
+#pragma region Lanes
+#if defined(KERNEL_PATH_AVX512)
+	constexpr uint32_t g_Width{ 16 };
+	using vfloat = __m512;
+	using vint = __m512i;
+	using vmask = __mmask16;
+
+	vfloat Set(float f) { return _mm512_set1_ps(f); }
+	vfloat Add(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+	vfloat Sub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+	vfloat Mul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+	vfloat Div(vfloat a, vfloat b) { return _mm512_div_ps(a, b); }
+	vfloat Sqrt(vfloat a) { return _mm512_sqrt_ps(a); }
+	//a < b ? a : b, like _mm_min_ps
+	vfloat Min(vfloat a, vfloat b) { return _mm512_min_ps(a, b); }
+	vfloat Max(vfloat a, vfloat b) { return _mm512_max_ps(a, b); }
+
+	vmask Less(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	vmask Greater(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	vmask GreaterEqual(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	vmask Equal(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+	vmask And(vmask a, vmask b) { return static_cast<vmask>(a & b); }
+	vmask Or(vmask a, vmask b) { return static_cast<vmask>(a | b); }
+	//b without the lanes of a
+	vmask AndNot(vmask a, vmask b) { return static_cast<vmask>(~a & b); }
+	vfloat Select(vmask m, vfloat a, vfloat b) { return _mm512_mask_blend_ps(m, b, a); }
+	uint32_t ToBits(vmask m) { return m; }
+	vmask FromBits(uint32_t bits) { return static_cast<vmask>(bits); }
+
+	//pBase[pOffsets[lane]]
+	vfloat Gather(const float* pBase, const int32_t* pOffsets)
+	{
+		return _mm512_i32gather_ps(_mm512_loadu_si512(pOffsets), pBase, 4);
+	}
+	vfloat Load(const float* p) { return _mm512_loadu_ps(p); }
+	void Store(float* p, vfloat a) { _mm512_storeu_ps(p, a); }
+
+	vint ToInt(vfloat a) { return _mm512_cvttps_epi32(a); }
+	vint SetInt(uint32_t i) { return _mm512_set1_epi32(static_cast<int>(i)); }
+	vint AndInt(vint a, vint b) { return _mm512_and_si512(a, b); }
+	vint OrInt(vint a, vint b) { return _mm512_or_si512(a, b); }
+	vint ShiftLeft(vint a, uint32_t count) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint ShiftRight(vint a, uint32_t count) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint AddInt(vint a, vint b) { return _mm512_add_epi32(a, b); }
+	vfloat ToFloat(vint a) { return _mm512_cvtepi32_ps(a); }
+	//Same bits
+	vfloat AsFloat(vint a) { return _mm512_castsi512_ps(a); }
+	void StoreInt(uint32_t* p, vint a) { _mm512_storeu_si512(p, a); }
+#elif defined(KERNEL_PATH_AVX2)
+	constexpr uint32_t g_Width{ 8 };
+	using vfloat = __m256;
+	using vint = __m256i;
+	using vmask = __m256;
+
+	vfloat Set(float f) { return _mm256_set1_ps(f); }
+	vfloat Add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	vfloat Sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	vfloat Mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+	vfloat Div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+	vfloat Sqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+	vfloat Min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+	vfloat Max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+
+	vmask Less(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	vmask Greater(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	vmask GreaterEqual(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	vmask Equal(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	vmask And(vmask a, vmask b) { return _mm256_and_ps(a, b); }
+	vmask Or(vmask a, vmask b) { return _mm256_or_ps(a, b); }
+	vmask AndNot(vmask a, vmask b) { return _mm256_andnot_ps(a, b); }
+	vfloat Select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); }
+	uint32_t ToBits(vmask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+	vmask FromBits(uint32_t bits)
+	{
+		const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), laneBits), laneBits));
+	}
+
+	vfloat Gather(const float* pBase, const int32_t* pOffsets)
+	{
+		return _mm256_i32gather_ps(pBase, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pOffsets)), 4);
+	}
+	vfloat Load(const float* p) { return _mm256_loadu_ps(p); }
+	void Store(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+
+	vint ToInt(vfloat a) { return _mm256_cvttps_epi32(a); }
+	vint SetInt(uint32_t i) { return _mm256_set1_epi32(static_cast<int>(i)); }
+	vint AndInt(vint a, vint b) { return _mm256_and_si256(a, b); }
+	vint OrInt(vint a, vint b) { return _mm256_or_si256(a, b); }
+	vint ShiftLeft(vint a, uint32_t count) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint ShiftRight(vint a, uint32_t count) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint AddInt(vint a, vint b) { return _mm256_add_epi32(a, b); }
+	vfloat ToFloat(vint a) { return _mm256_cvtepi32_ps(a); }
+	vfloat AsFloat(vint a) { return _mm256_castsi256_ps(a); }
+	void StoreInt(uint32_t* p, vint a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+
+	//Lanes [4 * i, 4 * i + 4) from and to SSE registers, for the packed Vector3 transposes
+	vfloat FromQuarters(const __m128* p) { return _mm256_set_m128(p[1], p[0]); }
+	void ToQuarters(vfloat a, __m128* p)
+	{
+		p[0] = _mm256_castps256_ps128(a);
+		p[1] = _mm256_extractf128_ps(a, 1);
+	}
+#elif defined(KERNEL_PATH_SSE42) || defined(KERNEL_PATH_SSE2)
+	constexpr uint32_t g_Width{ 4 };
+	using vfloat = __m128;
+	using vint = __m128i;
+	using vmask = __m128;
+
+	vfloat Set(float f) { return _mm_set1_ps(f); }
+	vfloat Add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	vfloat Sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	vfloat Mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+	vfloat Div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+	vfloat Sqrt(vfloat a) { return _mm_sqrt_ps(a); }
+	vfloat Min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+	vfloat Max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+
+	vmask Less(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+	vmask Greater(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+	vmask GreaterEqual(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+	vmask Equal(vfloat a, vfloat b) { return _mm_cmpeq_ps(a, b); }
+	vmask And(vmask a, vmask b) { return _mm_and_ps(a, b); }
+	vmask Or(vmask a, vmask b) { return _mm_or_ps(a, b); }
+	vmask AndNot(vmask a, vmask b) { return _mm_andnot_ps(a, b); }
+#if defined(KERNEL_PATH_SSE42)
+	vfloat Select(vmask m, vfloat a, vfloat b) { return _mm_blendv_ps(b, a, m); }
+#else
+	vfloat Select(vmask m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+#endif
+	uint32_t ToBits(vmask m) { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+	vmask FromBits(uint32_t bits)
+	{
+		const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(static_cast<int>(bits)), laneBits), laneBits));
+	}
+
+	//No gather instruction before AVX2
+	vfloat Gather(const float* pBase, const int32_t* pOffsets)
+	{
+		return _mm_setr_ps(pBase[pOffsets[0]], pBase[pOffsets[1]], pBase[pOffsets[2]], pBase[pOffsets[3]]);
+	}
+	vfloat Load(const float* p) { return _mm_loadu_ps(p); }
+	void Store(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+
+	vint ToInt(vfloat a) { return _mm_cvttps_epi32(a); }
+	vint SetInt(uint32_t i) { return _mm_set1_epi32(static_cast<int>(i)); }
+	vint AndInt(vint a, vint b) { return _mm_and_si128(a, b); }
+	vint OrInt(vint a, vint b) { return _mm_or_si128(a, b); }
+	vint ShiftLeft(vint a, uint32_t count) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint ShiftRight(vint a, uint32_t count) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(static_cast<int>(count))); }
+	vint AddInt(vint a, vint b) { return _mm_add_epi32(a, b); }
+	vfloat ToFloat(vint a) { return _mm_cvtepi32_ps(a); }
+	vfloat AsFloat(vint a) { return _mm_castsi128_ps(a); }
+	void StoreInt(uint32_t* p, vint a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+
+	vfloat FromQuarters(const __m128* p) { return p[0]; }
+	void ToQuarters(vfloat a, __m128* p) { p[0] = a; }
+#else
+#error Define one of the KERNEL_PATH_ macros before including KernelsImpl.inl
+#endif
+
+	constexpr uint32_t g_AllLanes{ (1u << g_Width) - 1 };
+
+	//Lanes [0, numLanes) of a block
+	vmask FirstLanes(uint32_t numLanes)
+	{
+		return FromBits(numLanes >= g_Width ? g_AllLanes : (1u << numLanes) - 1);
+	}
+
+	uint32_t GetNumLanes(uint32_t first, uint32_t count)
+	{
+		return count - first < g_Width ? count - first : g_Width;
+	}
+
+	vfloat Abs(vfloat a)
+	{
+		return Max(a, Sub(Set(0.f), a));
+	}
+
+	//e^x for x <= 0, within about 0.03%, results under e^-80 become e^-80
+	vfloat ExpNegative(vfloat x)
+	{
+		//2^t = 2^whole * 2^fraction, the fraction in (-1, 0] since ToInt truncates towards 0
+		const vfloat t = Mul(Max(x, Set(-80.f)), Set(1.44269504f)); //log2(e)
+		const vint whole = ToInt(t);
+		const vfloat f = Sub(t, ToFloat(whole));
+		//Taylor series of 2^f up to f^5
+		vfloat power = Add(Mul(f, Set(0.0013333558f)), Set(0.0096181291f));
+		power = Add(Mul(f, power), Set(0.0555041087f));
+		power = Add(Mul(f, power), Set(0.2402265070f));
+		power = Add(Mul(f, power), Set(0.6931471806f));
+		power = Add(Mul(f, power), Set(1.f));
+		//Adds whole to the exponent bits
+		return Mul(power, AsFloat(ShiftLeft(AddInt(whole, SetInt(127)), 23)));
+	}
+#pragma endregion
+
+#pragma region Vectors
+	//g_Width Vector3's in SoA layout, same operation order as the scalar Vector3 so the results match
+	struct vec3
+	{
+		vfloat x;
+		vfloat y;
+		vfloat z;
+	};
+
+	vec3 Set(const Vector3& v) { return { Set(v.x), Set(v.y), Set(v.z) }; }
+	vec3 Add(const vec3& a, const vec3& b) { return { Add(a.x, b.x), Add(a.y, b.y), Add(a.z, b.z) }; }
+	vec3 Sub(const vec3& a, const vec3& b) { return { Sub(a.x, b.x), Sub(a.y, b.y), Sub(a.z, b.z) }; }
+	vec3 Mul(const vec3& a, vfloat s) { return { Mul(a.x, s), Mul(a.y, s), Mul(a.z, s) }; }
+	vec3 Div(const vec3& a, vfloat s) { return { Div(a.x, s), Div(a.y, s), Div(a.z, s) }; }
+	vec3 Div(const vec3& a, const vec3& b) { return { Div(a.x, b.x), Div(a.y, b.y), Div(a.z, b.z) }; }
+
+	vfloat Dot(const vec3& a, const vec3& b)
+	{
+		return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z));
+	}
+
+	vec3 Cross(const vec3& a, const vec3& b)
+	{
+		return {
+			Sub(Mul(a.y, b.z), Mul(a.z, b.y)),
+			Sub(Mul(a.z, b.x), Mul(a.x, b.z)),
+			Sub(Mul(a.x, b.y), Mul(a.y, b.x)) };
+	}
+
+	vec3 Normalized(const vec3& a)
+	{
+		return Mul(a, Div(Set(1.f), Sqrt(Dot(a, a))));
+	}
+
+	//(pBase + pOffsets[lane])->x/y/z
+	vec3 Gather3(const float* pBase, const int32_t* pOffsets)
+	{
+		return { Gather(pBase, pOffsets), Gather(pBase + 1, pOffsets), Gather(pBase + 2, pOffsets) };
+	}
+
+#if defined(KERNEL_PATH_AVX512)
+	//Two-source permute indices for the packed Vector3 transposes: the 48 floats of 16 Vector3's are 3 registers a, b, c
+	struct PackedIndices
+	{
+		alignas(64) int32_t load[3][2][16]; //per component: from a and b, then the result and c
+		alignas(64) int32_t store[3][2][16]; //per register: from x and y, then the result and z
+	};
+
+	constexpr PackedIndices MakePackedIndices()
+	{
+		PackedIndices indices{};
+		for (int32_t i = 0; i < 16; ++i)
+		{
+			for (int32_t component = 0; component < 3; ++component)
+			{
+				const int32_t index = 3 * i + component;
+				indices.load[component][0][i] = index < 32 ? index : 0;
+				indices.load[component][1][i] = index < 32 ? i : 16 + index - 32;
+			}
+			for (int32_t block = 0; block < 3; ++block)
+			{
+				const int32_t index = 16 * block + i;
+				const int32_t component = index % 3;
+				const int32_t lane = index / 3;
+				indices.store[block][0][i] = component == 1 ? 16 + lane : lane;
+				indices.store[block][1][i] = component == 2 ? 16 + lane : i;
+			}
+		}
+		return indices;
+	}
+	constexpr PackedIndices g_PackedIndices{ MakePackedIndices() };
+
+	vfloat Permute(vfloat a, vfloat b, const int32_t* pIndices)
+	{
+		return _mm512_permutex2var_ps(a, _mm512_load_si512(pIndices), b);
+	}
+
+	//p[0..g_Width), tightly packed, with three contiguous loads
+	inline vec3 LoadPacked(const Vector3* p)
+	{
+		const float* pFloats = &p->x;
+		const vfloat a = Load(pFloats);
+		const vfloat b = Load(pFloats + 16);
+		const vfloat c = Load(pFloats + 32);
+		const auto& indices = g_PackedIndices.load;
+		return {
+			Permute(Permute(a, b, indices[0][0]), c, indices[0][1]),
+			Permute(Permute(a, b, indices[1][0]), c, indices[1][1]),
+			Permute(Permute(a, b, indices[2][0]), c, indices[2][1]) };
+	}
+
+	//Inverse of LoadPacked
+	inline void StorePacked(Vector3* p, const vec3& v)
+	{
+		float* pFloats = &p->x;
+		const auto& indices = g_PackedIndices.store;
+		for (int block = 0; block < 3; ++block)
+			Store(pFloats + 16 * block, Permute(Permute(v.x, v.y, indices[block][0]), v.z, indices[block][1]));
+	}
+#else
+	//p[0..g_Width), tightly packed, transposed 4 at a time with contiguous loads (see Vector3x4::LoadPacked)
+	inline vec3 LoadPacked(const Vector3* p)
+	{
+		__m128 x[g_Width / 4];
+		__m128 y[g_Width / 4];
+		__m128 z[g_Width / 4];
+		for (uint32_t quarter = 0; quarter < g_Width / 4; ++quarter)
+		{
+			const Vector3x4 v = Vector3x4::LoadPacked(p + quarter * 4);
+			x[quarter] = v.x;
+			y[quarter] = v.y;
+			z[quarter] = v.z;
+		}
+		return { FromQuarters(x), FromQuarters(y), FromQuarters(z) };
+	}
+
+	//Inverse of LoadPacked
+	inline void StorePacked(Vector3* p, const vec3& v)
+	{
+		__m128 x[g_Width / 4];
+		__m128 y[g_Width / 4];
+		__m128 z[g_Width / 4];
+		ToQuarters(v.x, x);
+		ToQuarters(v.y, y);
+		ToQuarters(v.z, z);
+		for (uint32_t quarter = 0; quarter < g_Width / 4; ++quarter)
+			Vector3x4{ x[quarter], y[quarter], z[quarter] }.StorePacked(p + quarter * 4);
+	}
+#endif
+
+	//Rows 0-2 (the axes) and 3 (the translation) of a matrix, broadcast
+	struct mat4x3
+	{
+		vec3 rows[4];
+	};
+
+	mat4x3 Set(const Matrix& matrix)
+	{
+		mat4x3 result{};
+		for (int r = 0; r < 4; ++r)
+		{
+			const Vector4 row = matrix[r];
+			result.rows[r] = Set(Vector3{ row.x, row.y, row.z });
+		}
+		return result;
+	}
+
+	//Same order as Matrix::TransformVector
+	inline vec3 TransformVector(const mat4x3& m, const vec3& v)
+	{
+		return Add(Add(Mul(m.rows[0], v.x), Mul(m.rows[1], v.y)), Mul(m.rows[2], v.z));
+	}
+#pragma endregion
+
+#pragma region Kernels
+	template<TriangleCullMode cullMode, bool isAnyHit>
+	int IntersectTriangles(const Ray& ray, const Vector3* pPositions, const int* pIndices, const Vector3* pNormals,
+		uint32_t numTriangles, float& t)
+	{
+		const float* pPositionFloats = &pPositions->x;
+		const float* pNormalFloats = &pNormals->x;
+		const vec3 origin = Set(ray.origin);
+		const vec3 direction = Set(ray.direction);
+		const vfloat zero = Set(0.f);
+		const vfloat three = Set(3.f);
+		const vfloat rayMin = Set(ray.min);
+
+		alignas(64) int32_t offsets0[g_Width];
+		alignas(64) int32_t offsets1[g_Width];
+		alignas(64) int32_t offsets2[g_Width];
+		alignas(64) int32_t normalOffsets[g_Width];
+		alignas(64) float hitDistances[g_Width];
+
+		float closestT = ray.max;
+		int closestIndex = -1;
+		for (uint32_t first = 0; first < numTriangles; first += g_Width)
+		{
+			//Lanes past the end repeat the first triangle and are masked out
+			const uint32_t numLanes = GetNumLanes(first, numTriangles);
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+			{
+				const uint32_t triangle = first + (lane < numLanes ? lane : 0);
+				offsets0[lane] = pIndices[triangle * 3] * 3;
+				offsets1[lane] = pIndices[triangle * 3 + 1] * 3;
+				offsets2[lane] = pIndices[triangle * 3 + 2] * 3;
+				normalOffsets[lane] = static_cast<int32_t>(triangle * 3);
+			}
+
+			const vec3 normal = Gather3(pNormalFloats, normalOffsets);
+			const vfloat viewAngle = Dot(normal, direction);
+			vmask isHit = AndNot(Equal(viewAngle, zero), FirstLanes(numLanes)); //parallel to the triangle
+			if constexpr (cullMode == TriangleCullMode::BackFaceCulling)
+				isHit = AndNot(isAnyHit ? Less(viewAngle, zero) : Greater(viewAngle, zero), isHit);
+			else if constexpr (cullMode == TriangleCullMode::FrontFaceCulling)
+				isHit = AndNot(isAnyHit ? Greater(viewAngle, zero) : Less(viewAngle, zero), isHit);
+			if (ToBits(isHit) == 0)
+				continue;
+
+			const vec3 v0 = Gather3(pPositionFloats, offsets0);
+			const vec3 v1 = Gather3(pPositionFloats, offsets1);
+			const vec3 v2 = Gather3(pPositionFloats, offsets2);
+
+			const vec3 center = Div(Add(Add(v0, v1), v2), three);
+			const vfloat hitDistance = Div(Dot(Sub(center, origin), normal), Dot(direction, normal));
+			isHit = AndNot(Or(Less(hitDistance, rayMin), Greater(hitDistance, Set(closestT))), isHit);
+			if (ToBits(isHit) == 0)
+				continue;
+
+			const vec3 p = Add(origin, Mul(direction, hitDistance));
+			const vec3 v0ToP = Sub(p, v0);
+			isHit = AndNot(Less(Dot(normal, Cross(Sub(v1, v0), v0ToP)), zero), isHit);
+			isHit = AndNot(Greater(Dot(normal, Cross(Sub(v2, v0), v0ToP)), zero), isHit);
+			isHit = AndNot(Less(Dot(normal, Cross(Sub(v2, v1), Sub(p, v1))), zero), isHit);
+
+			const uint32_t hitBits = ToBits(isHit);
+			if (hitBits == 0)
+				continue;
+
+			Store(hitDistances, hitDistance);
+			//In lane order, so ties resolve like the scalar loop (the later triangle wins)
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+			{
+				if (!((hitBits >> lane) & 1) || hitDistances[lane] > closestT)
+					continue;
+
+				closestT = hitDistances[lane];
+				closestIndex = static_cast<int>(first + lane);
+				if constexpr (isAnyHit)
+				{
+					t = closestT;
+					return closestIndex;
+				}
+			}
+		}
+
+		if (closestIndex >= 0)
+			t = closestT;
+		return closestIndex;
+	}
+
+	int IntersectTriangles(const Ray& ray, const Vector3* pPositions, const int* pIndices, const Vector3* pNormals,
+		uint32_t numTriangles, TriangleCullMode cullMode, bool isAnyHit, float& t)
+	{
+		if (numTriangles == 0)
+			return -1;
+
+		switch (cullMode)
+		{
+		case TriangleCullMode::BackFaceCulling:
+			return isAnyHit ? IntersectTriangles<TriangleCullMode::BackFaceCulling, true>(ray, pPositions, pIndices, pNormals, numTriangles, t)
+				: IntersectTriangles<TriangleCullMode::BackFaceCulling, false>(ray, pPositions, pIndices, pNormals, numTriangles, t);
+		case TriangleCullMode::FrontFaceCulling:
+			return isAnyHit ? IntersectTriangles<TriangleCullMode::FrontFaceCulling, true>(ray, pPositions, pIndices, pNormals, numTriangles, t)
+				: IntersectTriangles<TriangleCullMode::FrontFaceCulling, false>(ray, pPositions, pIndices, pNormals, numTriangles, t);
+		default:
+			return isAnyHit ? IntersectTriangles<TriangleCullMode::NoCulling, true>(ray, pPositions, pIndices, pNormals, numTriangles, t)
+				: IntersectTriangles<TriangleCullMode::NoCulling, false>(ray, pPositions, pIndices, pNormals, numTriangles, t);
+		}
+	}
+
+	int IntersectSpheres(const Ray& ray, const Sphere* pSpheres, uint32_t numSpheres, bool isAnyHit, float& t)
+	{
+		static_assert(offsetof(Sphere, origin) == 0 && sizeof(Sphere) % sizeof(float) == 0);
+		constexpr int32_t stride = sizeof(Sphere) / sizeof(float);
+		constexpr int32_t radiusOffset = offsetof(Sphere, radius) / sizeof(float);
+		if (numSpheres == 0)
+			return -1;
+
+		const float* pSphereFloats = &pSpheres->origin.x;
+		const vec3 origin = Set(ray.origin);
+		const vec3 direction = Set(ray.direction);
+		const vfloat rayMin = Set(ray.min);
+
+		alignas(64) int32_t offsets[g_Width];
+		alignas(64) float hitDistances[g_Width];
+
+		float closestT = ray.max;
+		int closestIndex = -1;
+		for (uint32_t first = 0; first < numSpheres; first += g_Width)
+		{
+			const uint32_t numLanes = GetNumLanes(first, numSpheres);
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+				offsets[lane] = static_cast<int32_t>(first + (lane < numLanes ? lane : 0)) * stride;
+
+			const vec3 rayOriginToSphereOrigin = Sub(Gather3(pSphereFloats, offsets), origin);
+			const vfloat radius = Gather(pSphereFloats + radiusOffset, offsets);
+			const vfloat radiusSquared = Mul(radius, radius);
+			const vfloat side1 = Dot(rayOriginToSphereOrigin, direction);
+			const vfloat distanceToRaySquared = Sub(Dot(rayOriginToSphereOrigin, rayOriginToSphereOrigin), Mul(side1, side1));
+
+			vmask isHit = AndNot(GreaterEqual(distanceToRaySquared, radiusSquared), FirstLanes(numLanes));
+			const vfloat hitDistance = Sub(side1, Sqrt(Sub(radiusSquared, distanceToRaySquared)));
+			isHit = AndNot(Or(Less(hitDistance, rayMin), Greater(hitDistance, Set(closestT))), isHit);
+
+			const uint32_t hitBits = ToBits(isHit);
+			if (hitBits == 0)
+				continue;
+
+			Store(hitDistances, hitDistance);
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+			{
+				if (!((hitBits >> lane) & 1) || hitDistances[lane] > closestT)
+					continue;
+
+				closestT = hitDistances[lane];
+				closestIndex = static_cast<int>(first + lane);
+				if (isAnyHit)
+				{
+					t = closestT;
+					return closestIndex;
+				}
+			}
+		}
+
+		if (closestIndex >= 0)
+			t = closestT;
+		return closestIndex;
+	}
+
+	void SlabTest(const Ray& ray, const Vector3* pMin, const Vector3* pMax, uint32_t stride, uint32_t count, uint8_t* pResults)
+	{
+		if (count == 0)
+			return;
+
+		const float* pMinFloats = &pMin->x;
+		const float* pMaxFloats = &pMax->x;
+		const int32_t strideFloats = static_cast<int32_t>(stride / sizeof(float));
+		const vec3 origin = Set(ray.origin);
+		const vec3 direction = Set(ray.direction);
+		const vfloat zero = Set(0.f);
+
+		alignas(64) int32_t offsets[g_Width];
+		for (uint32_t first = 0; first < count; first += g_Width)
+		{
+			const uint32_t numLanes = GetNumLanes(first, count);
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+				offsets[lane] = static_cast<int32_t>(first + (lane < numLanes ? lane : 0)) * strideFloats;
+
+			const vec3 t1 = Div(Sub(Gather3(pMaxFloats, offsets), origin), direction);
+			const vec3 t2 = Div(Sub(Gather3(pMinFloats, offsets), origin), direction);
+
+			//Operand order gives the same results as std::min/std::max in SlabTest_AABB, NaN included
+			vfloat tMin = Min(t2.x, t1.x);
+			vfloat tMax = Max(t2.x, t1.x);
+			tMin = Max(Min(t2.y, t1.y), tMin);
+			tMax = Min(Max(t2.y, t1.y), tMax);
+			tMin = Max(Min(t2.z, t1.z), tMin);
+			tMax = Min(Max(t2.z, t1.z), tMax);
+
+			const uint32_t hitBits = ToBits(And(Greater(tMax, zero), GreaterEqual(tMax, tMin)));
+			for (uint32_t lane = 0; lane < numLanes; ++lane)
+				pResults[first + lane] = static_cast<uint8_t>((hitBits >> lane) & 1);
+		}
+	}
+
+	void ShadeCookTorrence(const CookTorrenceParameters& parameters, uint32_t count, const Vector3* pNormals,
+		const Vector3* pLightDirections, const Vector3* pViewDirections, ColorRGB* pResults)
+	{
+		if (count == 0)
+			return;
+
+		const vfloat one = Set(1.f);
+		const vfloat alphaSquared = Set(parameters.alphaSquared);
+		const vfloat geometryK = Set(parameters.geometryK);
+		const vfloat oneMinusK = Set(1.f - parameters.geometryK);
+		const vfloat f0[3]{ Set(parameters.baseReflectivity.r), Set(parameters.baseReflectivity.g), Set(parameters.baseReflectivity.b) };
+		const vfloat oneMinusF0[3]{
+			Set(1.f - parameters.baseReflectivity.r), Set(1.f - parameters.baseReflectivity.g), Set(1.f - parameters.baseReflectivity.b) };
+		const vfloat diffuse[3]{ Set(parameters.diffuse.r), Set(parameters.diffuse.g), Set(parameters.diffuse.b) };
+
+		alignas(64) int32_t offsets[g_Width];
+		alignas(64) float results[3][g_Width];
+		for (uint32_t first = 0; first < count; first += g_Width)
+		{
+			const uint32_t numLanes = GetNumLanes(first, count);
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+				offsets[lane] = static_cast<int32_t>(first + (lane < numLanes ? lane : 0)) * 3;
+
+			const vec3 n = Gather3(&pNormals->x, offsets);
+			const vec3 l = Gather3(&pLightDirections->x, offsets);
+			const vec3 v = Gather3(&pViewDirections->x, offsets);
+			const vec3 h = Normalized(Add(v, l));
+			const vfloat dotNV = Dot(n, v);
+			const vfloat dotNL = Dot(n, l);
+
+			//Fresnel (Schlick)
+			const vfloat x = Sub(one, Dot(h, v));
+			const vfloat x2 = Mul(x, x);
+			const vfloat x5 = Mul(Mul(x2, x2), x);
+			//Normal distribution (Trowbridge-Reitz GGX)
+			const vfloat dotNH = Dot(n, h);
+			const vfloat d = Add(Mul(Mul(dotNH, dotNH), Sub(alphaSquared, one)), one);
+			const vfloat distribution = Div(alphaSquared, Mul(Set(PI), Mul(d, d)));
+			//Geometry (Smith with Schlick-GGX)
+			const vfloat geometry = Mul(Div(dotNV, Add(Mul(dotNV, oneMinusK), geometryK)), Div(dotNL, Add(Mul(dotNL, oneMinusK), geometryK)));
+
+			const vfloat specularScale = Div(Mul(distribution, geometry), Mul(Set(4.f), Mul(dotNV, dotNL)));
+			for (int channel = 0; channel < 3; ++channel)
+			{
+				const vfloat fresnel = Add(f0[channel], Mul(oneMinusF0[channel], x5));
+				const vfloat specular = Mul(fresnel, specularScale);
+				Store(results[channel], parameters.isMetal ? specular : Add(Mul(Sub(one, fresnel), diffuse[channel]), specular));
+			}
+
+			for (uint32_t lane = 0; lane < numLanes; ++lane)
+			{
+				ColorRGB& result = pResults[first + lane];
+				result.r = results[0][lane];
+				result.g = results[1][lane];
+				result.b = results[2][lane];
+			}
+		}
+	}
+
+	void ResolvePixels(const ColorRGB* pColors, const uint8_t* pIsWritten, uint32_t count, const PixelLayout& layout, uint32_t* pPixels)
+	{
+		if (count == 0)
+			return;
+
+		const vfloat one = Set(1.f);
+		const vfloat maxChannel = Set(255.f);
+		const vint byteMask = SetInt(0xFF);
+		const vint alphaMask = SetInt(layout.alphaMask);
+
+		alignas(64) int32_t offsets[g_Width];
+		alignas(64) uint32_t pixels[g_Width];
+		for (uint32_t first = 0; first < count; first += g_Width)
+		{
+			const uint32_t numLanes = GetNumLanes(first, count);
+			uint32_t writtenBits = 0;
+			for (uint32_t lane = 0; lane < g_Width; ++lane)
+			{
+				offsets[lane] = static_cast<int32_t>(first + (lane < numLanes ? lane : 0)) * 3;
+				if (lane < numLanes && pIsWritten[first + lane])
+					writtenBits |= 1u << lane;
+			}
+			if (writtenBits == 0)
+				continue;
+
+			vec3 color = Gather3(&pColors->r, offsets);
+
+			//MaxToOne
+			const vfloat maxValue = Max(Max(color.z, color.y), color.x);
+			const vmask isOverOne = Greater(maxValue, one);
+			color = { Select(isOverOne, Div(color.x, maxValue), color.x),
+				Select(isOverOne, Div(color.y, maxValue), color.y),
+				Select(isOverOne, Div(color.z, maxValue), color.z) };
+
+			//static_cast<uint8_t>(c * 255)
+			const vint channels[3]{ AndInt(ToInt(Mul(color.x, maxChannel)), byteMask),
+				AndInt(ToInt(Mul(color.y, maxChannel)), byteMask),
+				AndInt(ToInt(Mul(color.z, maxChannel)), byteMask) };
+
+			vint pixel = alphaMask;
+			for (int channel = 0; channel < 3; ++channel)
+				pixel = OrInt(pixel, ShiftLeft(ShiftRight(channels[channel], layout.loss[channel]), layout.shift[channel]));
+
+			if (writtenBits == g_AllLanes)
+			{
+				StoreInt(pPixels + first, pixel);
+				continue;
+			}
+
+			StoreInt(pixels, pixel);
+			for (uint32_t lane = 0; lane < numLanes; ++lane)
+			{
+				if ((writtenBits >> lane) & 1)
+					pPixels[first + lane] = pixels[lane];
+			}
+		}
+	}
+
+	//The guides and color of g_Width pixels, from SoA planes
+	struct DenoiseTap
+	{
+		vec3 color;
+		vec3 normal;
+		vec3 albedo;
+		vfloat depth;
+	};
+
+	//Pixels [index, index + g_Width) of every plane
+	DenoiseTap LoadDenoiseTap(const DenoiseInput& input, size_t index)
+	{
+		return { { Load(input.pColors[0] + index), Load(input.pColors[1] + index), Load(input.pColors[2] + index) },
+			{ Load(input.pNormals[0] + index), Load(input.pNormals[1] + index), Load(input.pNormals[2] + index) },
+			{ Load(input.pAlbedos[0] + index), Load(input.pAlbedos[1] + index), Load(input.pAlbedos[2] + index) },
+			Load(input.pDepths + index) };
+	}
+
+	DenoiseTap GatherDenoiseTap(const DenoiseInput& input, const int32_t* pOffsets)
+	{
+		return { { Gather(input.pColors[0], pOffsets), Gather(input.pColors[1], pOffsets), Gather(input.pColors[2], pOffsets) },
+			{ Gather(input.pNormals[0], pOffsets), Gather(input.pNormals[1], pOffsets), Gather(input.pNormals[2], pOffsets) },
+			{ Gather(input.pAlbedos[0], pOffsets), Gather(input.pAlbedos[1], pOffsets), Gather(input.pAlbedos[2], pOffsets) },
+			Gather(input.pDepths, pOffsets) };
+	}
+
+	void DenoiseRow(const DenoiseInput& input, uint32_t x, uint32_t y, uint32_t count, float* const* pResults)
+	{
+		if (count == 0)
+			return;
+
+		//B3 spline, by distance from the center
+		constexpr float taps[3]{ 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+		const int32_t width = static_cast<int32_t>(input.width);
+		const int32_t height = static_cast<int32_t>(input.height);
+		const int32_t step = static_cast<int32_t>(input.step);
+		const size_t rowIndex = static_cast<size_t>(y) * input.width;
+		const vfloat zero = Set(0.f);
+		const vec3 luminanceWeights{ Set(0.2126f), Set(0.7152f), Set(0.0722f) };
+		const vfloat inverseColorSigma = Set(1.f / input.colorSigma);
+		const vfloat inverseAlbedoSigmaSquared = Set(1.f / (input.albedoSigma * input.albedoSigma));
+
+		alignas(64) int32_t offsets[g_Width];
+		alignas(64) float results[3][g_Width];
+		for (uint32_t first = 0; first < count; first += g_Width)
+		{
+			const uint32_t numLanes = GetNumLanes(first, count);
+			const int32_t firstX = static_cast<int32_t>(x + first);
+
+			//Blocks that would read past the row (the last one of the frame) gather, lanes past the end repeat the first pixel
+			DenoiseTap center{};
+			if (firstX + static_cast<int32_t>(g_Width) <= width)
+				center = LoadDenoiseTap(input, rowIndex + firstX);
+			else
+			{
+				for (uint32_t lane = 0; lane < g_Width; ++lane)
+					offsets[lane] = static_cast<int32_t>(rowIndex) + firstX + static_cast<int32_t>(lane < numLanes ? lane : 0);
+				center = GatherDenoiseTap(input, offsets);
+			}
+			const vfloat luminance = Dot(center.color, luminanceWeights);
+			const vmask hasHit = Less(center.depth, Set(FLT_MAX));
+			const vfloat inverseDepthSigma = Div(Set(1.f), Mul(center.depth, Set(input.depthSigma)));
+
+			vec3 sum{ zero, zero, zero };
+			vfloat weightSum = zero;
+			for (int32_t dy = -2; dy <= 2; ++dy)
+			{
+				const int32_t tapY = static_cast<int32_t>(y) + dy * step;
+				if (tapY < 0 || tapY >= height)
+					continue;
+
+				for (int32_t dx = -2; dx <= 2; ++dx)
+				{
+					//Near the left and right edge the taps outside the frame read the center and get no weight
+					const int32_t firstTapX = firstX + dx * step;
+					const size_t tapRowIndex = static_cast<size_t>(tapY) * input.width;
+					DenoiseTap tap{};
+					vmask isInside = FirstLanes(numLanes);
+					if (firstTapX >= 0 && firstTapX + static_cast<int32_t>(g_Width) <= width)
+						tap = LoadDenoiseTap(input, tapRowIndex + firstTapX);
+					else
+					{
+						uint32_t insideBits = 0;
+						for (uint32_t lane = 0; lane < g_Width; ++lane)
+						{
+							const int32_t tapX = firstTapX + static_cast<int32_t>(lane);
+							const bool isTapInside = lane < numLanes && tapX >= 0 && tapX < width;
+							if (isTapInside)
+								insideBits |= 1u << lane;
+							offsets[lane] = isTapInside ? static_cast<int32_t>(tapRowIndex) + tapX : static_cast<int32_t>(rowIndex) + firstX;
+						}
+						if (insideBits == 0)
+							continue;
+						tap = GatherDenoiseTap(input, offsets);
+						isInside = FromBits(insideBits);
+					}
+
+					//The depth may change more the further the tap is
+					const float distance = static_cast<float>(step) * sqrtf(static_cast<float>(dx * dx + dy * dy));
+					const vec3 albedoDifference = Sub(center.albedo, tap.albedo);
+					vfloat exponent = Mul(Abs(Sub(luminance, Dot(tap.color, luminanceWeights))), inverseColorSigma);
+					exponent = Add(exponent, Mul(Mul(Abs(Sub(center.depth, tap.depth)), inverseDepthSigma), Set(distance > 0.f ? 1.f / distance : 0.f)));
+					exponent = Add(exponent, Mul(Dot(albedoDifference, albedoDifference), inverseAlbedoSigmaSquared));
+					//NaN and infinity (taps without a hit) become the smallest weight
+					exponent = Min(exponent, Set(80.f));
+
+					vfloat normalWeight = Max(Dot(center.normal, tap.normal), zero);
+					for (int i = 0; i < 7; ++i)
+						normalWeight = Mul(normalWeight, normalWeight);
+
+					vfloat weight = Mul(Mul(Set(taps[dx < 0 ? -dx : dx] * taps[dy < 0 ? -dy : dy]), normalWeight), ExpNegative(Sub(zero, exponent)));
+					weight = Select(isInside, weight, zero);
+					sum = Add(sum, Mul(tap.color, weight));
+					weightSum = Add(weightSum, weight);
+				}
+			}
+
+			const vec3 filtered = Div(sum, weightSum);
+			const vfloat channels[3]{ Select(hasHit, filtered.x, center.color.x), Select(hasHit, filtered.y, center.color.y),
+				Select(hasHit, filtered.z, center.color.z) };
+			for (int channel = 0; channel < 3; ++channel)
+			{
+				if (numLanes == g_Width)
+				{
+					Store(pResults[channel] + rowIndex + firstX, channels[channel]);
+					continue;
+				}
+				Store(results[channel], channels[channel]);
+				for (uint32_t lane = 0; lane < numLanes; ++lane)
+					pResults[channel][rowIndex + firstX + lane] = results[channel][lane];
+			}
+		}
+	}
+
+	//Full blocks only, the rest goes through the scalar Matrix and Vector3 functions
+	void TransformPoints(const Matrix& transform, const Vector3* pIn, Vector3* pOut, uint32_t count)
+	{
+		const mat4x3 m = Set(transform);
+		uint32_t i = 0;
+		for (; i + g_Width <= count; i += g_Width)
+			StorePacked(pOut + i, Add(TransformVector(m, LoadPacked(pIn + i)), m.rows[3]));
+		for (; i < count; ++i)
+			pOut[i] = transform.TransformPoint(pIn[i]);
+	}
+
+	void TransformNormals(const Matrix& normalTransform, const Vector3* pIn, Vector3* pOut, uint32_t count)
+	{
+		const mat4x3 m = Set(normalTransform);
+		uint32_t i = 0;
+		for (; i + g_Width <= count; i += g_Width)
+			StorePacked(pOut + i, Normalized(TransformVector(m, LoadPacked(pIn + i))));
+		for (; i < count; ++i)
+			pOut[i] = normalTransform.TransformVector(pIn[i]).Normalized();
+	}
+
+	void DotBatch(const Vector3* pA, const Vector3* pB, float* pOut, uint32_t count)
+	{
+		uint32_t i = 0;
+		for (; i + g_Width <= count; i += g_Width)
+			Store(pOut + i, Dot(LoadPacked(pA + i), LoadPacked(pB + i)));
+		for (; i < count; ++i)
+			pOut[i] = Vector3::Dot(pA[i], pB[i]);
+	}
+#pragma endregion
+}
+
+KernelTable dae::KERNEL_TABLE_FUNCTION()
+{
+	KernelTable table{};
+	table.path = KERNEL_CPU_PATH;
+	table.IntersectTriangles = IntersectTriangles;
+	table.IntersectSpheres = IntersectSpheres;
+	table.SlabTest = SlabTest;
+	table.ShadeCookTorrence = ShadeCookTorrence;
+	table.ResolvePixels = ResolvePixels;
+	table.DenoiseRow = DenoiseRow;
+	//Qualified, the batch wrappers of the same name in SIMD.h would hide these inside namespace dae
+	table.TransformPoints = ::TransformPoints;
+	table.TransformNormals = ::TransformNormals;
+	table.DotBatch = ::DotBatch;
+	return table;
+}
@@ -0,0 +1,8 @@
+//Compiled with /arch:AVX2 (see RayTracer.vcxproj), only selected when cpuid reports AVX2 and FMA
+#if defined(__GNUC__)
+#pragma GCC target("avx2,fma")
+#endif
+#define KERNEL_PATH_AVX2
+#define KERNEL_CPU_PATH CPUPath::AVX2
+#define KERNEL_TABLE_FUNCTION GetKernelTable_AVX2
+#include "KernelsImpl.inl"
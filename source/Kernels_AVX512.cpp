@@ -0,0 +1,8 @@
+//Compiled with /arch:AVX512 (see RayTracer.vcxproj), only selected when cpuid reports AVX-512 F, CD, BW, DQ and VL
+#if defined(__GNUC__)
+#pragma GCC target("avx512f,avx512cd,avx512bw,avx512dq,avx512vl")
+#endif
+#define KERNEL_PATH_AVX512
+#define KERNEL_CPU_PATH CPUPath::AVX512
+#define KERNEL_TABLE_FUNCTION GetKernelTable_AVX512
+#include "KernelsImpl.inl"
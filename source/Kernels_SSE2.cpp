@@ -0,0 +1,5 @@
+//Baseline, SSE2 is part of x64 so this path runs everywhere
+#define KERNEL_PATH_SSE2
+#define KERNEL_CPU_PATH CPUPath::SSE2
+#define KERNEL_TABLE_FUNCTION GetKernelTable_SSE2
+#include "KernelsImpl.inl"
@@ -0,0 +1,8 @@
+//SSE4.1 blends, no /arch switch needed for MSVC since its intrinsics don't depend on it
+#if defined(__GNUC__)
+#pragma GCC target("sse4.2")
+#endif
+#define KERNEL_PATH_SSE42
+#define KERNEL_CPU_PATH CPUPath::SSE42
+#define KERNEL_TABLE_FUNCTION GetKernelTable_SSE42
+#include "KernelsImpl.inl"
@@ -0,0 +1,141 @@
+#include "LightGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "Utils.h"
+
+using namespace dae;
+
+void LightGrid::Build(const std::vector<Light>& lights, float radianceThreshold)
+{
+	m_RadiiSquared.resize(lights.size());
+	m_UnboundedLights.clear();
+	m_CellOffsets.clear();
+	m_LightIndices.clear();
+
+	Vector3 minBounds{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 maxBounds{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	float radiusSum{};
+	for (size_t i{ 0 }; i < lights.size(); ++i)
+	{
+		const float radius = LightUtils::GetInfluenceRadius(lights[i], radianceThreshold);
+		if (radius == FLT_MAX)
+		{
+			m_RadiiSquared[i] = FLT_MAX;
+			m_UnboundedLights.push_back(static_cast<int>(i));
+			continue;
+		}
+
+		m_RadiiSquared[i] = radius * radius;
+		const Vector3 extent{ radius, radius, radius };
+		minBounds = Vector3::Min(minBounds, lights[i].origin - extent);
+		maxBounds = Vector3::Max(maxBounds, lights[i].origin + extent);
+		radiusSum += radius;
+	}
+
+	const size_t numBoundedLights = lights.size() - m_UnboundedLights.size();
+	if (numBoundedLights == 0)
+	{
+		m_Dimensions[0] = m_Dimensions[1] = m_Dimensions[2] = 0;
+		return;
+	}
+
+	//Cells about the size of an average influence sphere
+	const float cellSize = std::max(radiusSum / numBoundedLights, 1e-3f);
+	m_Min = minBounds;
+	for (int axis{ 0 }; axis < 3; ++axis)
+	{
+		const float extent = maxBounds[axis] - minBounds[axis];
+		m_Dimensions[axis] = std::clamp(static_cast<int>(std::ceil(extent / cellSize)), 1, m_MaxCellsPerAxis);
+	}
+	m_CellsPerUnit = {
+		m_Dimensions[0] / std::max(maxBounds.x - minBounds.x, 1e-6f),
+		m_Dimensions[1] / std::max(maxBounds.y - minBounds.y, 1e-6f),
+		m_Dimensions[2] / std::max(maxBounds.z - minBounds.z, 1e-6f) };
+
+	//Range of cells the sphere of a light overlaps, every cell for the unbounded ones
+	const auto getCellRange = [&](size_t lightIndex, int first[3], int last[3])
+		{
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				first[axis] = 0;
+				last[axis] = m_Dimensions[axis] - 1;
+			}
+			if (m_RadiiSquared[lightIndex] == FLT_MAX)
+				return;
+
+			const float radius = sqrtf(m_RadiiSquared[lightIndex]);
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				const float cellsPerUnit = m_CellsPerUnit[axis];
+				const float center = lights[lightIndex].origin[axis] - m_Min[axis];
+				first[axis] = std::clamp(static_cast<int>((center - radius) * cellsPerUnit), 0, m_Dimensions[axis] - 1);
+				last[axis] = std::clamp(static_cast<int>((center + radius) * cellsPerUnit), 0, m_Dimensions[axis] - 1);
+			}
+		};
+
+	//Count, prefix sum, fill. Lights go in in index order, so every cell list is ascending.
+	const size_t numCells = static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1] * m_Dimensions[2];
+	m_CellOffsets.assign(numCells + 1, 0);
+	for (int pass{ 0 }; pass < 2; ++pass)
+	{
+		for (size_t i{ 0 }; i < lights.size(); ++i)
+		{
+			int first[3]{}, last[3]{};
+			getCellRange(i, first, last);
+			for (int z{ first[2] }; z <= last[2]; ++z)
+			{
+				for (int y{ first[1] }; y <= last[1]; ++y)
+				{
+					for (int x{ first[0] }; x <= last[0]; ++x)
+					{
+						const size_t cell = (static_cast<size_t>(z) * m_Dimensions[1] + y) * m_Dimensions[0] + x;
+						if (pass == 0)
+							++m_CellOffsets[cell + 1];
+						else
+							m_LightIndices[m_CellOffsets[cell]++] = static_cast<int>(i);
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (size_t cell{ 1 }; cell <= numCells; ++cell)
+				m_CellOffsets[cell] += m_CellOffsets[cell - 1];
+			m_LightIndices.resize(m_CellOffsets[numCells]);
+		}
+	}
+
+	//The fill moved every offset to the end of its cell
+	for (size_t cell{ numCells }; cell > 0; --cell)
+		m_CellOffsets[cell] = m_CellOffsets[cell - 1];
+	m_CellOffsets[0] = 0;
+}
+
+std::span<const int> LightGrid::GetLights(const Vector3& point) const
+{
+	if (m_CellOffsets.empty())
+		return m_UnboundedLights;
+
+	int cell[3]{};
+	for (int axis{ 0 }; axis < 3; ++axis)
+	{
+		const float position = (point[axis] - m_Min[axis]) * m_CellsPerUnit[axis];
+		//Outside the grid no light with a radius reaches
+		if (!(position >= 0.f) || position >= static_cast<float>(m_Dimensions[axis]))
+			return m_UnboundedLights;
+		cell[axis] = static_cast<int>(position);
+	}
+
+	const size_t index = (static_cast<size_t>(cell[2]) * m_Dimensions[1] + cell[1]) * m_Dimensions[0] + cell[0];
+	return { m_LightIndices.data() + m_CellOffsets[index], m_CellOffsets[index + 1] - m_CellOffsets[index] };
+}
+
+size_t LightGrid::GetMemoryUsage() const
+{
+	return m_CellOffsets.capacity() * sizeof(uint32_t) + (m_LightIndices.capacity() + m_UnboundedLights.capacity()) * sizeof(int)
+		+ m_RadiiSquared.capacity() * sizeof(float);
+}
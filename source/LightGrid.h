@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Uniform world grid over the influence spheres of the point lights, every cell lists the lights whose sphere
+	 * overlaps it. Outside its influence radius (LightUtils::GetInfluenceRadius) a light can't visibly light anything,
+	 * so a shading point only has to look at the lights of its cell. Cheap to build, the Renderer rebuilds it every frame.
+	 */
+	class LightGrid final
+	{
+	public:
+		LightGrid() = default;
+		~LightGrid() = default;
+
+		LightGrid(const LightGrid&) = delete;
+		LightGrid(LightGrid&&) noexcept = delete;
+		LightGrid& operator=(const LightGrid&) = delete;
+		LightGrid& operator=(LightGrid&&) noexcept = delete;
+
+		/**
+		 * \param radianceThreshold radiance (brightest channel) below which a light is ignored, 0 keeps every light everywhere
+		 */
+		void Build(const std::vector<Light>& lights, float radianceThreshold);
+
+		//Indices of the lights that may reach the point, ascending. Lights without a radius (directional) are in every list.
+		std::span<const int> GetLights(const Vector3& point) const;
+		//FLT_MAX for lights without a radius
+		float GetInfluenceRadiusSquared(int lightIndex) const { return m_RadiiSquared[lightIndex]; }
+
+		size_t GetMemoryUsage() const;
+
+	private:
+		static constexpr int m_MaxCellsPerAxis{ 32 };
+
+		Vector3 m_Min{};
+		Vector3 m_CellsPerUnit{};
+		int m_Dimensions[3]{}; //0 when no light has a radius
+		std::vector<uint32_t> m_CellOffsets{}; //into m_LightIndices, one more than there are cells
+		std::vector<int> m_LightIndices{};
+		std::vector<int> m_UnboundedLights{}; //the list outside the grid
+		std::vector<float> m_RadiiSquared{};
+	};
+}
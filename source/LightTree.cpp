@@ -0,0 +1,156 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	float GetPower(const Light& light)
+	{
+		return light.intensity * (0.2126f * light.color.r + 0.7152f * light.color.g + 0.0722f * light.color.b);
+	}
+}
+
+void LightTree::Build(const std::vector<Light>& lights)
+{
+	std::vector<LightReference> references{};
+	m_DirectionalLights.clear();
+	for (size_t i{ 0 }; i < lights.size(); ++i)
+	{
+		const Light& light = lights[i];
+		if (light.type == LightType::Directional)
+		{
+			m_DirectionalLights.push_back(static_cast<int>(i));
+			continue;
+		}
+
+		//Lights that can't light anything are never worth a shadow ray
+		const float power = GetPower(light);
+		if (power <= 0.f)
+			continue;
+
+		references.push_back({ light.origin, LightUtils::GetAreaLightExtent(light), power, static_cast<int>(i) });
+	}
+
+	m_Nodes.clear();
+	m_NumLights = static_cast<uint32_t>(references.size());
+	if (references.empty())
+		return;
+
+	m_Nodes.reserve(references.size() * 2 - 1);
+	BuildNode(references, 0, references.size());
+}
+
+uint32_t LightTree::BuildNode(std::vector<LightReference>& lights, size_t first, size_t last)
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(m_Nodes.size());
+	m_Nodes.emplace_back();
+
+	//Area lights are bounded whole, so the cosine bound still sees the parts in front of a point whose center is behind it
+	const auto getMin = [](const LightReference& light) { return light.origin - Vector3{ light.extent, light.extent, light.extent }; };
+	const auto getMax = [](const LightReference& light) { return light.origin + Vector3{ light.extent, light.extent, light.extent }; };
+	Node node{};
+	node.minAABB = getMin(lights[first]);
+	node.maxAABB = getMax(lights[first]);
+	for (size_t i{ first }; i < last; ++i)
+	{
+		node.minAABB = Vector3::Min(node.minAABB, getMin(lights[i]));
+		node.maxAABB = Vector3::Max(node.maxAABB, getMax(lights[i]));
+		node.power += lights[i].power;
+	}
+
+	if (last - first == 1)
+	{
+		node.lightIndex = lights[first].lightIndex;
+		m_Nodes[nodeIndex] = node;
+		return nodeIndex;
+	}
+
+	//Median split along the longest axis of the bounds
+	const Vector3 extent = node.maxAABB - node.minAABB;
+	const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	const size_t middle = first + (last - first) / 2;
+	std::nth_element(lights.begin() + first, lights.begin() + middle, lights.begin() + last,
+		[axis](const LightReference& a, const LightReference& b) { return a.origin[axis] < b.origin[axis]; });
+
+	BuildNode(lights, first, middle);
+	node.secondChild = BuildNode(lights, middle, last);
+	m_Nodes[nodeIndex] = node;
+	return nodeIndex;
+}
+
+float LightTree::GetImportance(const Node& node, const Vector3& origin, const Vector3& normal) const
+{
+	const Vector3 toCenter = (node.minAABB + node.maxAABB) * 0.5f - origin;
+	const float distanceSquared = toCenter.SqrMagnitude();
+	const float radiusSquared = (node.maxAABB - node.minAABB).SqrMagnitude() * 0.25f;
+
+	//Inside the bounding sphere any direction is possible, the radius keeps the distance from going to 0
+	constexpr float minDistanceSquared{ 1e-6f };
+	if (distanceSquared <= radiusSquared)
+		return node.power / std::max(radiusSquared, minDistanceSquared);
+
+	//Largest cosine between the normal and a direction into the bounding sphere: cos(max(angle - sphere angle, 0))
+	float cosineBound{ 1.f };
+	if (normal != Vector3::Zero)
+	{
+		const float cosAngle = Vector3::Dot(normal, toCenter) / sqrtf(distanceSquared);
+		const float sinSphere = sqrtf(radiusSquared / distanceSquared);
+		const float cosSphere = sqrtf(1.f - sinSphere * sinSphere);
+		if (cosAngle < cosSphere)
+		{
+			const float sinAngle = sqrtf(std::max(1.f - cosAngle * cosAngle, 0.f));
+			cosineBound = cosAngle * cosSphere + sinAngle * sinSphere;
+			if (cosineBound <= 0.f)
+				return 0.f;
+		}
+	}
+
+	return node.power * cosineBound / std::max(distanceSquared, minDistanceSquared);
+}
+
+int LightTree::Sample(const Vector3& origin, const Vector3& normal, float u, float& pdf) const
+{
+	pdf = 0.f;
+	if (m_Nodes.empty() || GetImportance(m_Nodes[0], origin, normal) <= 0.f)
+		return -1;
+
+	pdf = 1.f;
+	uint32_t nodeIndex{ 0 };
+	while (m_Nodes[nodeIndex].lightIndex < 0)
+	{
+		const uint32_t firstChild = nodeIndex + 1;
+		const uint32_t secondChild = m_Nodes[nodeIndex].secondChild;
+		const float firstImportance = GetImportance(m_Nodes[firstChild], origin, normal);
+		const float secondImportance = GetImportance(m_Nodes[secondChild], origin, normal);
+		const float totalImportance = firstImportance + secondImportance;
+		if (totalImportance <= 0.f)
+		{
+			pdf = 0.f;
+			return -1;
+		}
+
+		//Reuse u for the next level by rescaling the part of [0, 1) the picked child covered
+		const float firstProbability = firstImportance / totalImportance;
+		if (u < firstProbability)
+		{
+			nodeIndex = firstChild;
+			pdf *= firstProbability;
+			u /= firstProbability;
+		}
+		else
+		{
+			nodeIndex = secondChild;
+			pdf *= 1.f - firstProbability;
+			u = (u - firstProbability) / (1.f - firstProbability);
+		}
+		u = std::min(u, 0.99999994f); //largest float below 1
+	}
+
+	return m_Nodes[nodeIndex].lightIndex;
+}
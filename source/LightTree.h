@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Binary tree over the point and area lights of a scene, every node bounds its lights (area lights whole)
+	 * and knows their total power. Sample walks down from the root and picks a child by how much it could light the
+	 * shading point (power over distance squared, times a bound on the cosine with the normal), so the cost of picking
+	 * a light grows with log(lights) and the lights that matter are picked most. Directional lights are not in the tree.
+	 */
+	class LightTree final
+	{
+	public:
+		LightTree() = default;
+		~LightTree() = default;
+
+		LightTree(const LightTree&) = delete;
+		LightTree(LightTree&&) noexcept = delete;
+		LightTree& operator=(const LightTree&) = delete;
+		LightTree& operator=(LightTree&&) noexcept = delete;
+
+		//Rebuilds the tree from the lights, call again after lights were added or moved
+		void Build(const std::vector<Light>& lights);
+
+		//Number of point and area lights in the tree
+		uint32_t GetNumLights() const { return m_NumLights; }
+		//Indices of the directional lights, they light everything the same so they are always shaded
+		const std::vector<int>& GetDirectionalLights() const { return m_DirectionalLights; }
+
+		/**
+		 * \brief Picks one point or area light for a shading point
+		 * \param normal Vector3::Zero when the shading doesn't use the cosine, lights behind the point are picked too then
+		 * \param u uniform random number in [0, 1)
+		 * \param pdf probability the returned light had to be picked
+		 * \return index into the lights the tree was built from, -1 if no light can reach the point
+		 */
+		int Sample(const Vector3& origin, const Vector3& normal, float u, float& pdf) const;
+
+		size_t GetMemoryUsage() const { return m_Nodes.capacity() * sizeof(Node) + m_DirectionalLights.capacity() * sizeof(int); }
+
+	private:
+		struct Node
+		{
+			Vector3 minAABB{};
+			Vector3 maxAABB{};
+			float power{}; //sum of intensity * luminance of the color
+			uint32_t secondChild{}; //the first one follows its parent
+			int lightIndex{ -1 }; //leaves only
+		};
+		std::vector<Node> m_Nodes{};
+		uint32_t m_NumLights{};
+		std::vector<int> m_DirectionalLights{};
+
+		struct LightReference
+		{
+			Vector3 origin{};
+			float extent{}; //of area lights, 0 for point lights
+			float power{};
+			int lightIndex{};
+		};
+		uint32_t BuildNode(std::vector<LightReference>& lights, size_t first, size_t last);
+		//Estimated contribution of the lights below the node, 0 when none of them can reach the point
+		float GetImportance(const Node& node, const Vector3& origin, const Vector3& normal) const;
+	};
+}
@@ -1,211 +1,186 @@
 #pragma once
+#include <cstdint>
+
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
+#include "Kernels.h"
 
 namespace dae
 {
-#pragma region Material BASE
-	class Material
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
-
-		bool IsReflective() const { return m_IsReflective; }
-
-	protected:
-		bool m_IsReflective{ false };
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence,
+		Mirror //reflects the view ray tinted by its albedo, shaded as Cook-Torrance where the reflection isn't followed
 	};
-#pragma endregion
 
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
+	/**
+	 * \brief Flat material, every kind shares one layout so the scene can keep them by value in a single vector.
+	 * Shading switches on the type instead of a virtual call and everything that only depends on the parameters
+	 * (Lambert term, base reflectivity, squared roughness...) is computed once in the Create functions.
+	 */
+	class Material final
 	{
 	public:
-		Material_SolidColor(const ColorRGB& color): m_Color(color)
-		{
-		}
+		Material() = default;
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+#pragma region Factories
+		static Material CreateSolidColor(const ColorRGB& color)
 		{
-			return m_Color;
+			Material material{};
+			material.m_Type = MaterialType::SolidColor;
+			material.m_Diffuse = color;
+			material.m_Albedo = color;
+			return material;
 		}
 
-	private:
-		ColorRGB m_Color{colors::White};
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT
-	//LAMBERT
-	//=======
-	class Material_Lambert final : public Material
-	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		static Material CreateLambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
-			//todo: W3
-			/*assert(false && "Not Implemented Yet");
-			return {};*/
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			Material material{};
+			material.m_Type = MaterialType::Lambert;
+			material.m_Diffuse = BRDF::Lambert(diffuseReflectance, diffuseColor);
+			material.m_Albedo = diffuseColor;
+			return material;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{1.f}; //kd
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT PHONG
-	//LAMBERT-PHONG
-	//=============
-	class Material_LambertPhong final : public Material
-	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		static Material CreateLambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
+			Material material{};
+			material.m_Type = MaterialType::LambertPhong;
+			material.m_Diffuse = BRDF::Lambert(kd, diffuseColor);
+			material.m_Albedo = diffuseColor;
+			material.m_SpecularReflectance = ks;
+			material.m_PhongExponent = phongExponent;
+			return material;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \param albedo base color, also the reflectivity of metals
+		 * \param metalness 0 is dielectric, anything else is treated as metal
+		 * \param roughness [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		 */
+		static Material CreateCookTorrence(const ColorRGB& albedo, float metalness, float roughness)
 		{
-			//todo: W3
-			/*assert(false && "Not Implemented Yet");
-			return {};*/
-			//return BRDF::Phong(m_DiffuseReflectance, m_PhongExponent, l, -v, hitRecord.normal);
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor)
-				+ BRDF::Phong(m_DiffuseReflectance, m_PhongExponent, l, -v, hitRecord.normal);
+			Material material{};
+			material.m_Type = MaterialType::CookTorrence;
+			material.m_IsMetal = metalness != 0.f;
+			//Metals have no diffuse part, dielectrics scale it by 1 - Fresnel while shading
+			material.m_Diffuse = material.m_IsMetal ? ColorRGB{} : albedo * (1.f / PI);
+			material.m_BaseReflectivity = material.m_IsMetal ? albedo : ColorRGB{ 0.04f, 0.04f, 0.04f };
+			material.m_Albedo = albedo;
+
+			//Squared (UE4) roughness, squared once more inside GGX
+			const float alpha = Square(roughness);
+			material.m_AlphaSquared = Square(alpha);
+			material.m_GeometryK = Square(alpha + 1.f) / 8.f; //direct lighting
+			return material;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{0.5f}; //kd
-		float m_SpecularReflectance{0.5f}; //ks
-		float m_PhongExponent{1.f}; //Phong Exponent
-	};
-#pragma endregion
-
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
-	{
-	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		static Material CreateMirror(const ColorRGB& albedo, float metalness, float roughness)
 		{
+			Material material = CreateCookTorrence(albedo, metalness, roughness);
+			material.m_Type = MaterialType::Mirror;
+			material.m_IsReflective = true;
+			material.m_Reflectance = albedo;
+			return material;
 		}
+#pragma endregion
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \brief Function used to calculate the correct color for the specific material and its parameters
+		 * \param hitRecord current hitrecord
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
-			//todo: W3
-			/*assert(false && "Not Implemented Yet");
-			return {};*/
-
-			ColorRGB baseSurfaceReflectivity{ m_Albedo };
-			if (m_Metalness == 0)
-			{
-				//Dielectric
-				//ColorRGB baseSurfaceReflectivity{ m_Albedo };
-				baseSurfaceReflectivity = ColorRGB(0.04f, 0.04f, 0.04f);
-			}
-
-			Vector3 normalizedHalfVector{ v + l };
-			normalizedHalfVector.Normalize();
-			float squaredRoughness{ Square(m_Roughness) };
-
-			ColorRGB FresnelFunction{ BRDF::FresnelFunction_Schlick(normalizedHalfVector, v, baseSurfaceReflectivity) };
-			float normalDistributionFunction{BRDF::NormalDistribution_GGX(hitRecord.normal, normalizedHalfVector, squaredRoughness)};
-			float GeometryFunction{BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, squaredRoughness)};
-
-			float devision{ 4 * (Vector3::Dot(v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal)) };
-			ColorRGB specular{ (normalDistributionFunction * FresnelFunction * GeometryFunction) * (1 / devision) };
-
-			ColorRGB kd{};
-			if (m_Metalness == 0)
+			switch (m_Type)
 			{
-				kd = ColorRGB(1, 1, 1) - FresnelFunction;
+			case MaterialType::SolidColor:
+			case MaterialType::Lambert:
+				return m_Diffuse;
+			case MaterialType::LambertPhong:
+				return m_Diffuse + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
+			case MaterialType::CookTorrence:
+			case MaterialType::Mirror:
+				return ShadeCookTorrence(hitRecord.normal, l, v);
 			}
-			
-			ColorRGB diffuse = BRDF::Lambert(kd, m_Albedo);
-
-			return diffuse + specular;
-			//return ColorRGB(1,1,1) * FresnelFunction;
+			return {};
 		}
 
-	private:
-		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
-		float m_Metalness{1.0f};
-		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
-	};
-
-
-	class Material_Mirror final : public Material
-	{
-	public:
-		Material_Mirror(const ColorRGB& albedo, float metalness, float roughness) :
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
-		{
-			m_IsReflective = true;
-		}
-
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		//Shade for many hits with this material at once, the type is only switched on once
+		void ShadeBatch(size_t count, const Vector3* pNormals, const Vector3* pLightDirections, const Vector3* pViewDirections,
+			ColorRGB* pResults) const
 		{
-			ColorRGB baseSurfaceReflectivity{ m_Albedo };
-			if (m_Metalness == 0)
+			switch (m_Type)
+			{
+			case MaterialType::SolidColor:
+			case MaterialType::Lambert:
+				for (size_t i = 0; i < count; ++i)
+					pResults[i] = m_Diffuse;
+				break;
+			case MaterialType::LambertPhong:
+				for (size_t i = 0; i < count; ++i)
+					pResults[i] = m_Diffuse + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, pLightDirections[i], -pViewDirections[i], pNormals[i]);
+				break;
+			case MaterialType::CookTorrence:
+			case MaterialType::Mirror:
 			{
-				//Dielectric
-				//ColorRGB baseSurfaceReflectivity{ m_Albedo };
-				baseSurfaceReflectivity = ColorRGB(0.04f, 0.04f, 0.04f);
+				const CookTorrenceParameters parameters{ m_Diffuse, m_BaseReflectivity, m_AlphaSquared, m_GeometryK, m_IsMetal };
+				g_Kernels.ShadeCookTorrence(parameters, static_cast<uint32_t>(count), pNormals, pLightDirections, pViewDirections, pResults);
+				break;
 			}
+			}
+		}
 
-			Vector3 normalizedHalfVector{ v + l };
-			normalizedHalfVector.Normalize();
-			float squaredRoughness{ Square(m_Roughness) };
+		MaterialType GetType() const { return m_Type; }
+		bool IsReflective() const { return m_IsReflective; }
+		//Part of the reflected view ray's color a reflective material passes on, its albedo
+		const ColorRGB& GetReflectance() const { return m_Reflectance; }
+		//Base color as given to the Create function, guides the denoiser
+		const ColorRGB& GetAlbedo() const { return m_Albedo; }
 
-			ColorRGB FresnelFunction{ BRDF::FresnelFunction_Schlick(normalizedHalfVector, v, baseSurfaceReflectivity) };
-			float normalDistributionFunction{ BRDF::NormalDistribution_GGX(hitRecord.normal, normalizedHalfVector, squaredRoughness) };
-			float GeometryFunction{ BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, squaredRoughness) };
+	private:
+		MaterialType m_Type{ MaterialType::SolidColor };
+		bool m_IsReflective{ false };
+		bool m_IsMetal{ false };
+		ColorRGB m_Reflectance{}; //mirrors
+		ColorRGB m_Albedo{ colors::White };
 
-			float devision{ 4 * (Vector3::Dot(v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal)) };
-			ColorRGB specular{ (normalDistributionFunction * FresnelFunction * GeometryFunction) * (1 / devision) };
+		ColorRGB m_Diffuse{ colors::White }; //solid color or precomputed Lambert term (albedo / PI for Cook-Torrance)
 
-			ColorRGB kd{};
-			if (m_Metalness == 0)
-			{
-				kd = ColorRGB(1, 1, 1) - FresnelFunction;
-			}
+		//Phong
+		float m_SpecularReflectance{}; //ks
+		float m_PhongExponent{ 1.f };
 
-			ColorRGB diffuse = BRDF::Lambert(kd, m_Albedo);
+		//Cook-Torrance
+		ColorRGB m_BaseReflectivity{}; //f0
+		float m_AlphaSquared{}; //roughness^4
+		float m_GeometryK{};
 
-			return diffuse + specular;
-			//return ColorRGB(1,1,1) * FresnelFunction;
+		ColorRGB ShadeCookTorrence(const Vector3& n, const Vector3& l, const Vector3& v) const
+		{
+			const Vector3 h = (v + l).Normalized();
+			const float dotNH = Vector3::Dot(n, h);
+			const float dotNV = Vector3::Dot(n, v);
+			const float dotNL = Vector3::Dot(n, l);
+
+			//Fresnel (Schlick)
+			const ColorRGB fresnel = m_BaseReflectivity + (ColorRGB{ 1, 1, 1 } - m_BaseReflectivity) * powf(1 - Vector3::Dot(h, v), 5);
+			//Normal distribution (Trowbridge-Reitz GGX)
+			const float distribution = m_AlphaSquared / (PI * Square(Square(dotNH) * (m_AlphaSquared - 1) + 1));
+			//Geometry (Smith with Schlick-GGX)
+			const float geometry = dotNV / (dotNV * (1 - m_GeometryK) + m_GeometryK) * dotNL / (dotNL * (1 - m_GeometryK) + m_GeometryK);
+
+			const ColorRGB specular = fresnel * (distribution * geometry / (4 * dotNV * dotNL));
+			if (m_IsMetal)
+				return specular;
+
+			return (ColorRGB{ 1, 1, 1 } - fresnel) * m_Diffuse + specular;
 		}
-
-	private:
-		ColorRGB m_Albedo{ 0.955f, 0.637f, 0.538f }; //Copper
-		float m_Metalness{ 1.0f };
-		float m_Roughness{ 0.1f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
 	};
-#pragma endregion
 }
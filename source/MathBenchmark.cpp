@@ -0,0 +1,111 @@
+#include "MathBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "Kernels.h"
+#include "Math.h"
+#include "SIMD.h"
+
+using namespace dae;
+
+namespace
+{
+	//The scalar layer is constexpr now, so it can be checked at compile time
+	static_assert(Vector3::Dot(Vector3::UnitX, Vector3::UnitY) == 0.f);
+	static_assert(Vector3::Cross(Vector3::UnitX, Vector3::UnitY).z == 1.f);
+	static_assert(Matrix::CreateTranslation(1.f, 2.f, 3.f).TransformPoint(Vector3::Zero).y == 2.f);
+	static_assert(Matrix::Inverse(Matrix::CreateScale(2.f, 4.f, 8.f)).TransformVector(2.f, 4.f, 8.f).z == 1.f);
+
+	constexpr int g_NumRuns{ 5 };
+
+	//Best time of g_NumRuns runs in milliseconds
+	template<typename Function>
+	double TimeBest(Function function)
+	{
+		double best = 1e30;
+		for (int run = 0; run < g_NumRuns; ++run)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			function();
+			const auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	float MaxDifference(const std::vector<Vector3>& a, const std::vector<Vector3>& b)
+	{
+		float difference{};
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			difference = std::max({ difference, std::abs(a[i].x - b[i].x), std::abs(a[i].y - b[i].y), std::abs(a[i].z - b[i].z) });
+		}
+		return difference;
+	}
+
+	void Report(std::ostream& os, const char* name, double scalarMs, double batchMs, float maxDifference)
+	{
+		os << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << scalarMs << " ms" << std::setw(10) << batchMs << " ms"
+			<< std::setprecision(2) << std::setw(8) << scalarMs / batchMs << "x"
+			<< std::scientific << std::setprecision(1) << "   max diff " << maxDifference << std::defaultfloat << '\n';
+	}
+}
+
+void dae::RunMathBenchmark(std::ostream& os, size_t count)
+{
+	std::mt19937 random{ 1234 };
+	std::uniform_real_distribution<float> distribution{ -10.f, 10.f };
+	std::vector<Vector3> a(count);
+	std::vector<Vector3> b(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		a[i] = { distribution(random), distribution(random), distribution(random) };
+		b[i] = { distribution(random), distribution(random), distribution(random) };
+	}
+
+	const Matrix transform = Matrix::CreateScale(1.f, 2.f, .5f) * Matrix::CreateRotationY(.7f) * Matrix::CreateTranslation(1.f, 2.f, 3.f);
+	const Matrix normalTransform = Matrix::Transpose(Matrix::Inverse(transform));
+
+	std::vector<Vector3> scalarResult(count);
+	std::vector<Vector3> batchResult(count);
+	std::vector<float> scalarDots(count);
+	std::vector<float> batchDots(count);
+
+	os << "[MathBenchmark] " << count << " vectors, best of " << g_NumRuns << " runs, batch path: " << GetCPUPathName(g_Kernels.path) << '\n';
+	os << "  " << std::left << std::setw(18) << "" << std::right << std::setw(13) << "scalar" << std::setw(13) << "batch" << '\n';
+
+	double scalarMs = TimeBest([&]
+		{
+			for (size_t i = 0; i < count; ++i)
+				scalarResult[i] = transform.TransformPoint(a[i]);
+		});
+	double batchMs = TimeBest([&] { TransformPoints(transform, a.data(), batchResult.data(), count); });
+	Report(os, "TransformPoint", scalarMs, batchMs, MaxDifference(scalarResult, batchResult));
+
+	scalarMs = TimeBest([&]
+		{
+			for (size_t i = 0; i < count; ++i)
+				scalarResult[i] = normalTransform.TransformVector(b[i]).Normalized();
+		});
+	batchMs = TimeBest([&] { TransformNormals(normalTransform, b.data(), batchResult.data(), count); });
+	Report(os, "TransformNormal", scalarMs, batchMs, MaxDifference(scalarResult, batchResult));
+
+	scalarMs = TimeBest([&]
+		{
+			for (size_t i = 0; i < count; ++i)
+				scalarDots[i] = Vector3::Dot(a[i], b[i]);
+		});
+	batchMs = TimeBest([&] { DotBatch(a.data(), b.data(), batchDots.data(), count); });
+	float maxDotDifference{};
+	for (size_t i = 0; i < count; ++i)
+		maxDotDifference = std::max(maxDotDifference, std::abs(scalarDots[i] - batchDots[i]));
+	Report(os, "Dot", scalarMs, batchMs, maxDotDifference);
+	os.flush();
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <iosfwd>
+
+namespace dae
+{
+	/**
+	 * \brief Times the scalar math (Matrix::TransformPoint, Vector3::Dot...) against the SIMD batch functions in SIMD.h
+	 * on the same random data and prints the best of a few runs for both, plus the largest difference in the results.
+	 * \param count number of vectors per run
+	 */
+	void RunMathBenchmark(std::ostream& os, size_t count = size_t{ 1 } << 20);
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cfloat>
 #include <cmath>
 
 namespace dae
@@ -13,12 +14,12 @@ namespace dae
 	constexpr auto TO_DEGREES = (180.0f / PI);
 	constexpr auto TO_RADIANS(PI / 180.0f);
 
-	inline float Square(float a)
+	constexpr float Square(float a)
 	{
 		return a * a;
 	}
 
-	inline float Lerpf(float a, float b, float factor)
+	constexpr float Lerpf(float a, float b, float factor)
 	{
 		return ((1 - factor) * a) + (factor * b);
 	}
@@ -1,51 +1,263 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+
 #include "Vector3.h"
 #include "Vector4.h"
 
 namespace dae {
+	//Header-only like the vectors, only the rotations can't be constexpr (sin/cos)
 	struct Matrix
 	{
-		Matrix() = default;
-		Matrix(
+		constexpr Matrix() = default;
+		constexpr Matrix(
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
-		Matrix(
+		constexpr Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
-
-		Matrix(const Matrix& m);
-
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
-		const Matrix& Transpose();
-
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
-
-		static Matrix CreateTranslation(float x, float y, float z);
-		static Matrix CreateTranslation(const Vector3& t);
-		static Matrix CreateRotationX(float pitch);
-		static Matrix CreateRotationY(float yaw);
-		static Matrix CreateRotationZ(float roll);
-		static Matrix CreateRotation(float pitch, float yaw, float roll);
-		static Matrix CreateRotation(const Vector3& r);
-		static Matrix CreateScale(float sx, float sy, float sz);
-		static Matrix CreateScale(const Vector3& s);
-		static Matrix Transpose(const Matrix& m);
-
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
-		Matrix operator*(const Matrix& m) const;
-		const Matrix& operator*=(const Matrix& m);
+			const Vector4& t) :
+			data{ xAxis, yAxis, zAxis, t }
+		{
+		}
+
+		constexpr Matrix(const Matrix& m) = default;
+		constexpr Matrix& operator=(const Matrix& m) = default;
+
+		constexpr Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		constexpr Vector3 TransformVector(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z,
+				data[0].y * x + data[1].y * y + data[2].y * z,
+				data[0].z * x + data[1].z * y + data[2].z * z
+			};
+		}
+
+		constexpr Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		constexpr Vector3 TransformPoint(float x, float y, float z) const
+		{
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+			};
+		}
+
+		//Bounds of the 8 transformed corners of an axis aligned box
+		constexpr void TransformAABB(const Vector3& minAABB, const Vector3& maxAABB, Vector3& transformedMinAABB, Vector3& transformedMaxAABB) const
+		{
+			transformedMinAABB = TransformPoint(minAABB);
+			transformedMaxAABB = transformedMinAABB;
+			for (int corner = 1; corner < 8; ++corner)
+			{
+				const Vector3 p = TransformPoint(
+					(corner & 1) ? maxAABB.x : minAABB.x,
+					(corner & 2) ? maxAABB.y : minAABB.y,
+					(corner & 4) ? maxAABB.z : minAABB.z);
+				transformedMinAABB = Vector3::Min(p, transformedMinAABB);
+				transformedMaxAABB = Vector3::Max(p, transformedMaxAABB);
+			}
+		}
+
+		constexpr const Matrix& Transpose()
+		{
+			*this = Transpose(*this);
+			return *this;
+		}
+
+		constexpr Vector3 GetAxisX() const { return data[0]; }
+		constexpr Vector3 GetAxisY() const { return data[1]; }
+		constexpr Vector3 GetAxisZ() const { return data[2]; }
+		constexpr Vector3 GetTranslation() const { return data[3]; }
+
+		static constexpr Matrix CreateTranslation(float x, float y, float z)
+		{
+			return Matrix(
+				Vector4(1, 0, 0, 0),
+				Vector4(0, 1, 0, 0),
+				Vector4(0, 0, 1, 0),
+				Vector4(x, y, z, 1));
+		}
+
+		static constexpr Matrix CreateTranslation(const Vector3& t)
+		{
+			return CreateTranslation(t.x, t.y, t.z);
+		}
+
+		static Matrix CreateRotationX(float pitch)
+		{
+			return Matrix(
+				Vector4(1, 0, 0, 0),
+				Vector4(0, cosf(pitch), -sinf(pitch), 0),
+				Vector4(0, sinf(pitch), cosf(pitch), 0),
+				Vector4(0, 0, 0, 1));
+		}
+
+		static Matrix CreateRotationY(float yaw)
+		{
+			return Matrix(
+				Vector4(cosf(yaw), 0, -sinf(yaw), 0),
+				Vector4(0, 1, 0, 0),
+				Vector4(sinf(yaw), 0, cosf(yaw), 0),
+				Vector4(0, 0, 0, 1));
+		}
+
+		static Matrix CreateRotationZ(float roll)
+		{
+			return Matrix(
+				Vector4(cosf(roll), sinf(roll), 0, 0),
+				Vector4(-sinf(roll), cosf(roll), 0, 0),
+				Vector4(0, 0, 1, 0),
+				Vector4(0, 0, 0, 1));
+		}
+
+		static Matrix CreateRotation(float pitch, float yaw, float roll)
+		{
+			return CreateRotation({ pitch, yaw, roll });
+		}
+
+		static Matrix CreateRotation(const Vector3& r)
+		{
+			return CreateRotationX(r.x) * CreateRotationY(r.y) * CreateRotationZ(r.z);
+		}
+
+		static constexpr Matrix CreateScale(float sx, float sy, float sz)
+		{
+			return Matrix(
+				Vector4(sx, 0, 0, 0),
+				Vector4(0, sy, 0, 0),
+				Vector4(0, 0, sz, 0),
+				Vector4(0, 0, 0, 1));
+		}
+
+		static constexpr Matrix CreateScale(const Vector3& s)
+		{
+			return CreateScale(s.x, s.y, s.z);
+		}
+
+		static constexpr Matrix Transpose(const Matrix& m)
+		{
+			Matrix result{};
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					result.data[r][c] = m.data[c][r];
+				}
+			}
+
+			return result;
+		}
+
+		//Affine matrices only (last column 0,0,0,1)
+		static constexpr Matrix Inverse(const Matrix& m)
+		{
+			//Row vectors: p' = p * A + t  >>  p = (p' - t) * A^-1
+			const Vector4& r0 = m.data[0];
+			const Vector4& r1 = m.data[1];
+			const Vector4& r2 = m.data[2];
+
+			const float c00 = r1.y * r2.z - r1.z * r2.y;
+			const float c01 = r1.z * r2.x - r1.x * r2.z;
+			const float c02 = r1.x * r2.y - r1.y * r2.x;
+			const float determinant = r0.x * c00 + r0.y * c01 + r0.z * c02;
+			assert(determinant != 0.f && "Matrix is not invertible");
+			const float invDeterminant = 1.f / determinant;
+
+			Matrix inverse{};
+			inverse.data[0] = {
+				c00 * invDeterminant,
+				(r0.z * r2.y - r0.y * r2.z) * invDeterminant,
+				(r0.y * r1.z - r0.z * r1.y) * invDeterminant,
+				0.f };
+			inverse.data[1] = {
+				c01 * invDeterminant,
+				(r0.x * r2.z - r0.z * r2.x) * invDeterminant,
+				(r0.z * r1.x - r0.x * r1.z) * invDeterminant,
+				0.f };
+			inverse.data[2] = {
+				c02 * invDeterminant,
+				(r0.y * r2.x - r0.x * r2.y) * invDeterminant,
+				(r0.x * r1.y - r0.y * r1.x) * invDeterminant,
+				0.f };
+
+			const Vector3 translation = inverse.TransformVector(m.GetTranslation());
+			inverse.data[3] = { -translation.x, -translation.y, -translation.z, 1.f };
+
+			return inverse;
+		}
+
+#pragma region Operator Overloads
+		constexpr Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		constexpr Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		constexpr Matrix operator*(const Matrix& m) const
+		{
+			Matrix result{};
+			const Matrix m_transposed = Transpose(m);
+
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					result.data[r][c] = Vector4::Dot(data[r], m_transposed.data[c]);
+				}
+			}
+
+			return result;
+		}
+
+		constexpr const Matrix& operator*=(const Matrix& m)
+		{
+			*this = *this * m;
+			return *this;
+		}
+
+		//Exact, used to skip work when a transform is set to the same value
+		constexpr bool operator==(const Matrix& m) const
+		{
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					if (data[r][c] != m.data[r][c])
+						return false;
+				}
+			}
+
+			return true;
+		}
+
+		constexpr bool operator!=(const Matrix& m) const
+		{
+			return !(*this == m);
+		}
+#pragma endregion
 
 	private:
 
@@ -63,4 +275,4 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
-}
\ No newline at end of file
+}
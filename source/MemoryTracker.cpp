@@ -0,0 +1,102 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "Renderer.h"
+#include "Scene.h"
+
+using namespace dae;
+
+namespace
+{
+	//Only warn again once the footprint has grown by another 10% (a leak would spam every frame otherwise)
+	constexpr float g_WarnGrowthFactor{ 1.1f };
+
+	float ToKiB(size_t bytes)
+	{
+		return static_cast<float>(bytes) / 1024.f;
+	}
+}
+
+void MemoryTracker::Sample(const Scene* pScene, const Renderer* pRenderer)
+{
+	MemoryUsage usage{};
+	if (pScene)
+		usage += pScene->GetMemoryUsage();
+	if (pRenderer)
+		usage += pRenderer->GetMemoryUsage();
+
+	m_Current = usage;
+	m_Peak.geometry = std::max(m_Peak.geometry, usage.geometry);
+	m_Peak.materials = std::max(m_Peak.materials, usage.materials);
+	m_Peak.lights = std::max(m_Peak.lights, usage.lights);
+	m_Peak.frameBuffers = std::max(m_Peak.frameBuffers, usage.frameBuffers);
+
+	const size_t total = usage.GetTotal();
+	m_PeakTotal = std::max(m_PeakTotal, total);
+
+	if (m_NumSamples++ == 0)
+	{
+		m_BaselineTotal = total;
+		m_LastWarnedTotal = total;
+		return;
+	}
+
+	if (total > m_BaselineTotal && total > static_cast<size_t>(m_LastWarnedTotal * g_WarnGrowthFactor))
+	{
+		std::cout << "[Memory] WARNING: footprint grew to " << ToKiB(total) << " KiB (was "
+			<< ToKiB(m_BaselineTotal) << " KiB at load, frame " << m_NumSamples << ")\n";
+		m_LastWarnedTotal = total;
+	}
+}
+
+void MemoryTracker::Report(std::ostream& os, const char* label) const
+{
+	os << "**MEMORY (" << label << ")**\n";
+	os << ">> GEOMETRY = " << ToKiB(m_Current.geometry) << " KiB (peak " << ToKiB(m_Peak.geometry) << " KiB)\n";
+	os << ">> MATERIALS = " << ToKiB(m_Current.materials) << " KiB (peak " << ToKiB(m_Peak.materials) << " KiB)\n";
+	os << ">> LIGHTS = " << ToKiB(m_Current.lights) << " KiB (peak " << ToKiB(m_Peak.lights) << " KiB)\n";
+	os << ">> FRAMEBUFFERS = " << ToKiB(m_Current.frameBuffers) << " KiB (peak " << ToKiB(m_Peak.frameBuffers) << " KiB)\n";
+	os << ">> TOTAL = " << ToKiB(m_Current.GetTotal()) << " KiB (peak " << ToKiB(m_PeakTotal) << " KiB)" << std::endl;
+}
+
+void MemoryTracker::ReportMeshes(std::ostream& os, const Scene* pScene)
+{
+	const auto& meshes = pScene->GetTriangleMeshGeometries();
+	for (size_t i{ 0 }; i < meshes.size(); ++i)
+	{
+		const TriangleMesh& mesh = meshes[i];
+		os << ">> MESH " << i << ": " << mesh.positions.size() << " vertices, "
+			<< mesh.indices.size() / 3 << " triangles, " << ToKiB(mesh.GetMemoryUsage()) << " KiB\n";
+	}
+
+	const auto& instances = pScene->GetMeshInstances();
+	for (size_t i{ 0 }; i < instances.size(); ++i)
+	{
+		const MeshInstance& instance = instances[i];
+		if (instance.pData)
+		{
+			os << ">> INSTANCE " << i << ": " << instance.pData->indices.size() / 3 << " triangles, shared by "
+				<< instance.pData.use_count() << " users, " << ToKiB(instance.pData->GetMemoryUsage()) << " KiB\n";
+		}
+		else if (instance.pCompactData)
+		{
+			os << ">> INSTANCE " << i << " (compact): " << instance.pCompactData->GetNumTriangles() << " triangles, shared by "
+				<< instance.pCompactData.use_count() << " users, " << ToKiB(instance.pCompactData->GetMemoryUsage()) << " KiB\n";
+		}
+	}
+
+	const GeometryPageCache& pageCache = pScene->GetPageCache();
+	const auto& pagedMeshes = pageCache.GetMeshes();
+	for (size_t i{ 0 }; i < pagedMeshes.size(); ++i)
+	{
+		const PagedMesh& mesh = *pagedMeshes[i];
+		os << ">> PAGED MESH " << i << ": " << mesh.GetNumTriangles() << " triangles in " << mesh.GetClusters().size()
+			<< " clusters, " << ToKiB(mesh.GetMemoryUsage()) << " KiB resident table\n";
+	}
+	if (!pagedMeshes.empty())
+	{
+		os << ">> PAGE CACHE: " << ToKiB(pageCache.GetResidentBytes()) << " / " << ToKiB(pageCache.GetBudget()) << " KiB\n";
+	}
+}
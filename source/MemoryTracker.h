@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+
+namespace dae
+{
+	class Scene;
+	class Renderer;
+
+	//Byte counts per category, filled in by Scene::GetMemoryUsage and Renderer::GetMemoryUsage
+	struct MemoryUsage
+	{
+		size_t geometry{};
+		size_t materials{};
+		size_t lights{};
+		size_t frameBuffers{};
+
+		size_t GetTotal() const { return geometry + materials + lights + frameBuffers; }
+
+		MemoryUsage& operator+=(const MemoryUsage& other)
+		{
+			geometry += other.geometry;
+			materials += other.materials;
+			lights += other.lights;
+			frameBuffers += other.frameBuffers;
+			return *this;
+		}
+	};
+
+	class MemoryTracker final
+	{
+	public:
+		MemoryTracker() = default;
+		~MemoryTracker() = default;
+
+		MemoryTracker(const MemoryTracker&) = delete;
+		MemoryTracker(MemoryTracker&&) noexcept = delete;
+		MemoryTracker& operator=(const MemoryTracker&) = delete;
+		MemoryTracker& operator=(MemoryTracker&&) noexcept = delete;
+
+		/**
+		 * \brief Samples the current footprint of the scene and renderer and updates the peaks.
+		 * Warns as soon as the footprint grows after the first sample (scene load), which is
+		 * how per-frame leaks (vectors that keep appending) show up.
+		 */
+		void Sample(const Scene* pScene, const Renderer* pRenderer);
+
+		//Makes the next sample the new baseline (e.g. once streamed in assets have arrived)
+		void ResetBaseline() { m_NumSamples = 0; }
+
+		void Report(std::ostream& os, const char* label) const;
+		static void ReportMeshes(std::ostream& os, const Scene* pScene);
+
+		const MemoryUsage& GetCurrent() const { return m_Current; }
+		const MemoryUsage& GetPeak() const { return m_Peak; }
+
+	private:
+		MemoryUsage m_Current{};
+		MemoryUsage m_Peak{};
+		size_t m_PeakTotal{};
+		size_t m_BaselineTotal{};
+		size_t m_LastWarnedTotal{};
+		uint32_t m_NumSamples{};
+	};
+}
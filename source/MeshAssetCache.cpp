@@ -0,0 +1,89 @@
+#include "MeshAssetCache.h"
+
+#include <filesystem>
+
+#include "MeshCache.h"
+#include "MeshCompression.h"
+
+using namespace dae;
+
+MeshAssetCache& MeshAssetCache::GetInstance()
+{
+	static MeshAssetCache instance{};
+	return instance;
+}
+
+std::shared_ptr<const MeshData> MeshAssetCache::Load(const std::string& filename)
+{
+	const std::string key = GetKey(filename);
+	{
+		std::lock_guard lock{ m_Mutex };
+		if (auto pData = m_Assets[key].lock())
+			return pData;
+	}
+
+	//Load outside of the lock so different assets can load concurrently
+	auto pData = std::make_shared<MeshData>();
+	if (!Utils::LoadMesh(filename, *pData))
+		return nullptr;
+
+	std::lock_guard lock{ m_Mutex };
+	//Someone else may have loaded the same asset in the meantime, keep theirs so there is only one copy
+	std::weak_ptr<const MeshData>& asset = m_Assets[key];
+	if (auto pExisting = asset.lock())
+		return pExisting;
+
+	asset = pData;
+	return pData;
+}
+
+std::shared_ptr<const CompactMeshData> MeshAssetCache::LoadCompact(const std::string& filename)
+{
+	const std::string key = GetKey(filename);
+	{
+		std::lock_guard lock{ m_Mutex };
+		if (auto pCompactData = m_CompactAssets[key].lock())
+			return pCompactData;
+	}
+
+	//Reuses the full asset if it happens to be loaded, it is released again afterwards otherwise
+	const std::shared_ptr<const MeshData> pData = Load(filename);
+	if (!pData)
+		return nullptr;
+
+	auto pCompactData = std::make_shared<const CompactMeshData>(Utils::CompressMesh(*pData));
+
+	std::lock_guard lock{ m_Mutex };
+	std::weak_ptr<const CompactMeshData>& asset = m_CompactAssets[key];
+	if (auto pExisting = asset.lock())
+		return pExisting;
+
+	asset = pCompactData;
+	return pCompactData;
+}
+
+size_t MeshAssetCache::GetNumLoaded() const
+{
+	std::lock_guard lock{ m_Mutex };
+
+	size_t numLoaded{};
+	for (const auto& asset : m_Assets)
+	{
+		if (!asset.second.expired())
+			++numLoaded;
+	}
+	for (const auto& asset : m_CompactAssets)
+	{
+		if (!asset.second.expired())
+			++numLoaded;
+	}
+	return numLoaded;
+}
+
+std::string MeshAssetCache::GetKey(const std::string& filename)
+{
+	//"Resources/a.obj" and "Resources/../Resources/a.obj" are the same asset
+	std::error_code error{};
+	const std::filesystem::path path = std::filesystem::weakly_canonical(filename, error);
+	return error ? std::filesystem::path(filename).lexically_normal().string() : path.string();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Reference counted mesh assets keyed by path. Only weak references are kept here: an asset stays loaded
+	//as long as a MeshInstance (or anyone else) holds on to it and is shared by every Load of the same path.
+	class MeshAssetCache final
+	{
+	public:
+		static MeshAssetCache& GetInstance();
+
+		~MeshAssetCache() = default;
+
+		MeshAssetCache(const MeshAssetCache&) = delete;
+		MeshAssetCache(MeshAssetCache&&) noexcept = delete;
+		MeshAssetCache& operator=(const MeshAssetCache&) = delete;
+		MeshAssetCache& operator=(MeshAssetCache&&) noexcept = delete;
+
+		/**
+		 * \brief Returns the already loaded asset for this path or loads it (through Utils::LoadMesh). Thread safe.
+		 * \return the shared mesh data, nullptr if the file could not be loaded
+		 */
+		std::shared_ptr<const MeshData> Load(const std::string& filename);
+		//Same as Load, but returns the quantized representation (see Utils::CompressMesh)
+		std::shared_ptr<const CompactMeshData> LoadCompact(const std::string& filename);
+
+		size_t GetNumLoaded() const;
+
+	private:
+		MeshAssetCache() = default;
+
+		static std::string GetKey(const std::string& filename);
+
+		mutable std::mutex m_Mutex{};
+		std::unordered_map<std::string, std::weak_ptr<const MeshData>> m_Assets{};
+		std::unordered_map<std::string, std::weak_ptr<const CompactMeshData>> m_CompactAssets{};
+	};
+}
@@ -0,0 +1,250 @@
+#include "MeshCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include "FileMapping.h"
+#include "MeshOptimizer.h"
+#include "OBJLoader.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr char g_MeshCacheMagic[8]{ 'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0' };
+	//Bump whenever the layout or the content of the cache changes
+	constexpr uint32_t g_MeshCacheVersion{ 2 };
+	constexpr uint32_t g_FlagFlippedWinding{ 1 << 0 };
+	constexpr const char* g_MeshCacheExtension{ ".meshcache" };
+
+	struct MeshCacheHeader
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t flags{};
+
+		//Source validation
+		uint64_t sourceSize{};
+		int64_t sourceWriteTime{};
+		uint64_t sourceHash{};
+
+		//Payload, offsets are from the start of the file
+		uint64_t numPositions{};
+		uint64_t numIndices{};
+		uint64_t numNormals{};
+		uint64_t positionsOffset{};
+		uint64_t indicesOffset{};
+		uint64_t normalsOffset{};
+		uint64_t fileSize{};
+
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+	};
+	static_assert(std::is_trivially_copyable_v<MeshCacheHeader>);
+	static_assert(std::is_trivially_copyable_v<Vector3> && sizeof(Vector3) == 3 * sizeof(float));
+
+	struct SourceInfo
+	{
+		uint64_t size{};
+		int64_t writeTime{};
+	};
+
+	//FNV-1a
+	uint64_t HashBytes(const char* pData, size_t size)
+	{
+		uint64_t hash{ 14695981039346656037ull };
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= static_cast<unsigned char>(pData[i]);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool HashFile(const std::string& filename, uint64_t& hash)
+	{
+		FileMapping file{};
+		if (!file.Open(filename))
+			return false;
+
+		hash = HashBytes(file.GetData(), file.GetSize());
+		return true;
+	}
+
+	bool GetSourceInfo(const std::string& filename, SourceInfo& info)
+	{
+		std::error_code error{};
+		info.size = std::filesystem::file_size(filename, error);
+		if (error)
+			return false;
+
+		const auto writeTime = std::filesystem::last_write_time(filename, error);
+		if (error)
+			return false;
+
+		info.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+		return true;
+	}
+
+	uint64_t AlignOffset(uint64_t offset)
+	{
+		constexpr uint64_t alignment{ 16 };
+		return (offset + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool ReadCache(const std::string& cacheFilename, const std::string& sourceFilename, const SourceInfo& source,
+		uint32_t flags, MeshData& mesh)
+	{
+		FileMapping cache{};
+		if (!cache.Open(cacheFilename) || cache.GetSize() < sizeof(MeshCacheHeader))
+			return false;
+
+		MeshCacheHeader header{};
+		std::memcpy(&header, cache.GetData(), sizeof(MeshCacheHeader));
+
+		if (std::memcmp(header.magic, g_MeshCacheMagic, sizeof(g_MeshCacheMagic)) != 0 ||
+			header.version != g_MeshCacheVersion ||
+			header.flags != flags ||
+			header.fileSize != cache.GetSize() ||
+			header.sourceSize != source.size)
+		{
+			return false;
+		}
+
+		//A different modification time alone (checkout, copy) is fine as long as the content is the same
+		if (header.sourceWriteTime != source.writeTime)
+		{
+			uint64_t sourceHash{};
+			if (!HashFile(sourceFilename, sourceHash) || sourceHash != header.sourceHash)
+				return false;
+		}
+
+		const auto isInside = [&](uint64_t offset, uint64_t count, size_t elementSize)
+		{
+			return offset <= header.fileSize && count <= (header.fileSize - offset) / elementSize;
+		};
+		if (!isInside(header.positionsOffset, header.numPositions, sizeof(Vector3)) ||
+			!isInside(header.indicesOffset, header.numIndices, sizeof(int)) ||
+			!isInside(header.normalsOffset, header.numNormals, sizeof(Vector3)))
+		{
+			return false;
+		}
+
+		const char* pData = cache.GetData();
+		mesh.positions.resize(header.numPositions);
+		mesh.indices.resize(header.numIndices);
+		mesh.normals.resize(header.numNormals);
+		std::memcpy(mesh.positions.data(), pData + header.positionsOffset, header.numPositions * sizeof(Vector3));
+		std::memcpy(mesh.indices.data(), pData + header.indicesOffset, header.numIndices * sizeof(int));
+		std::memcpy(mesh.normals.data(), pData + header.normalsOffset, header.numNormals * sizeof(Vector3));
+		mesh.minAABB = header.minAABB;
+		mesh.maxAABB = header.maxAABB;
+
+		return true;
+	}
+
+	bool WriteCache(const std::string& cacheFilename, const std::string& sourceFilename, const SourceInfo& source,
+		uint32_t flags, const MeshData& mesh)
+	{
+		MeshCacheHeader header{};
+		std::memcpy(header.magic, g_MeshCacheMagic, sizeof(g_MeshCacheMagic));
+		header.version = g_MeshCacheVersion;
+		header.flags = flags;
+		header.sourceSize = source.size;
+		header.sourceWriteTime = source.writeTime;
+		if (!HashFile(sourceFilename, header.sourceHash))
+			return false;
+
+		header.numPositions = mesh.positions.size();
+		header.numIndices = mesh.indices.size();
+		header.numNormals = mesh.normals.size();
+		header.positionsOffset = AlignOffset(sizeof(MeshCacheHeader));
+		header.indicesOffset = AlignOffset(header.positionsOffset + header.numPositions * sizeof(Vector3));
+		header.normalsOffset = AlignOffset(header.indicesOffset + header.numIndices * sizeof(int));
+		header.fileSize = header.normalsOffset + header.numNormals * sizeof(Vector3);
+		header.minAABB = mesh.minAABB;
+		header.maxAABB = mesh.maxAABB;
+
+		//Write to a temporary file first so a crash never leaves a half written cache behind
+		const std::string tempFilename = cacheFilename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+			if (!file)
+				return false;
+
+			const auto writeAt = [&file](uint64_t offset, const void* pData, size_t size)
+			{
+				static constexpr char padding[16]{};
+				const uint64_t current = static_cast<uint64_t>(file.tellp());
+				file.write(padding, static_cast<std::streamsize>(offset - current));
+				file.write(static_cast<const char*>(pData), static_cast<std::streamsize>(size));
+			};
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+			writeAt(header.positionsOffset, mesh.positions.data(), mesh.positions.size() * sizeof(Vector3));
+			writeAt(header.indicesOffset, mesh.indices.data(), mesh.indices.size() * sizeof(int));
+			writeAt(header.normalsOffset, mesh.normals.data(), mesh.normals.size() * sizeof(Vector3));
+
+			if (!file)
+				return false;
+		}
+
+		std::error_code error{};
+		std::filesystem::rename(tempFilename, cacheFilename, error);
+		if (error)
+		{
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool Utils::LoadMesh(const std::string& filename, MeshData& mesh, bool flipAxisAndWinding)
+{
+	const std::string cacheFilename = filename + g_MeshCacheExtension;
+	const uint32_t flags = flipAxisAndWinding ? g_FlagFlippedWinding : 0;
+
+	SourceInfo source{};
+	const bool hasSource = GetSourceInfo(filename, source);
+	if (hasSource && ReadCache(cacheFilename, filename, source, flags, mesh))
+		return true;
+
+	if (!LoadOBJ(filename, mesh.positions, mesh.normals, mesh.indices, flipAxisAndWinding))
+		return false;
+
+	//The cache stores the optimized mesh, so this only runs when the OBJ gets parsed
+	Utils::OptimizeMesh(mesh);
+
+	if (hasSource && !WriteCache(cacheFilename, filename, source, flags, mesh))
+		std::cout << "[MeshCache] Could not write " << cacheFilename << std::endl;
+
+	return true;
+}
+
+bool Utils::LoadMesh(const std::string& filename, TriangleMesh& mesh, bool flipAxisAndWinding)
+{
+	MeshData data{};
+	if (!LoadMesh(filename, data, flipAxisAndWinding))
+		return false;
+
+	mesh.positions = std::move(data.positions);
+	mesh.normals = std::move(data.normals);
+	mesh.indices = std::move(data.indices);
+	mesh.minAABB = data.minAABB;
+	mesh.maxAABB = data.maxAABB;
+	return true;
+}
+
+std::future<MeshLoadResult> Utils::LoadMeshAsync(const std::string& filename, bool flipAxisAndWinding)
+{
+	return std::async(std::launch::async, [filename, flipAxisAndWinding]
+		{
+			MeshLoadResult result{};
+			result.succeeded = LoadMesh(filename, result.mesh, flipAxisAndWinding);
+			return result;
+		});
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <future>
+#include <string>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Result of LoadMeshAsync, only the object space data of the mesh (positions, normals, indices, bounds) is filled in
+	struct MeshLoadResult
+	{
+		TriangleMesh mesh{};
+		bool succeeded{ false };
+	};
+
+	namespace Utils
+	{
+		/**
+		 * \brief Loads an OBJ file into the mesh through a binary cache ("<filename>.meshcache") next to it.
+		 * The cache holds positions, indices, face normals and the object space bounds. It is used when its version
+		 * and the size and modification time of the OBJ match (or the content hash matches when only the time changed),
+		 * otherwise the OBJ is parsed with LoadOBJ, optimized with OptimizeMesh and the cache is (re)written.
+		 * \param filename path to the OBJ file
+		 * \param mesh mesh receiving positions, normals, indices, minAABB and maxAABB
+		 * \param flipAxisAndWinding swap the winding order of every triangle
+		 * \return false if neither the cache nor the OBJ file could be loaded
+		 */
+		bool LoadMesh(const std::string& filename, MeshData& mesh, bool flipAxisAndWinding = false);
+		bool LoadMesh(const std::string& filename, TriangleMesh& mesh, bool flipAxisAndWinding = false);
+
+		/**
+		 * \brief Starts LoadMesh on its own thread, all loads started this way run concurrently.
+		 * \return future that becomes ready once the mesh has been loaded (or failed to load)
+		 */
+		std::future<MeshLoadResult> LoadMeshAsync(const std::string& filename, bool flipAxisAndWinding = false);
+	}
+}
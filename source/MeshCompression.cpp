@@ -0,0 +1,75 @@
+#include "MeshCompression.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "DataTypes.h"
+
+using namespace dae;
+
+namespace
+{
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::clamp(value, 0.f, 1.f) * 65535.f + 0.5f);
+	}
+
+	uint16_t QuantizeSnorm16(float value)
+	{
+		const float scaled = std::clamp(value, -1.f, 1.f) * 32767.f;
+		return static_cast<uint16_t>(static_cast<int16_t>(scaled >= 0.f ? scaled + 0.5f : scaled - 0.5f));
+	}
+
+	uint32_t EncodeOctahedral(const Vector3& normal)
+	{
+		const float invL1Norm = 1.f / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+		float x = normal.x * invL1Norm;
+		float y = normal.y * invL1Norm;
+
+		//Fold the lower hemisphere over the diagonals
+		if (normal.z < 0.f)
+		{
+			const float foldedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+			const float foldedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		return static_cast<uint32_t>(QuantizeSnorm16(x)) | (static_cast<uint32_t>(QuantizeSnorm16(y)) << 16);
+	}
+}
+
+CompactMeshData Utils::CompressMesh(const MeshData& mesh)
+{
+	CompactMeshData compact{};
+	compact.minAABB = mesh.minAABB;
+	compact.maxAABB = mesh.maxAABB;
+
+	const Vector3 extent = mesh.maxAABB - mesh.minAABB;
+	compact.dequantizeScale = extent / 65535.f;
+	const Vector3 invExtent{
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f };
+
+	compact.positions.reserve(mesh.positions.size() * 3);
+	for (const Vector3& position : mesh.positions)
+	{
+		compact.positions.push_back(QuantizeUnorm16((position.x - mesh.minAABB.x) * invExtent.x));
+		compact.positions.push_back(QuantizeUnorm16((position.y - mesh.minAABB.y) * invExtent.y));
+		compact.positions.push_back(QuantizeUnorm16((position.z - mesh.minAABB.z) * invExtent.z));
+	}
+
+	compact.normals.reserve(mesh.normals.size());
+	for (const Vector3& normal : mesh.normals)
+	{
+		compact.normals.push_back(EncodeOctahedral(normal));
+	}
+
+	if (mesh.positions.size() <= size_t(std::numeric_limits<uint16_t>::max()) + 1)
+		compact.indices16.assign(mesh.indices.begin(), mesh.indices.end());
+	else
+		compact.indices32.assign(mesh.indices.begin(), mesh.indices.end());
+
+	return compact;
+}
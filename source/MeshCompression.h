@@ -0,0 +1,17 @@
+#pragma once
+
+namespace dae
+{
+	struct MeshData;
+	struct CompactMeshData;
+
+	namespace Utils
+	{
+		/**
+		 * \brief Builds the quantized representation of a mesh: 16-bit positions relative to the mesh bounds,
+		 * octahedral encoded face normals and 16-bit indices when the mesh has at most 65536 vertices.
+		 * Roughly 6 instead of 12 bytes per vertex and 4 (or 10) instead of 24 bytes per triangle.
+		 */
+		CompactMeshData CompressMesh(const MeshData& mesh);
+	}
+}
@@ -0,0 +1,190 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include "DataTypes.h"
+
+using namespace dae;
+
+namespace
+{
+	struct WeldKey
+	{
+		uint32_t x{};
+		uint32_t y{};
+		uint32_t z{};
+
+		bool operator==(const WeldKey& other) const
+		{
+			return x == other.x && y == other.y && z == other.z;
+		}
+	};
+
+	struct WeldKeyHash
+	{
+		size_t operator()(const WeldKey& key) const
+		{
+			return (static_cast<size_t>(key.x) * 73856093u) ^ (static_cast<size_t>(key.y) * 19349663u) ^ (static_cast<size_t>(key.z) * 83492791u);
+		}
+	};
+
+	uint32_t FloatBits(float value)
+	{
+		//-0 and +0 are the same position
+		if (value == 0.f)
+			value = 0.f;
+
+		uint32_t bits{};
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	WeldKey GetWeldKey(const Vector3& position, float weldEpsilon)
+	{
+		if (weldEpsilon <= 0.f)
+			return { FloatBits(position.x), FloatBits(position.y), FloatBits(position.z) };
+
+		return {
+			static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.x / weldEpsilon + 0.5f))),
+			static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.y / weldEpsilon + 0.5f))),
+			static_cast<uint32_t>(static_cast<int32_t>(std::floor(position.z / weldEpsilon + 0.5f))) };
+	}
+
+	//Spreads the lower 10 bits so there are two zero bits between each of them
+	uint32_t ExpandBits(uint32_t value)
+	{
+		value = (value * 0x00010001u) & 0xFF0000FFu;
+		value = (value * 0x00000101u) & 0x0F00F00Fu;
+		value = (value * 0x00000011u) & 0xC30C30C3u;
+		value = (value * 0x00000005u) & 0x49249249u;
+		return value;
+	}
+
+	uint32_t GetMortonCode(const Vector3& point, const Vector3& minAABB, const Vector3& invExtent)
+	{
+		const auto quantize = [](float value)
+		{
+			return static_cast<uint32_t>(std::clamp(value * 1023.f, 0.f, 1023.f));
+		};
+
+		const uint32_t x = quantize((point.x - minAABB.x) * invExtent.x);
+		const uint32_t y = quantize((point.y - minAABB.y) * invExtent.y);
+		const uint32_t z = quantize((point.z - minAABB.z) * invExtent.z);
+		return (ExpandBits(x) << 2) | (ExpandBits(y) << 1) | ExpandBits(z);
+	}
+}
+
+MeshOptimizeStats Utils::OptimizeMesh(MeshData& mesh, float weldEpsilon)
+{
+	MeshOptimizeStats stats{};
+	stats.verticesBefore = static_cast<uint32_t>(mesh.positions.size());
+	stats.trianglesBefore = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	//Weld
+	std::vector<int> remap(mesh.positions.size());
+	std::vector<Vector3> weldedPositions{};
+	weldedPositions.reserve(mesh.positions.size());
+	{
+		std::unordered_map<WeldKey, int, WeldKeyHash> uniqueVertices{};
+		uniqueVertices.reserve(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); ++i)
+		{
+			const auto [it, isNew] = uniqueVertices.try_emplace(GetWeldKey(mesh.positions[i], weldEpsilon), static_cast<int>(weldedPositions.size()));
+			if (isNew)
+				weldedPositions.push_back(mesh.positions[i]);
+			remap[i] = it->second;
+		}
+	}
+
+	//Drop degenerate triangles
+	std::vector<int> triangles{};
+	triangles.reserve(mesh.indices.size());
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		const int i0 = remap[mesh.indices[i]];
+		const int i1 = remap[mesh.indices[i + 1]];
+		const int i2 = remap[mesh.indices[i + 2]];
+		if (i0 == i1 || i1 == i2 || i0 == i2)
+			continue;
+
+		const Vector3& v0 = weldedPositions[i0];
+		const Vector3 cross = Vector3::Cross(weldedPositions[i1] - v0, weldedPositions[i2] - v0);
+		const float sqrArea = cross.SqrMagnitude();
+		if (!(sqrArea > 0.f) || std::isinf(sqrArea))
+			continue;
+
+		triangles.push_back(i0);
+		triangles.push_back(i1);
+		triangles.push_back(i2);
+	}
+
+	//Sort triangles along a Morton curve through the bounds
+	mesh.positions = std::move(weldedPositions);
+	mesh.UpdateAABB();
+
+	const size_t numTriangles = triangles.size() / 3;
+	const Vector3 extent = mesh.maxAABB - mesh.minAABB;
+	const Vector3 invExtent{
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f };
+
+	std::vector<uint32_t> mortonCodes(numTriangles);
+	for (size_t t = 0; t < numTriangles; ++t)
+	{
+		const Vector3 centroid = (mesh.positions[triangles[t * 3]] + mesh.positions[triangles[t * 3 + 1]] + mesh.positions[triangles[t * 3 + 2]]) / 3.f;
+		mortonCodes[t] = GetMortonCode(centroid, mesh.minAABB, invExtent);
+	}
+
+	std::vector<uint32_t> order(numTriangles);
+	std::iota(order.begin(), order.end(), 0u);
+	std::stable_sort(order.begin(), order.end(), [&mortonCodes](uint32_t a, uint32_t b)
+		{
+			return mortonCodes[a] < mortonCodes[b];
+		});
+
+	//Renumber the vertices in first-use order (unreferenced vertices are dropped)
+	std::vector<int> newIndex(mesh.positions.size(), -1);
+	std::vector<Vector3> orderedPositions{};
+	orderedPositions.reserve(mesh.positions.size());
+
+	mesh.indices.clear();
+	mesh.indices.reserve(triangles.size());
+	for (const uint32_t t : order)
+	{
+		for (size_t corner = 0; corner < 3; ++corner)
+		{
+			const int oldIndex = triangles[t * 3 + corner];
+			if (newIndex[oldIndex] < 0)
+			{
+				newIndex[oldIndex] = static_cast<int>(orderedPositions.size());
+				orderedPositions.push_back(mesh.positions[oldIndex]);
+			}
+			mesh.indices.push_back(newIndex[oldIndex]);
+		}
+	}
+
+	mesh.positions = std::move(orderedPositions);
+	mesh.UpdateAABB();
+
+	//Face normals in the new triangle order
+	mesh.normals.clear();
+	mesh.normals.reserve(numTriangles);
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		const Vector3& v0 = mesh.positions[mesh.indices[i]];
+		const Vector3& v1 = mesh.positions[mesh.indices[i + 1]];
+		const Vector3& v2 = mesh.positions[mesh.indices[i + 2]];
+		mesh.normals.emplace_back(Vector3::Cross(v1 - v0, v2 - v0).Normalized());
+	}
+
+	mesh.positions.shrink_to_fit();
+	mesh.indices.shrink_to_fit();
+
+	stats.verticesAfter = static_cast<uint32_t>(mesh.positions.size());
+	stats.trianglesAfter = static_cast<uint32_t>(numTriangles);
+	return stats;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	struct MeshData;
+
+	struct MeshOptimizeStats
+	{
+		uint32_t verticesBefore{};
+		uint32_t verticesAfter{};
+		uint32_t trianglesBefore{};
+		uint32_t trianglesAfter{};
+	};
+
+	namespace Utils
+	{
+		/**
+		 * \brief Load-time optimization pass for parsed meshes:
+		 * welds duplicate vertices, drops degenerate triangles (repeated indices, zero area, NaN normals),
+		 * sorts the triangles along a Morton curve through the mesh bounds and renumbers the vertices in
+		 * first-use order, so consecutive triangle tests touch neighbouring memory. Face normals are recomputed.
+		 * \param mesh mesh to optimize in place, its bounds are updated as well
+		 * \param weldEpsilon vertices closer than this (per axis, on a grid) are merged, 0 only merges exact duplicates
+		 */
+		MeshOptimizeStats OptimizeMesh(MeshData& mesh, float weldEpsilon = 0.f);
+	}
+}
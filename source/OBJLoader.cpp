@@ -0,0 +1,261 @@
+#include "OBJLoader.h"
+
+#include <charconv>
+#include <cstring>
+#include <thread>
+#include <ppl.h> //parallel_for
+
+#include "FileMapping.h"
+
+using namespace dae;
+
+namespace
+{
+	//Chunks smaller than this are not worth a task of their own
+	constexpr size_t g_MinChunkSize{ 64 * 1024 };
+	constexpr size_t g_TrianglesPerNormalTask{ 4096 };
+
+	struct ChunkResult
+	{
+		std::vector<Vector3> positions{};
+		//Absolute (0-based) indices, except the ones listed in relativeIndices:
+		//those came from negative OBJ indices and are relative to the first vertex of this chunk
+		std::vector<int> indices{};
+		std::vector<uint32_t> relativeIndices{};
+		bool isValid{ true };
+	};
+
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* SkipSpaces(const char* pCurr, const char* pEnd)
+	{
+		while (pCurr < pEnd && IsSpace(*pCurr))
+			++pCurr;
+		return pCurr;
+	}
+
+	const char* NextLine(const char* pCurr, const char* pEnd)
+	{
+		const void* pNewLine = std::memchr(pCurr, '\n', pEnd - pCurr);
+		return pNewLine ? static_cast<const char*>(pNewLine) + 1 : pEnd;
+	}
+
+	bool ParseFloat(const char*& pCurr, const char* pEnd, float& value)
+	{
+		pCurr = SkipSpaces(pCurr, pEnd);
+		//from_chars does not accept a leading '+'
+		if (pCurr < pEnd && *pCurr == '+')
+			++pCurr;
+
+		const auto [pNext, error] = std::from_chars(pCurr, pEnd, value);
+		if (error != std::errc{})
+			return false;
+
+		pCurr = pNext;
+		return true;
+	}
+
+	//Parses one "v", "v/vt", "v//vn" or "v/vt/vn" token, only the position index is kept
+	bool ParseFaceVertex(const char*& pCurr, const char* pEnd, int& positionIndex)
+	{
+		const auto [pNext, error] = std::from_chars(pCurr, pEnd, positionIndex);
+		if (error != std::errc{} || positionIndex == 0)
+			return false;
+
+		pCurr = pNext;
+		while (pCurr < pEnd && !IsSpace(*pCurr) && *pCurr != '\n')
+			++pCurr;
+
+		return true;
+	}
+
+	void ParseChunk(const char* pCurr, const char* pEnd, bool flipWinding, ChunkResult& result)
+	{
+		std::vector<int> polygon{};
+		std::vector<char> isRelative{};
+		polygon.reserve(8);
+		isRelative.reserve(8);
+
+		const auto emitIndex = [&](size_t polygonIndex)
+		{
+			if (isRelative[polygonIndex])
+				result.relativeIndices.push_back(static_cast<uint32_t>(result.indices.size()));
+			result.indices.push_back(polygon[polygonIndex]);
+		};
+
+		while (pCurr < pEnd)
+		{
+			const char* pLine = SkipSpaces(pCurr, pEnd);
+			const char* pLineEnd = NextLine(pLine, pEnd);
+
+			if (pLineEnd - pLine >= 2 && pLine[0] == 'v' && IsSpace(pLine[1]))
+			{
+				//Vertex
+				const char* pToken = pLine + 2;
+				Vector3 position{};
+				if (!ParseFloat(pToken, pLineEnd, position.x) ||
+					!ParseFloat(pToken, pLineEnd, position.y) ||
+					!ParseFloat(pToken, pLineEnd, position.z))
+				{
+					result.isValid = false;
+					return;
+				}
+				result.positions.emplace_back(position);
+			}
+			else if (pLineEnd - pLine >= 2 && pLine[0] == 'f' && IsSpace(pLine[1]))
+			{
+				//Face, polygons are triangulated as a fan around the first vertex
+				polygon.clear();
+				isRelative.clear();
+
+				const char* pToken = SkipSpaces(pLine + 2, pLineEnd);
+				while (pToken < pLineEnd && *pToken != '\n' && *pToken != '#')
+				{
+					int index{};
+					if (!ParseFaceVertex(pToken, pLineEnd, index))
+					{
+						result.isValid = false;
+						return;
+					}
+
+					//Negative indices are relative to the vertices read so far, the chunk offset gets added when merging
+					//OBJ format uses 1-based arrays
+					isRelative.push_back(index < 0);
+					polygon.push_back(index < 0 ? index + static_cast<int>(result.positions.size()) : index - 1);
+
+					pToken = SkipSpaces(pToken, pLineEnd);
+				}
+
+				if (polygon.size() < 3)
+				{
+					result.isValid = false;
+					return;
+				}
+
+				for (size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					emitIndex(0);
+					if (flipWinding)
+					{
+						emitIndex(i + 1);
+						emitIndex(i);
+					}
+					else
+					{
+						emitIndex(i);
+						emitIndex(i + 1);
+					}
+				}
+			}
+			//Everything else ("#", "vt", "vn", "o", "g", "s", "usemtl", ...) is ignored
+
+			pCurr = pLineEnd;
+		}
+	}
+}
+
+bool Utils::LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals,
+	std::vector<int>& indices, bool flipAxisAndWinding)
+{
+	positions.clear();
+	normals.clear();
+	indices.clear();
+
+	FileMapping file{};
+	if (!file.Open(filename))
+		return false;
+
+	const char* pData = file.GetData();
+	const size_t size = file.GetSize();
+
+	//Split into line-aligned chunks
+	const size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	const size_t numChunks = std::max<size_t>(1, std::min(numThreads * 4, size / g_MinChunkSize));
+
+	std::vector<const char*> chunkStarts(numChunks + 1);
+	chunkStarts[0] = pData;
+	chunkStarts[numChunks] = pData + size;
+	for (size_t i = 1; i < numChunks; ++i)
+	{
+		const char* pSplit = std::max(pData + size * i / numChunks, chunkStarts[i - 1]);
+		chunkStarts[i] = NextLine(pSplit, pData + size);
+	}
+
+	//Parse
+	std::vector<ChunkResult> chunks(numChunks);
+	concurrency::parallel_for(size_t(0), numChunks, [&](size_t i)
+		{
+			ParseChunk(chunkStarts[i], chunkStarts[i + 1], flipAxisAndWinding, chunks[i]);
+		});
+
+	//Merge
+	std::vector<size_t> positionOffsets(numChunks + 1, 0);
+	std::vector<size_t> indexOffsets(numChunks + 1, 0);
+	for (size_t i = 0; i < numChunks; ++i)
+	{
+		if (!chunks[i].isValid)
+			return false;
+
+		positionOffsets[i + 1] = positionOffsets[i] + chunks[i].positions.size();
+		indexOffsets[i + 1] = indexOffsets[i] + chunks[i].indices.size();
+	}
+
+	positions.resize(positionOffsets[numChunks]);
+	indices.resize(indexOffsets[numChunks]);
+
+	const int numPositions = static_cast<int>(positions.size());
+	std::vector<char> chunkIndicesValid(numChunks, 1);
+	concurrency::parallel_for(size_t(0), numChunks, [&](size_t i)
+		{
+			const ChunkResult& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionOffsets[i]);
+
+			int* pIndices = indices.data() + indexOffsets[i];
+			std::copy(chunk.indices.begin(), chunk.indices.end(), pIndices);
+			for (const uint32_t relativeIndex : chunk.relativeIndices)
+			{
+				pIndices[relativeIndex] += static_cast<int>(positionOffsets[i]);
+			}
+
+			for (size_t j = 0; j < chunk.indices.size(); ++j)
+			{
+				if (pIndices[j] < 0 || pIndices[j] >= numPositions)
+				{
+					chunkIndicesValid[i] = 0;
+					return;
+				}
+			}
+		});
+
+	for (const char isValid : chunkIndicesValid)
+	{
+		if (!isValid)
+		{
+			positions.clear();
+			indices.clear();
+			return false;
+		}
+	}
+
+	//Precompute normals
+	const size_t numTriangles = indices.size() / 3;
+	normals.resize(numTriangles);
+	const size_t numNormalTasks = (numTriangles + g_TrianglesPerNormalTask - 1) / g_TrianglesPerNormalTask;
+	concurrency::parallel_for(size_t(0), numNormalTasks, [&](size_t task)
+		{
+			const size_t end = std::min(numTriangles, (task + 1) * g_TrianglesPerNormalTask);
+			for (size_t triangle = task * g_TrianglesPerNormalTask; triangle < end; ++triangle)
+			{
+				const Vector3& v0 = positions[indices[triangle * 3]];
+				const Vector3& v1 = positions[indices[triangle * 3 + 1]];
+				const Vector3& v2 = positions[indices[triangle * 3 + 2]];
+
+				normals[triangle] = Vector3::Cross(v1 - v0, v2 - v0).Normalized();
+			}
+		});
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	namespace Utils
+	{
+		/**
+		 * \brief Loads the positions and triangle indices of an OBJ file and precomputes the face normals.
+		 * The file is memory mapped, split into line-aligned chunks and the chunks are parsed in parallel (std::from_chars, no streams).
+		 * Supports "f v", "f v/vt", "f v//vn" and "f v/vt/vn" faces, negative (relative) indices and polygons (fan triangulated).
+		 * \param filename path to the OBJ file
+		 * \param positions output vertex positions (cleared first)
+		 * \param normals output face normals, one per triangle (cleared first)
+		 * \param indices output triangle indices, three per triangle (cleared first)
+		 * \param flipAxisAndWinding swap the winding order of every triangle
+		 * \return false if the file could not be opened or a face references a vertex that does not exist
+		 */
+		bool LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals,
+			std::vector<int>& indices, bool flipAxisAndWinding = false);
+	}
+}
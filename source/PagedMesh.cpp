@@ -0,0 +1,419 @@
+#include "PagedMesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <type_traits>
+
+#include "MeshCache.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr char g_PageFileMagic[8]{ 'R', 'T', 'P', 'A', 'G', 'E', 'S', '\0' };
+	//Bump whenever the layout or the content of the page file changes
+	constexpr uint32_t g_PageFileVersion{ 1 };
+	constexpr const char* g_PageFileExtension{ ".pages" };
+
+	struct PageFileHeader
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t trianglesPerCluster{};
+
+		//Source validation
+		uint64_t sourceSize{};
+		int64_t sourceWriteTime{};
+
+		uint32_t numClusters{};
+		uint32_t numTriangles{};
+		uint64_t clustersOffset{};
+		uint64_t fileSize{};
+
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+	};
+	static_assert(std::is_trivially_copyable_v<PageFileHeader>);
+	static_assert(std::is_trivially_copyable_v<MeshCluster> && std::is_trivially_copyable_v<PagedTriangle>);
+
+	bool GetSourceInfo(const std::string& filename, uint64_t& size, int64_t& writeTime)
+	{
+		std::error_code error{};
+		size = std::filesystem::file_size(filename, error);
+		if (error)
+			return false;
+
+		const auto time = std::filesystem::last_write_time(filename, error);
+		if (error)
+			return false;
+
+		writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+		return true;
+	}
+
+	//The triangles of an optimized mesh are already in Morton order, so consecutive runs are spatially coherent clusters
+	bool WritePageFile(const std::string& pageFilename, const MeshData& mesh, uint64_t sourceSize, int64_t sourceWriteTime,
+		uint32_t trianglesPerCluster)
+	{
+		const uint32_t numTriangles = static_cast<uint32_t>(mesh.normals.size());
+		const uint32_t numClusters = (numTriangles + trianglesPerCluster - 1) / trianglesPerCluster;
+
+		PageFileHeader header{};
+		std::memcpy(header.magic, g_PageFileMagic, sizeof(g_PageFileMagic));
+		header.version = g_PageFileVersion;
+		header.trianglesPerCluster = trianglesPerCluster;
+		header.sourceSize = sourceSize;
+		header.sourceWriteTime = sourceWriteTime;
+		header.numClusters = numClusters;
+		header.numTriangles = numTriangles;
+		header.clustersOffset = sizeof(PageFileHeader);
+		header.minAABB = mesh.minAABB;
+		header.maxAABB = mesh.maxAABB;
+
+		std::vector<MeshCluster> clusters(numClusters);
+		uint64_t pageOffset = header.clustersOffset + numClusters * sizeof(MeshCluster);
+		for (uint32_t c = 0; c < numClusters; ++c)
+		{
+			MeshCluster& cluster = clusters[c];
+			const uint32_t firstTriangle = c * trianglesPerCluster;
+			cluster.numTriangles = std::min(trianglesPerCluster, numTriangles - firstTriangle);
+			cluster.fileOffset = pageOffset;
+			pageOffset += PagedMesh::GetPageSize(cluster);
+
+			cluster.minAABB = mesh.positions[mesh.indices[firstTriangle * 3]];
+			cluster.maxAABB = cluster.minAABB;
+			for (uint32_t i = firstTriangle * 3; i < (firstTriangle + cluster.numTriangles) * 3; ++i)
+			{
+				cluster.minAABB = Vector3::Min(mesh.positions[mesh.indices[i]], cluster.minAABB);
+				cluster.maxAABB = Vector3::Max(mesh.positions[mesh.indices[i]], cluster.maxAABB);
+			}
+		}
+		header.fileSize = pageOffset;
+
+		//Write to a temporary file first so a crash never leaves a half written page file behind
+		const std::string tempFilename = pageFilename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+			if (!file)
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(PageFileHeader));
+			file.write(reinterpret_cast<const char*>(clusters.data()), static_cast<std::streamsize>(clusters.size() * sizeof(MeshCluster)));
+
+			std::vector<PagedTriangle> page{};
+			page.reserve(trianglesPerCluster);
+			for (uint32_t c = 0; c < numClusters; ++c)
+			{
+				page.clear();
+				const uint32_t firstTriangle = c * trianglesPerCluster;
+				for (uint32_t t = firstTriangle; t < firstTriangle + clusters[c].numTriangles; ++t)
+				{
+					page.push_back({
+						mesh.positions[mesh.indices[t * 3]],
+						mesh.positions[mesh.indices[t * 3 + 1]],
+						mesh.positions[mesh.indices[t * 3 + 2]],
+						mesh.normals[t] });
+				}
+				file.write(reinterpret_cast<const char*>(page.data()), static_cast<std::streamsize>(page.size() * sizeof(PagedTriangle)));
+			}
+
+			if (!file)
+				return false;
+		}
+
+		std::error_code error{};
+		std::filesystem::rename(tempFilename, pageFilename, error);
+		if (error)
+		{
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		return true;
+	}
+}
+
+#pragma region PagedMesh
+PagedMesh::PagedMesh(TriangleCullMode cullMode, unsigned char materialIndex) :
+	m_CullMode{ cullMode },
+	m_MaterialIndex{ materialIndex }
+{
+}
+
+bool PagedMesh::Open(const std::string& filename, uint32_t trianglesPerCluster)
+{
+	trianglesPerCluster = std::max(trianglesPerCluster, 1u);
+	m_PageFilename = filename + g_PageFileExtension;
+
+	uint64_t sourceSize{};
+	int64_t sourceWriteTime{};
+	if (!GetSourceInfo(filename, sourceSize, sourceWriteTime))
+		return false;
+
+	if (!ReadPageTable(sourceSize, sourceWriteTime, trianglesPerCluster))
+	{
+		//Scoped so the full mesh is released again before the pages are used
+		{
+			MeshData data{};
+			if (!Utils::LoadMesh(filename, data) || data.normals.empty())
+				return false;
+
+			if (!WritePageFile(m_PageFilename, data, sourceSize, sourceWriteTime, trianglesPerCluster))
+			{
+				std::cout << "[PagedMesh] Could not write " << m_PageFilename << std::endl;
+				return false;
+			}
+		}
+
+		if (!ReadPageTable(sourceSize, sourceWriteTime, trianglesPerCluster))
+			return false;
+	}
+
+	const size_t numClusters = m_Clusters.size();
+	m_Pages.clear();
+	m_Pages.resize(numClusters);
+	m_pLastUsedFrame = std::make_unique<std::atomic<uint32_t>[]>(numClusters);
+	m_pIsRequested = std::make_unique<std::atomic<bool>[]>(numClusters);
+	m_Requests.clear();
+
+	UpdateTransforms();
+	return true;
+}
+
+bool PagedMesh::ReadPageTable(uint64_t sourceSize, int64_t sourceWriteTime, uint32_t trianglesPerCluster)
+{
+	m_PageFile.close();
+	m_PageFile.clear();
+	m_PageFile.open(m_PageFilename, std::ios::binary);
+	if (!m_PageFile)
+		return false;
+
+	std::error_code error{};
+	const uint64_t fileSize = std::filesystem::file_size(m_PageFilename, error);
+
+	PageFileHeader header{};
+	if (error || !m_PageFile.read(reinterpret_cast<char*>(&header), sizeof(PageFileHeader)))
+		return false;
+
+	if (std::memcmp(header.magic, g_PageFileMagic, sizeof(g_PageFileMagic)) != 0 ||
+		header.version != g_PageFileVersion ||
+		header.trianglesPerCluster != trianglesPerCluster ||
+		header.sourceSize != sourceSize ||
+		header.sourceWriteTime != sourceWriteTime ||
+		header.fileSize != fileSize ||
+		header.clustersOffset > fileSize ||
+		header.numClusters > (fileSize - header.clustersOffset) / sizeof(MeshCluster))
+	{
+		return false;
+	}
+
+	std::vector<MeshCluster> clusters(header.numClusters);
+	m_PageFile.seekg(static_cast<std::streamoff>(header.clustersOffset));
+	if (!m_PageFile.read(reinterpret_cast<char*>(clusters.data()), static_cast<std::streamsize>(clusters.size() * sizeof(MeshCluster))))
+		return false;
+
+	for (const MeshCluster& cluster : clusters)
+	{
+		if (cluster.numTriangles == 0 || cluster.fileOffset > fileSize || GetPageSize(cluster) > fileSize - cluster.fileOffset)
+			return false;
+	}
+
+	m_Clusters = std::move(clusters);
+	m_NumTriangles = header.numTriangles;
+	m_MinAABB = header.minAABB;
+	m_MaxAABB = header.maxAABB;
+	return true;
+}
+
+void PagedMesh::Translate(const Vector3& translation)
+{
+	SetTransform(m_TranslationTransform, Matrix::CreateTranslation(translation));
+}
+
+void PagedMesh::RotateY(float yaw)
+{
+	SetTransform(m_RotationTransform, Matrix::CreateRotationY(yaw));
+}
+
+void PagedMesh::Scale(const Vector3& scale)
+{
+	SetTransform(m_ScaleTransform, Matrix::CreateScale(scale));
+}
+
+void PagedMesh::SetTransform(Matrix& transform, const Matrix& newTransform)
+{
+	if (transform == newTransform)
+		return;
+
+	transform = newTransform;
+	m_IsTransformDirty = true;
+}
+
+bool PagedMesh::UpdateTransforms()
+{
+	if (!m_IsTransformDirty)
+		return false;
+	m_IsTransformDirty = false;
+
+	const Matrix objectToWorld = m_ScaleTransform * m_RotationTransform * m_TranslationTransform;
+	m_WorldToObject = Matrix::Inverse(objectToWorld);
+	m_NormalToWorld = Matrix::Transpose(m_WorldToObject);
+
+	objectToWorld.TransformAABB(m_MinAABB, m_MaxAABB, m_TransformedMinAABB, m_TransformedMaxAABB);
+	return true;
+}
+
+std::vector<uint32_t> PagedMesh::TakeRequests()
+{
+	std::vector<uint32_t> requests{};
+	{
+		std::lock_guard lock{ m_RequestMutex };
+		requests.swap(m_Requests);
+	}
+
+	//Clusters that don't get loaded this time are queued again by the next ray that needs them
+	for (const uint32_t cluster : requests)
+		m_pIsRequested[cluster].store(false, std::memory_order_relaxed);
+
+	return requests;
+}
+
+size_t PagedMesh::LoadPage(uint32_t cluster)
+{
+	if (m_Pages[cluster])
+		return 0;
+
+	const MeshCluster& info = m_Clusters[cluster];
+	auto pPage = std::make_unique<PagedTriangle[]>(info.numTriangles);
+
+	m_PageFile.clear();
+	m_PageFile.seekg(static_cast<std::streamoff>(info.fileOffset));
+	if (!m_PageFile.read(reinterpret_cast<char*>(pPage.get()), static_cast<std::streamsize>(GetPageSize(info))))
+	{
+		//Keep it marked as requested so a broken page isn't retried every frame
+		m_pIsRequested[cluster].store(true, std::memory_order_relaxed);
+		std::cout << "[PagedMesh] Could not read cluster " << cluster << " from " << m_PageFilename << std::endl;
+		return 0;
+	}
+
+	m_Pages[cluster] = std::move(pPage);
+	m_pLastUsedFrame[cluster].store(m_Frame, std::memory_order_relaxed);
+	return GetPageSize(info);
+}
+
+size_t PagedMesh::EvictPage(uint32_t cluster)
+{
+	if (!m_Pages[cluster])
+		return 0;
+
+	m_Pages[cluster].reset();
+	return GetPageSize(m_Clusters[cluster]);
+}
+
+size_t PagedMesh::GetMemoryUsage() const
+{
+	return sizeof(PagedMesh)
+		+ m_Clusters.capacity() * sizeof(MeshCluster)
+		+ m_Pages.capacity() * sizeof(std::unique_ptr<PagedTriangle[]>)
+		+ m_Clusters.size() * (sizeof(std::atomic<uint32_t>) + sizeof(std::atomic<bool>));
+}
+#pragma endregion
+
+#pragma region GeometryPageCache
+GeometryPageCache::GeometryPageCache(size_t budgetBytes) :
+	m_BudgetBytes{ budgetBytes }
+{
+}
+
+PagedMesh* GeometryPageCache::Add(std::unique_ptr<PagedMesh> pMesh)
+{
+	pMesh->SetFrame(m_Frame);
+	m_pMeshes.push_back(std::move(pMesh));
+	return m_pMeshes.back().get();
+}
+
+bool GeometryPageCache::Update()
+{
+	struct PageRef
+	{
+		PagedMesh* pMesh{};
+		uint32_t cluster{};
+	};
+
+	bool hasChanged{ false };
+	std::vector<PageRef> requests{};
+	for (const auto& pMesh : m_pMeshes)
+	{
+		for (const uint32_t cluster : pMesh->TakeRequests())
+			requests.push_back({ pMesh.get(), cluster });
+	}
+
+	if (!requests.empty())
+	{
+		//Sequential reads per page file
+		std::sort(requests.begin(), requests.end(), [](const PageRef& a, const PageRef& b)
+			{
+				if (a.pMesh != b.pMesh)
+					return a.pMesh < b.pMesh;
+				return a.pMesh->GetClusters()[a.cluster].fileOffset < b.pMesh->GetClusters()[b.cluster].fileOffset;
+			});
+
+		//Eviction candidates, least recently used first. Pages loaded below are not in here, so they survive this batch.
+		std::vector<PageRef> residentPages{};
+		for (const auto& pMesh : m_pMeshes)
+		{
+			for (uint32_t cluster = 0; cluster < pMesh->GetClusters().size(); ++cluster)
+			{
+				if (pMesh->IsResident(cluster))
+					residentPages.push_back({ pMesh.get(), cluster });
+			}
+		}
+		std::sort(residentPages.begin(), residentPages.end(), [](const PageRef& a, const PageRef& b)
+			{
+				return a.pMesh->GetLastUsedFrame(a.cluster) < b.pMesh->GetLastUsedFrame(b.cluster);
+			});
+
+		size_t nextEviction{ 0 };
+		for (const PageRef& request : requests)
+		{
+			const size_t pageSize = PagedMesh::GetPageSize(request.pMesh->GetClusters()[request.cluster]);
+			while (m_ResidentBytes + pageSize > m_BudgetBytes && nextEviction < residentPages.size())
+			{
+				const PageRef& victim = residentPages[nextEviction++];
+				m_ResidentBytes -= victim.pMesh->EvictPage(victim.cluster);
+				hasChanged = true;
+			}
+
+			//The rest gets requested again next frame
+			if (m_ResidentBytes + pageSize > m_BudgetBytes)
+			{
+				if (!m_WarnedBudget)
+				{
+					m_WarnedBudget = true;
+					std::cout << "[GeometryPageCache] Visible geometry does not fit in the " << m_BudgetBytes / 1024
+						<< " KiB page budget" << std::endl;
+				}
+				break;
+			}
+
+			m_ResidentBytes += request.pMesh->LoadPage(request.cluster);
+			hasChanged = true;
+		}
+	}
+
+	++m_Frame;
+	for (const auto& pMesh : m_pMeshes)
+		pMesh->SetFrame(m_Frame);
+
+	return hasChanged;
+}
+
+size_t GeometryPageCache::GetMemoryUsage() const
+{
+	size_t usage = m_ResidentBytes + m_pMeshes.capacity() * sizeof(std::unique_ptr<PagedMesh>);
+	for (const auto& pMesh : m_pMeshes)
+		usage += pMesh->GetMemoryUsage();
+	return usage;
+}
+#pragma endregion
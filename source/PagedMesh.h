@@ -0,0 +1,173 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Object space triangle as stored in a cluster page
+	struct PagedTriangle
+	{
+		Vector3 v0{};
+		Vector3 v1{};
+		Vector3 v2{};
+		Vector3 normal{};
+	};
+
+	//Always resident part of a cluster: its object space bounds and where its page lives in the page file
+	struct MeshCluster
+	{
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		uint64_t fileOffset{};
+		uint32_t numTriangles{};
+	};
+
+	/**
+	 * \brief Out-of-core triangle mesh. The mesh is split into spatially coherent clusters (runs of Morton ordered triangles)
+	 * that are stored in "<filename>.pages", only the cluster table stays in memory.
+	 * A ray reaching a cluster that is not resident queues the cluster and skips it, GeometryPageCache loads the queued
+	 * clusters in one batch between frames, so render threads never wait on I/O.
+	 */
+	class PagedMesh final
+	{
+	public:
+		PagedMesh(TriangleCullMode cullMode, unsigned char materialIndex);
+		~PagedMesh() = default;
+
+		PagedMesh(const PagedMesh&) = delete;
+		PagedMesh(PagedMesh&&) noexcept = delete;
+		PagedMesh& operator=(const PagedMesh&) = delete;
+		PagedMesh& operator=(PagedMesh&&) noexcept = delete;
+
+		/**
+		 * \brief Opens the page file of an OBJ file, (re)building it through Utils::LoadMesh when it is missing or outdated.
+		 * Building needs the whole mesh in memory once, afterwards only the cluster table is kept.
+		 * \param filename path to the OBJ file
+		 * \param trianglesPerCluster triangles per page, smaller pages load less unused geometry but grow the cluster table
+		 * \return false if the page file could not be opened or built
+		 */
+		bool Open(const std::string& filename, uint32_t trianglesPerCluster = 512);
+
+		void Translate(const Vector3& translation);
+		void RotateY(float yaw);
+		void Scale(const Vector3& scale);
+		//Returns false when nothing had to be recomputed
+		bool UpdateTransforms();
+
+		//Page of a cluster, or nullptr after queueing the cluster when its page is not resident. Safe to call while rendering.
+		const PagedTriangle* GetPage(uint32_t cluster) const
+		{
+			if (const PagedTriangle* pPage = m_Pages[cluster].get())
+			{
+				//Only write when it changes, so rays sharing a cluster don't keep bouncing its cache line between cores
+				if (m_pLastUsedFrame[cluster].load(std::memory_order_relaxed) != m_Frame)
+					m_pLastUsedFrame[cluster].store(m_Frame, std::memory_order_relaxed);
+				return pPage;
+			}
+
+			if (!m_pIsRequested[cluster].exchange(true, std::memory_order_relaxed))
+			{
+				std::lock_guard lock{ m_RequestMutex };
+				m_Requests.push_back(cluster);
+			}
+			return nullptr;
+		}
+
+		//Page cache side, only called between frames
+		std::vector<uint32_t> TakeRequests();
+		size_t LoadPage(uint32_t cluster);
+		size_t EvictPage(uint32_t cluster);
+		void SetFrame(uint32_t frame) { m_Frame = frame; }
+
+		bool IsResident(uint32_t cluster) const { return m_Pages[cluster] != nullptr; }
+		uint32_t GetLastUsedFrame(uint32_t cluster) const { return m_pLastUsedFrame[cluster].load(std::memory_order_relaxed); }
+		static size_t GetPageSize(const MeshCluster& cluster) { return cluster.numTriangles * sizeof(PagedTriangle); }
+
+		const std::vector<MeshCluster>& GetClusters() const { return m_Clusters; }
+		uint32_t GetNumTriangles() const { return m_NumTriangles; }
+		TriangleCullMode GetCullMode() const { return m_CullMode; }
+		unsigned char GetMaterialIndex() const { return m_MaterialIndex; }
+		const Matrix& GetWorldToObject() const { return m_WorldToObject; }
+		const Matrix& GetNormalToWorld() const { return m_NormalToWorld; }
+		const Vector3& GetTransformedMinAABB() const { return m_TransformedMinAABB; }
+		const Vector3& GetTransformedMaxAABB() const { return m_TransformedMaxAABB; }
+
+		//Cluster table and bookkeeping, resident pages are counted by the page cache
+		size_t GetMemoryUsage() const;
+
+	private:
+		TriangleCullMode m_CullMode{ TriangleCullMode::BackFaceCulling };
+		unsigned char m_MaterialIndex{};
+
+		Matrix m_RotationTransform{};
+		Matrix m_TranslationTransform{};
+		Matrix m_ScaleTransform{};
+		bool m_IsTransformDirty{ true };
+		Matrix m_WorldToObject{};
+		Matrix m_NormalToWorld{};
+
+		Vector3 m_MinAABB{};
+		Vector3 m_MaxAABB{};
+		Vector3 m_TransformedMinAABB{};
+		Vector3 m_TransformedMaxAABB{};
+
+		std::string m_PageFilename{};
+		std::ifstream m_PageFile{};
+		uint32_t m_NumTriangles{};
+
+		std::vector<MeshCluster> m_Clusters{};
+		std::vector<std::unique_ptr<PagedTriangle[]>> m_Pages{};
+		std::unique_ptr<std::atomic<uint32_t>[]> m_pLastUsedFrame{};
+		std::unique_ptr<std::atomic<bool>[]> m_pIsRequested{};
+
+		uint32_t m_Frame{};
+		mutable std::mutex m_RequestMutex{};
+		mutable std::vector<uint32_t> m_Requests{};
+
+		void SetTransform(Matrix& transform, const Matrix& newTransform);
+		bool ReadPageTable(uint64_t sourceSize, int64_t sourceWriteTime, uint32_t trianglesPerCluster);
+	};
+
+	/**
+	 * \brief Owns the paged meshes of a scene and keeps their resident pages within a memory budget.
+	 * Pages are evicted least recently used first, using the frame in which a ray last touched them.
+	 */
+	class GeometryPageCache final
+	{
+	public:
+		explicit GeometryPageCache(size_t budgetBytes = 64ull * 1024 * 1024);
+		~GeometryPageCache() = default;
+
+		GeometryPageCache(const GeometryPageCache&) = delete;
+		GeometryPageCache(GeometryPageCache&&) noexcept = delete;
+		GeometryPageCache& operator=(const GeometryPageCache&) = delete;
+		GeometryPageCache& operator=(GeometryPageCache&&) noexcept = delete;
+
+		PagedMesh* Add(std::unique_ptr<PagedMesh> pMesh);
+
+		//Loads the clusters queued during the last frame in one batch (in file order), evicting old pages to make room.
+		//Must be called between frames. Returns true when pages were loaded or evicted.
+		bool Update();
+
+		void SetBudget(size_t budgetBytes) { m_BudgetBytes = budgetBytes; }
+		size_t GetBudget() const { return m_BudgetBytes; }
+		size_t GetResidentBytes() const { return m_ResidentBytes; }
+		const std::vector<std::unique_ptr<PagedMesh>>& GetMeshes() const { return m_pMeshes; }
+
+		size_t GetMemoryUsage() const;
+
+	private:
+		std::vector<std::unique_ptr<PagedMesh>> m_pMeshes{};
+		size_t m_BudgetBytes{};
+		size_t m_ResidentBytes{};
+		uint32_t m_Frame{ 1 };
+		bool m_WarnedBudget{ false };
+	};
+}
@@ -9,7 +9,11 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "ImageWriter.h"
+#include "Sampling.h"
 
+#include <bit>
+#include <chrono>
 #include <future>
 #include <ppl.h> //parallel_for
 
@@ -24,51 +28,211 @@ Renderer::Renderer(SDL_Window * pWindow) :
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_pColorBuffer = std::make_unique<ColorRGB[]>(static_cast<size_t>(m_Width) * m_Height);
+	m_pObjectIds = std::make_unique<uint32_t[]>(static_cast<size_t>(m_Width) * m_Height);
+	m_pTileStates = std::make_unique<TileState[]>(GetNumTiles());
+
+	//What SDL_MapRGB does for this surface, so the resolve kernel can do it
+	const SDL_PixelFormat* pFormat = m_pBuffer->format;
+	m_PixelLayout.shift[0] = pFormat->Rshift;
+	m_PixelLayout.shift[1] = pFormat->Gshift;
+	m_PixelLayout.shift[2] = pFormat->Bshift;
+	m_PixelLayout.loss[0] = pFormat->Rloss;
+	m_PixelLayout.loss[1] = pFormat->Gloss;
+	m_PixelLayout.loss[2] = pFormat->Bloss;
+	m_PixelLayout.alphaMask = pFormat->Amask;
 }
 
-void Renderer::Render(Scene* pScene) const
+namespace
 {
+	//Objects ids of samples that didn't hit anything
+	constexpr uint32_t g_NoObjectId{ UINT32_MAX };
+
+	//Phase 1 result of a sample whose (reflected) view ray hit something
+	struct ShadingHit
+	{
+		Vector3 origin{};
+		Vector3 normal{};
+		Vector3 viewDirection{}; //towards the camera
+		uint32_t sample{};
+		unsigned char materialIndex{};
+		ColorRGB throughput{ colors::White }; //of the mirrors on the way
+	};
+
+	//Reflection rays a ShadeSamples call takes from the frame's budget at once, so the counter isn't touched for every ray
+	constexpr uint32_t g_SecondaryRaysPerReservation{ 64 };
+
+	//Edge pixels per task of the adaptive anti-aliasing pass
+	constexpr uint32_t g_EdgePixelsPerBatch{ 64 };
+
+	float GetLuminance(ColorRGB color)
+	{
+		color.MaxToOne();
+		return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+	}
+}
+
+//Per thread scratch memory of ShadeSamples, so tiles don't allocate once the buffers have grown
+struct Renderer::SampleScratch
+{
+	//Input, raster positions (pixel + offset inside the pixel)
+	std::vector<float> sampleX{};
+	std::vector<float> sampleY{};
+
+	//Output, per sample
+	std::vector<ColorRGB> colors{};
+	std::vector<uint8_t> isWritten{};
+	std::vector<uint32_t> objectIds{};
+	//Denoiser guides of the hit that was shaded (behind the mirrors), the depth is the length of the path to it
+	std::vector<float> depths{}; //FLT_MAX for misses
+	std::vector<uint8_t> ages{}; //0 unless the color came from the history
+	std::vector<Vector3> hitNormals{}; //zero for misses
+	std::vector<ColorRGB> albedos{};
+
+	//Set for samples through the pixel centers, in pixel order, only those can take the previous frame's color
+	const FrameHistory* pHistory{};
+
+	std::vector<ShadingHit> hits{};
+	std::vector<ShadingHit> sortedHits{};
+	std::vector<uint32_t> materialOffsets{};
+
+	//(hit, light) pairs of one material where the light reaches the hit
+	std::vector<uint32_t> litHits{};
+	std::vector<Vector3> normals{};
+	std::vector<Vector3> lightDirections{};
+	std::vector<Vector3> viewDirections{};
+	std::vector<float> cosines{};
+	std::vector<ColorRGB> radiances{}; //times the light's selection weight
+	std::vector<ColorRGB> shaded{};
+
+	//Samples of one area light for one hit that face the hit, and their shadow rays
+	struct AreaLightSample
+	{
+		Vector3 point{};
+		Vector3 direction{}; //normalized, from the hit
+		float cosine{};
+	};
+	std::vector<AreaLightSample> areaLightSamples{};
+	std::vector<Ray> shadowRays{};
+	std::vector<uint8_t> isOccluded{};
+
+	void Clear()
+	{
+		sampleX.clear();
+		sampleY.clear();
+		pHistory = nullptr;
+	}
+
+	void AddSample(float x, float y)
+	{
+		sampleX.push_back(x);
+		sampleY.push_back(y);
+	}
+};
+
+void Renderer::Render(Scene* pScene)
+{
+	const auto startTime = std::chrono::steady_clock::now();
 	Camera& camera = pScene->GetCamera();
-	auto& materials = pScene->GetMaterials();
-	auto& lights = pScene->GetLights();
+
+	//Progressive accumulation starts over whenever the image would change, updateONB is only set for rotations
+	if (m_IsProgressiveEnabled)
+	{
+		if (camera.updateONB || camera.origin != m_AccumulatedCameraOrigin || camera.fovAngle != m_AccumulatedFovAngle
+			|| pScene->GetVersion() != m_AccumulatedSceneVersion)
+			m_NumAccumulatedFrames = 0;
+
+		if (m_NumAccumulatedFrames == 0)
+		{
+			m_AccumulatedTime = 0.f;
+			m_IsConverged = false;
+		}
+		m_AccumulatedCameraOrigin = camera.origin;
+		m_AccumulatedFovAngle = camera.fovAngle;
+		m_AccumulatedSceneVersion = pScene->GetVersion();
+
+		//Done, the buffers keep the final image until something changes
+		if (m_IsConverged)
+		{
+			m_Stats.numPrimarySamples = m_Stats.numEdgePixels = m_Stats.numExtraSamples = 0;
+			m_Stats.numRenderedTiles = m_Stats.samplesPerPixel = m_Stats.numSecondaryRays = 0;
+			m_Stats.isRayBudgetExhausted = false;
+			m_Stats.numReusedPixels = 0;
+			m_Stats.denoiseTime = 0.f;
+			SDL_UpdateWindowSurface(m_pWindow);
+			return;
+		}
+
+		++m_NumAccumulatedFrames;
+	}
 
 	/*const float width = m_Width;
 	const float height = m_Height;*/
-	const float aspectRatio = m_Width / static_cast<float>(m_Height);
-	const float fov = tanf(camera.fovAngle * TO_RADIANS / 2.f);
 	camera.CalculateCameraToWorld();
 
-	const uint32_t numPixels = m_Width * m_Height;
+	FrameContext context{};
+	context.pScene = pScene;
+	context.pCamera = &camera;
+	context.pLights = &pScene->GetLights();
+	context.pMaterials = &pScene->GetMaterials();
+	context.pLightTree = &pScene->GetLightTree();
+	//Lights can move between frames
+	m_LightGrid.Build(pScene->GetLights(), m_LightCutoff);
+	//Few enough lights are all shaded, exactly like before the light tree existed
+	context.numLightSamples = context.pLightTree->GetNumLights() > m_NumLightSamples ? m_NumLightSamples : 0;
+	context.areaLightGridSize = m_AreaLightGridSize;
+	context.areaLightSampling = m_AreaLightSampling;
+	SecondaryRayCounters secondaryRays{};
+	context.maxReflectionDepth = m_MaxReflectionDepth;
+	context.secondaryRayBudget = m_SecondaryRayBudget;
+	//Aims a bit under the budget, so the hard limit is only reached when the demand jumps
+	const float secondaryRayTarget = m_SecondaryRayBudget * 0.9f;
+	if (m_SecondaryRayBudget > 0 && m_SecondaryRayDemand > secondaryRayTarget)
+		context.budgetSurvivalProbability = secondaryRayTarget / m_SecondaryRayDemand;
+	context.pSecondaryRays = &secondaryRays;
+	context.aspectRatio = m_Width / static_cast<float>(m_Height);
+	context.fov = tanf(camera.fovAngle * TO_RADIANS / 2.f);
+	context.frameIndex = m_FrameIndex++;
+	context.numAccumulatedFrames = m_IsProgressiveEnabled ? m_NumAccumulatedFrames : 0;
+	context.samplesPerPixel = SelectTiles();
+	//Anything that changed for every object (a light, new geometry) makes the whole history stale
+	if (m_IsTemporalReuseEnabled && context.numAccumulatedFrames == 0 && m_History.isValid
+		&& pScene->GetSceneWideVersion() <= m_History.sceneVersion)
+		context.pHistory = &m_History;
+	context.refreshInterval = m_RefreshInterval;
+
+	const uint32_t numTiles = static_cast<uint32_t>(m_RenderedTiles.size());
+	const RenderFunctions functions = GetRenderFunctions();
 	
 #if defined(ASYNC)
 	//Async
 	//+++++
 	const uint32_t numCores = std::thread::hardware_concurrency();
 	std::vector<std::future<void>> async_futures{};
-	const uint32_t numPixelsPerTask = numPixels / numCores;
-	uint32_t numUnassignedPixels = numPixels % numCores;
-	uint32_t currPixelIndex = 0;
+	const uint32_t numTilesPerTask = numTiles / numCores;
+	uint32_t numUnassignedTiles = numTiles % numCores;
+	uint32_t currTileIndex = 0;
 
 	for (uint32_t coreId{0}; coreId < numCores; ++coreId)
 	{
-		uint32_t taskSize = numPixelsPerTask;
-		if (numUnassignedPixels > 0)
+		uint32_t taskSize = numTilesPerTask;
+		if (numUnassignedTiles > 0)
 		{
 			++taskSize;
-			--numUnassignedPixels;
+			--numUnassignedTiles;
 		}
 		
-		async_futures.push_back(std::async(std::launch::async, [=, this]
+		async_futures.push_back(std::async(std::launch::async, [=, this, &context]
 			{
-				//Rander all pixels for this task (currPixelIndex > currPixelIndex + taskSize)
-				const uint32_t pixelIndexEnd = currPixelIndex + taskSize;
-				for (uint32_t pixelIndex = currPixelIndex; pixelIndex < pixelIndexEnd; ++pixelIndex)
+				//Render all tiles for this task (currTileIndex > currTileIndex + taskSize)
+				const uint32_t tileIndexEnd = currTileIndex + taskSize;
+				for (uint32_t tileIndex = currTileIndex; tileIndex < tileIndexEnd; ++tileIndex)
 				{
-					RenderPixel(pScene, pixelIndex, fov, aspectRatio, camera, lights, materials);
+					(this->*functions.renderTile)(context, m_RenderedTiles[tileIndex]);
 				}
 			}));
 		
-		currPixelIndex += taskSize;
+		currTileIndex += taskSize;
 	}
 	
 	//Wait for async tasks to finish
@@ -80,117 +244,983 @@ void Renderer::Render(Scene* pScene) const
 #elif defined(PARALLEL_FOR)
 	//Parallel For
 	//++++++++++++
-	concurrency::parallel_for(0u, numPixels, [=, this](uint32_t pixelIndex)
+	concurrency::parallel_for(0u, numTiles, [=, this, &context](uint32_t i)
 		{
-			RenderPixel(pScene, pixelIndex, fov, aspectRatio, camera, lights, materials);
+			(this->*functions.renderTile)(context, m_RenderedTiles[i]);
 		});
 #else
-	for (uint32_t i{ 0 }; i < numPixels; ++i)
+	for (uint32_t i{ 0 }; i < numTiles; ++i)
+	{
+		(this->*functions.renderTile)(context, m_RenderedTiles[i]);
+	}
+#endif
+
+	m_Stats = {};
+	for (uint32_t tileIndex : m_RenderedTiles)
 	{
-		RenderPixel(pScene, i, fov, aspectRatio, camera, lights, materials);
+		int tileX{}, tileY{}, tileWidth{}, tileHeight{};
+		GetTileRect(tileIndex, tileX, tileY, tileWidth, tileHeight);
+		m_Stats.numPrimarySamples += static_cast<uint32_t>(tileWidth * tileHeight) * context.samplesPerPixel;
 	}
+	m_Stats.numAccumulatedFrames = context.numAccumulatedFrames;
+	m_Stats.numRenderedTiles = numTiles;
+	m_Stats.samplesPerPixel = context.samplesPerPixel;
+
+	//Adaptive anti-aliasing: extra samples only for the pixels FindEdgePixels picked.
+	//Accumulated frames are jittered, so only the first one of those needs it.
+	if (m_IsAdaptiveAAEnabled && context.numAccumulatedFrames <= 1)
+	{
+		FindEdgePixels();
+		const uint32_t numBatches = (static_cast<uint32_t>(m_EdgePixels.size()) + g_EdgePixelsPerBatch - 1) / g_EdgePixelsPerBatch;
+#if defined(PARALLEL_FOR)
+		concurrency::parallel_for(0u, numBatches, [=, this, &context](uint32_t batchIndex)
+			{
+				(this->*functions.renderEdgePixels)(context, batchIndex);
+			});
+#else
+		for (uint32_t i{ 0 }; i < numBatches; ++i)
+		{
+			(this->*functions.renderEdgePixels)(context, i);
+		}
 #endif
+		m_Stats.numEdgePixels = static_cast<uint32_t>(m_EdgePixels.size());
+		m_Stats.numExtraSamples = m_Stats.numEdgePixels * m_EdgeGridSize * m_EdgeGridSize;
+	}
+
+	//Counted before the survival test, only the requests behind a first mirror were thinned out by it
+	m_SecondaryRayDemand = static_cast<float>(secondaryRays.numRequested);
+	m_Stats.numSecondaryRays = secondaryRays.numTraced;
+	m_Stats.isRayBudgetExhausted = secondaryRays.isBudgetExhausted;
+
+	//The finished frame becomes the history of the next one
+	if (m_IsTemporalReuseEnabled)
+	{
+		const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+		m_Stats.numReusedPixels = static_cast<uint32_t>(std::count_if(m_pAges.get(), m_pAges.get() + numPixels,
+			[](uint8_t age) { return age > 0; }));
+		if (context.numAccumulatedFrames == 0)
+		{
+			std::copy_n(m_pColorBuffer.get(), numPixels, m_History.pColors.get());
+			std::copy_n(m_pDepths.get(), numPixels, m_History.pDepths.get());
+			std::copy_n(m_pObjectIds.get(), numPixels, m_History.pObjectIds.get());
+			std::copy_n(m_pAges.get(), numPixels, m_History.pAges.get());
+			m_History.worldToCamera = Matrix::Inverse(camera.cameraToWorld);
+			m_History.fov = context.fov;
+			m_History.sceneVersion = pScene->GetVersion();
+			m_History.isValid = true;
+		}
+		else
+			m_History.isValid = false;
+	}
+
+	m_IsFrameDenoised = m_IsDenoiserEnabled;
+	if (m_IsDenoiserEnabled)
+	{
+		const auto denoiseStartTime = std::chrono::steady_clock::now();
+		Denoise();
+		m_Stats.denoiseTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - denoiseStartTime).count();
+	}
+
+	//Converged tiles stay converged until the accumulation starts over
+	if (m_IsProgressiveEnabled)
+	{
+		m_AccumulatedTime += std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		const uint32_t numAllTiles = GetNumTiles();
+		m_Stats.numConvergedTiles = static_cast<uint32_t>(std::count_if(m_pTileStates.get(), m_pTileStates.get() + numAllTiles,
+			[this](const TileState& tile) { return IsTileConverged(tile); }));
+		m_IsConverged = m_Stats.numConvergedTiles == numAllTiles || (m_TimeLimit > 0.f && m_AccumulatedTime >= m_TimeLimit);
+		m_Stats.isConverged = m_IsConverged;
+	}
 
 	//@END
 	//Update SDL Surface
 	SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera,
-	const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::SetAdaptiveAA(bool isEnabled, uint32_t sampleBudget)
+{
+	m_IsAdaptiveAAEnabled = isEnabled;
+	m_AdaptiveSampleBudget = sampleBudget;
+}
+
+void Renderer::SetProgressive(bool isEnabled)
+{
+	m_IsProgressiveEnabled = isEnabled;
+	m_NumAccumulatedFrames = 0;
+	if (isEnabled && !m_pAccumulationBuffer)
+	{
+		m_pAccumulationBuffer = std::make_unique<ColorRGB[]>(static_cast<size_t>(m_Width) * m_Height);
+		m_pLuminanceSums = std::make_unique<LuminanceSums[]>(static_cast<size_t>(m_Width) * m_Height);
+	}
+}
+
+void Renderer::SetLightSampling(uint32_t numLightSamples)
+{
+	m_NumLightSamples = numLightSamples;
+	m_NumAccumulatedFrames = 0;
+	m_History.isValid = false;
+}
+
+void Renderer::SetLightCutoff(float radianceThreshold)
+{
+	m_LightCutoff = radianceThreshold;
+	m_NumAccumulatedFrames = 0;
+	m_History.isValid = false;
+}
+
+void Renderer::SetAreaLightSampling(uint32_t numSamples, AreaLightSampling sampling)
+{
+	m_AreaLightGridSize = std::max(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(numSamples)))), 1u);
+	m_AreaLightSampling = sampling;
+	m_NumAccumulatedFrames = 0;
+	m_History.isValid = false;
+}
+
+void Renderer::SetReflections(uint32_t maxDepth, uint32_t secondaryRayBudget)
+{
+	m_MaxReflectionDepth = maxDepth;
+	m_SecondaryRayBudget = secondaryRayBudget;
+	m_NumAccumulatedFrames = 0;
+	m_History.isValid = false;
+}
+
+void Renderer::SetTemporalReuse(bool isEnabled, uint32_t refreshInterval)
+{
+	m_IsTemporalReuseEnabled = isEnabled;
+	//The ages are stored in a byte
+	m_RefreshInterval = std::min(std::max(refreshInterval, 1u), 255u);
+	m_History.isValid = false;
+	if (isEnabled && !m_pAges)
+	{
+		const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+		if (!m_pDepths)
+			m_pDepths = std::make_unique<float[]>(numPixels);
+		m_pAges = std::make_unique<uint8_t[]>(numPixels);
+		m_History.pColors = std::make_unique<ColorRGB[]>(numPixels);
+		m_History.pDepths = std::make_unique<float[]>(numPixels);
+		m_History.pObjectIds = std::make_unique<uint32_t[]>(numPixels);
+		m_History.pAges = std::make_unique<uint8_t[]>(numPixels);
+	}
+}
+
+void Renderer::SetDenoiser(bool isEnabled, uint32_t numIterations)
+{
+	m_IsDenoiserEnabled = isEnabled;
+	m_NumDenoiseIterations = std::max(numIterations, 1u);
+	if (isEnabled && !m_pDenoiseGuides)
+	{
+		const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+		if (!m_pDepths)
+			m_pDepths = std::make_unique<float[]>(numPixels);
+		m_pDenoiseGuides = std::make_unique<float[]>(numPixels * 6);
+		m_pDenoisePlanes[0] = std::make_unique<float[]>(numPixels * 3);
+		m_pDenoisePlanes[1] = std::make_unique<float[]>(numPixels * 3);
+		m_pDenoisedColors = std::make_unique<ColorRGB[]>(numPixels);
+	}
+}
+
+void Renderer::SetConvergence(float noiseThreshold, float timeLimit)
+{
+	m_NoiseThreshold = noiseThreshold;
+	m_TimeLimit = timeLimit;
+	m_NumAccumulatedFrames = 0;
+}
+
+uint32_t Renderer::GetNumTiles() const
+{
+	const uint32_t numTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	const uint32_t numTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+	return numTilesX * numTilesY;
+}
+
+void Renderer::GetTileRect(uint32_t tileIndex, int& x, int& y, int& width, int& height) const
+{
+	const int numTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	x = static_cast<int>(tileIndex) % numTilesX * m_TileSize;
+	y = static_cast<int>(tileIndex) / numTilesX * m_TileSize;
+	width = std::min(m_TileSize, m_Width - x);
+	height = std::min(m_TileSize, m_Height - y);
+}
+
+bool Renderer::IsTileConverged(const TileState& tile) const
+{
+	return m_NoiseThreshold > 0.f && tile.numSamples >= m_MinConvergenceSamples && tile.noise <= m_NoiseThreshold;
+}
+
+uint32_t Renderer::SelectTiles()
+{
+	const uint32_t numTiles = GetNumTiles();
+	m_RenderedTiles.clear();
+
+	//Every tile, the first frame of an accumulation starts them all over
+	if (!m_IsProgressiveEnabled || m_NumAccumulatedFrames <= 1)
+	{
+		for (uint32_t tileIndex{ 0 }; tileIndex < numTiles; ++tileIndex)
+			m_RenderedTiles.push_back(tileIndex);
+		if (m_IsProgressiveEnabled)
+			std::fill_n(m_pTileStates.get(), numTiles, TileState{});
+		return 1;
+	}
+
+	for (uint32_t tileIndex{ 0 }; tileIndex < numTiles; ++tileIndex)
+	{
+		if (!IsTileConverged(m_pTileStates[tileIndex]))
+			m_RenderedTiles.push_back(tileIndex);
+	}
+
+	//The samples the converged tiles don't take go to the others, so a frame keeps about the same cost
+	if (m_RenderedTiles.empty())
+		return 0;
+	return std::clamp(numTiles / static_cast<uint32_t>(m_RenderedTiles.size()), 1u, m_MaxSamplesPerFrame);
+}
+
+float Renderer::LuminanceSums::GetStandardError(uint32_t numSamples) const
 {
-	const int px = pixelIndex % m_Width;
-	const int py = pixelIndex / m_Width;
+	if (numSamples < 2)
+		return FLT_MAX;
 
-	float rx = px + 0.5f;
-	float ry = py + 0.5f;
+	const float n = static_cast<float>(numSamples);
+	const float mean = sum / n;
+	const float variance = std::max(squares / n - mean * mean, 0.f) * n / (n - 1.f);
+	return sqrtf(variance / n);
+}
 
-	float cx = ((2 * rx) / float(m_Width) - 1) * aspectRatio * fov;
-	float cy = (1 - (2 * ry) / float(m_Height)) * fov;
+Renderer::RenderFunctions Renderer::GetRenderFunctions() const
+{
+	switch (m_currentLightingMode)
+	{
+	case LightingMode::observationArea:
+		return m_ShadowsEnabled ? MakeRenderFunctions<LightingMode::observationArea, true>()
+			: MakeRenderFunctions<LightingMode::observationArea, false>();
+	case LightingMode::Radiance:
+		return m_ShadowsEnabled ? MakeRenderFunctions<LightingMode::Radiance, true>()
+			: MakeRenderFunctions<LightingMode::Radiance, false>();
+	case LightingMode::BRDF:
+		return m_ShadowsEnabled ? MakeRenderFunctions<LightingMode::BRDF, true>()
+			: MakeRenderFunctions<LightingMode::BRDF, false>();
+	default:
+		return m_ShadowsEnabled ? MakeRenderFunctions<LightingMode::Combined, true>()
+			: MakeRenderFunctions<LightingMode::Combined, false>();
+	}
+}
 
-	const Vector3 rayDirection = camera.cameraToWorld.TransformVector(Vector3(cx, cy, 1.f)).Normalized();
+template<Renderer::LightingMode lightingMode, bool areShadowsEnabled>
+void Renderer::RenderTile(const FrameContext& context, uint32_t tileIndex) const
+{
+	thread_local SampleScratch scratch{};
 
-	const Ray viewRay = Ray{ camera.origin, rayDirection };
+	int tileX{}, tileY{}, tileWidth{}, tileHeight{};
+	GetTileRect(tileIndex, tileX, tileY, tileWidth, tileHeight);
+	const uint32_t numTilePixels = static_cast<uint32_t>(tileWidth * tileHeight);
 
-	//TODO 6: rendering the scene
-	HitRecord closestHit{};
-	pScene->GetClosestHit(viewRay, closestHit);
+	//The first sample of a pixel goes through its center, the ones accumulated after that go through
+	//a different cell of a 4x4 grid over the pixel every time
+	const bool isAccumulating = context.numAccumulatedFrames > 0;
+	TileState& tile = m_pTileStates[tileIndex];
+	const uint32_t firstSample = isAccumulating ? tile.numSamples : 0;
+	scratch.Clear();
+	scratch.pHistory = context.pHistory;
+	for (uint32_t sampleIndex{ firstSample }; sampleIndex < firstSample + context.samplesPerPixel; ++sampleIndex)
+	{
+		for (int py{ tileY }; py < tileY + tileHeight; ++py)
+		{
+			for (int px{ tileX }; px < tileX + tileWidth; ++px)
+			{
+				if (sampleIndex == 0)
+				{
+					scratch.AddSample(px + 0.5f, py + 0.5f);
+					continue;
+				}
+
+				const uint32_t pixel = static_cast<uint32_t>(py * m_Width + px);
+				float x{}, y{};
+				Sampling::GetStratifiedSample((sampleIndex + Sampling::Hash(pixel)) % 16, 4,
+					Sampling::Hash(pixel, sampleIndex), x, y);
+				scratch.AddSample(px + x, py + y);
+			}
+		}
+	}
+
+	ShadeSamples<lightingMode, areShadowsEnabled>(context, scratch);
+
+	//Update Colors in Buffer, one tile row at a time
+	const uint32_t numSamples = firstSample + context.samplesPerPixel;
+	float tileNoise{};
+	for (int y{ 0 }; y < tileHeight; ++y)
+	{
+		const uint32_t rowBegin = static_cast<uint32_t>(y * tileWidth);
+		const size_t bufferIndex = static_cast<size_t>(tileY + y) * m_Width + tileX;
+		for (int x{ 0 }; x < tileWidth; ++x)
+		{
+			const size_t pixel = bufferIndex + x;
+			m_pObjectIds[pixel] = scratch.objectIds[rowBegin + x];
+			if (m_pDepths)
+				m_pDepths[pixel] = scratch.depths[rowBegin + x];
+			if (m_pAges)
+				m_pAges[pixel] = scratch.ages[rowBegin + x];
+			if (m_pDenoiseGuides)
+			{
+				const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+				const Vector3& normal = scratch.hitNormals[rowBegin + x];
+				const ColorRGB& albedo = scratch.albedos[rowBegin + x];
+				m_pDenoiseGuides[pixel] = normal.x;
+				m_pDenoiseGuides[numPixels + pixel] = normal.y;
+				m_pDenoiseGuides[2 * numPixels + pixel] = normal.z;
+				m_pDenoiseGuides[3 * numPixels + pixel] = albedo.r;
+				m_pDenoiseGuides[4 * numPixels + pixel] = albedo.g;
+				m_pDenoiseGuides[5 * numPixels + pixel] = albedo.b;
+			}
+			if (!isAccumulating)
+			{
+				if (scratch.isWritten[rowBegin + x])
+					m_pColorBuffer[pixel] = scratch.colors[rowBegin + x];
+				continue;
+			}
+
+			ColorRGB& sum = m_pAccumulationBuffer[pixel];
+			LuminanceSums& luminance = m_pLuminanceSums[pixel];
+			if (firstSample == 0)
+			{
+				sum = {};
+				luminance = {};
+			}
+
+			for (uint32_t sample{ rowBegin + x }; sample < scratch.colors.size(); sample += numTilePixels)
+			{
+				//Samples that keep what was in the buffer add that instead
+				const ColorRGB& color = scratch.isWritten[sample] ? scratch.colors[sample] : m_pColorBuffer[pixel];
+				sum += color;
+				const float sampleLuminance = GetLuminance(color);
+				luminance.sum += sampleLuminance;
+				luminance.squares += sampleLuminance * sampleLuminance;
+			}
+
+			//Through a copy, the non-const operator/ divides in place
+			ColorRGB average = sum;
+			m_pColorBuffer[pixel] = average /= static_cast<float>(numSamples);
+			scratch.colors[rowBegin + x] = m_pColorBuffer[pixel];
+			scratch.isWritten[rowBegin + x] = 1;
+			tileNoise = std::max(tileNoise, luminance.GetStandardError(numSamples));
+		}
+
+		g_Kernels.ResolvePixels(&scratch.colors[rowBegin], &scratch.isWritten[rowBegin], static_cast<uint32_t>(tileWidth),
+			m_PixelLayout, m_pBufferPixels + bufferIndex);
+	}
+
+	if (isAccumulating)
+		tile = { numSamples, tileNoise };
+}
+
+template<Renderer::LightingMode lightingMode, bool areShadowsEnabled>
+void Renderer::RenderEdgePixels(const FrameContext& context, uint32_t batchIndex) const
+{
+	thread_local SampleScratch scratch{};
 
+	const size_t first = static_cast<size_t>(batchIndex) * g_EdgePixelsPerBatch;
+	const size_t last = std::min(first + g_EdgePixelsPerBatch, m_EdgePixels.size());
+	constexpr uint32_t numStrata = m_EdgeGridSize * m_EdgeGridSize;
 
-	//ColorRGB finalColor{ rayDirection.x, rayDirection.y, rayDirection.z };
-	ColorRGB finalColor{};
-	if (closestHit.didHit)
+	//Stratified over the pixel, the jitter changes every frame
+	scratch.Clear();
+	for (size_t i{ first }; i < last; ++i)
 	{
-		if (materials[closestHit.materialIndex]->IsReflective())
+		const uint32_t pixel = m_EdgePixels[i].pixel;
+		const float px = static_cast<float>(pixel % m_Width);
+		const float py = static_cast<float>(pixel / m_Width);
+		for (uint32_t stratum{ 0 }; stratum < numStrata; ++stratum)
 		{
+			float x{}, y{};
+			Sampling::GetStratifiedSample(stratum, m_EdgeGridSize, Sampling::Hash(pixel, context.frameIndex), x, y);
+			scratch.AddSample(px + x, py + y);
+		}
+	}
+
+	ShadeSamples<lightingMode, areShadowsEnabled>(context, scratch);
+
+	//Averaged with the center sample of the tile pass
+	for (size_t i{ first }; i < last; ++i)
+	{
+		const uint32_t pixel = m_EdgePixels[i].pixel;
+		const uint32_t firstSample = static_cast<uint32_t>(i - first) * numStrata;
+
+		ColorRGB sum = m_pColorBuffer[pixel];
+		uint32_t numSamples{ 1 };
+		for (uint32_t sample{ firstSample }; sample < firstSample + numStrata; ++sample)
+		{
+			if (!scratch.isWritten[sample])
+				continue;
+			sum += scratch.colors[sample];
+			++numSamples;
+		}
+
+		const ColorRGB color = sum / static_cast<float>(numSamples);
+		m_pColorBuffer[pixel] = color;
+		//The first accumulated frame, counts as its sample
+		if (context.numAccumulatedFrames == 1)
+		{
+			m_pAccumulationBuffer[pixel] = color;
+			const float luminance = GetLuminance(color);
+			m_pLuminanceSums[pixel] = { luminance, luminance * luminance };
+		}
+
+		const uint8_t isWritten{ 1 };
+		g_Kernels.ResolvePixels(&color, &isWritten, 1, m_PixelLayout, m_pBufferPixels + pixel);
+	}
+}
+
+template<Renderer::LightingMode lightingMode, bool areShadowsEnabled>
+void Renderer::ShadeSamples(const FrameContext& context, SampleScratch& scratch) const
+{
+	const Camera& camera = *context.pCamera;
+	const std::vector<Light>& lights = *context.pLights;
+	const std::vector<Material>& materials = *context.pMaterials;
+	Scene* pScene = context.pScene;
+	const uint32_t numSamples = static_cast<uint32_t>(scratch.sampleX.size());
+
+	scratch.hits.clear();
+	scratch.colors.assign(numSamples, ColorRGB{});
+	scratch.isWritten.assign(numSamples, 1);
+	scratch.objectIds.assign(numSamples, g_NoObjectId);
+	scratch.depths.assign(numSamples, FLT_MAX);
+	scratch.ages.assign(numSamples, 0);
+	scratch.hitNormals.assign(numSamples, Vector3{});
+	scratch.albedos.assign(numSamples, ColorRGB{});
+
+	//Reflection rays come out of the frame's budget, reserved g_SecondaryRaysPerReservation at a time
+	uint32_t numReservedRays{};
+	uint32_t numRequestedRays{};
+	uint32_t numTracedRays{};
+	bool isBudgetExhausted{ false };
+	const auto acquireSecondaryRay = [&]()
+		{
+			if (context.secondaryRayBudget == 0)
+				return true;
+			if (numReservedRays == 0)
+			{
+				if (isBudgetExhausted)
+					return false;
+				const uint32_t numTaken = context.pSecondaryRays->numReserved.fetch_add(g_SecondaryRaysPerReservation);
+				if (numTaken >= context.secondaryRayBudget)
+				{
+					isBudgetExhausted = true;
+					context.pSecondaryRays->isBudgetExhausted = true;
+					return false;
+				}
+				numReservedRays = std::min(g_SecondaryRaysPerReservation, context.secondaryRayBudget - numTaken);
+			}
+			--numReservedRays;
+			return true;
+		};
+
+	//Phase 1: intersect every view ray
+	for (uint32_t sample{ 0 }; sample < numSamples; ++sample)
+	{
+		float rx = scratch.sampleX[sample];
+		float ry = scratch.sampleY[sample];
+
+		float cx = ((2 * rx) / float(m_Width) - 1) * context.aspectRatio * context.fov;
+		float cy = (1 - (2 * ry) / float(m_Height)) * context.fov;
+
+		const Vector3 rayDirection = camera.cameraToWorld.TransformVector(Vector3(cx, cy, 1.f)).Normalized();
+
+		const Ray viewRay = Ray{ camera.origin, rayDirection };
+
+		HitRecord closestHit{};
+		pScene->GetClosestHit(viewRay, closestHit);
+		if (!closestHit.didHit)
+			continue;
+
+		scratch.objectIds[sample] = closestHit.objectId;
+		scratch.depths[sample] = closestHit.t;
+		scratch.hitNormals[sample] = closestHit.normal;
+		scratch.albedos[sample] = materials[closestHit.materialIndex].GetAlbedo();
+
+		//Temporal reuse, the pixel the hit was in last frame must have seen the same object at the same distance.
+		//Mirrors depend on too much else to keep.
+		if (scratch.pHistory && !materials[closestHit.materialIndex].IsReflective())
+		{
+			const FrameHistory& history = *scratch.pHistory;
+			const uint32_t pixel = static_cast<uint32_t>(ry) * m_Width + static_cast<uint32_t>(rx);
+			const Vector3 previousPosition = history.worldToCamera.TransformPoint(closestHit.origin);
+			const float previousX = (previousPosition.x / (previousPosition.z * context.aspectRatio * history.fov) + 1.f) * 0.5f * m_Width;
+			const float previousY = (1.f - previousPosition.y / (previousPosition.z * history.fov)) * 0.5f * m_Height;
+			if (previousPosition.z > 0.f && previousX >= 0.f && previousX < m_Width && previousY >= 0.f && previousY < m_Height)
+			{
+				const size_t previousPixel = static_cast<size_t>(previousY) * m_Width + static_cast<size_t>(previousX);
+				const uint32_t age = history.pAges[previousPixel] + 1u;
+				//Staggered, so the pixels don't all shade again in the same frame
+				const bool isRefreshDue = age >= context.refreshInterval
+					|| (context.frameIndex + Sampling::Hash(pixel)) % context.refreshInterval == 0;
+				if (!isRefreshDue && history.pObjectIds[previousPixel] == closestHit.objectId
+					&& std::abs(history.pDepths[previousPixel] - previousPosition.Magnitude()) <= m_ReuseDepthTolerance * closestHit.t
+					&& pScene->GetObjectVersion(closestHit.objectId) <= history.sceneVersion)
+				{
+					scratch.colors[sample] = history.pColors[previousPixel];
+					scratch.ages[sample] = static_cast<uint8_t>(age);
+					continue;
+				}
+			}
+		}
+
+		//Follow the mirrors, without recursion. Paths that are absorbed or miss everything stay black,
+		//the ones stopped by the depth or the budget shade the mirror they ended on.
+		Ray ray{ viewRay };
+		ColorRGB throughput{ colors::White };
+		bool isAbsorbed{ false };
+		for (uint32_t depth{ 0 }; depth < context.maxReflectionDepth && materials[closestHit.materialIndex].IsReflective(); ++depth)
+		{
+			++numRequestedRays;
+			ColorRGB reflectedThroughput{ throughput };
+			reflectedThroughput *= materials[closestHit.materialIndex].GetReflectance();
+
+			//Survivors carry the energy of the absorbed paths
+			float survivalProbability{ context.budgetSurvivalProbability };
+			if (depth >= m_MinRouletteDepth)
+			{
+				const ColorRGB& t = reflectedThroughput;
+				survivalProbability *= std::min(std::max(t.r, std::max(t.g, t.b)), 1.f);
+			}
+			if (survivalProbability < 1.f)
+			{
+				const float u = Sampling::ToUnitFloat(Sampling::Hash(std::bit_cast<uint32_t>(scratch.sampleX[sample]),
+					std::bit_cast<uint32_t>(scratch.sampleY[sample]), Sampling::Hash(context.frameIndex, depth)));
+				if (u >= survivalProbability)
+				{
+					isAbsorbed = true;
+					break;
+				}
+				reflectedThroughput /= survivalProbability;
+			}
+
+			if (!acquireSecondaryRay())
+				break;
+			throughput = reflectedThroughput;
+
 			const float offset{ 0.0001f };
-			const Vector3 reflectDirection{ viewRay.direction - 2.0f * Vector3::Dot(closestHit.normal, viewRay.direction) * closestHit.normal };
-			
-			Ray reflectRay = Ray{ closestHit.origin + reflectDirection * offset,
-				 reflectDirection,
+			const Vector3 reflectDirection{ Vector3::Reflect(ray.direction, closestHit.normal) };
+			ray = Ray{ closestHit.origin + reflectDirection * offset,
+				reflectDirection,
 				0.00001f,
 				100000 };
-			pScene->GetClosestHit(reflectRay, closestHit);
-			if (!closestHit.didHit) return;
-			//return;
+			++numTracedRays;
+
+			closestHit = {};
+			pScene->GetClosestHit(ray, closestHit);
+			if (!closestHit.didHit)
+			{
+				scratch.depths[sample] = FLT_MAX;
+				scratch.hitNormals[sample] = Vector3{};
+				isAbsorbed = true;
+				break;
+			}
+
+			//The denoiser follows what the mirror shows, the depth becomes the length of the path
+			scratch.depths[sample] += closestHit.t;
+			scratch.hitNormals[sample] = closestHit.normal;
+			scratch.albedos[sample] = throughput;
+			scratch.albedos[sample] *= materials[closestHit.materialIndex].GetAlbedo();
 		}
-		
-		//finalColor = materials[closestHit.materialIndex]->Shade();
-		for (const Light& light : lights)
+		if (isAbsorbed)
+			continue;
+
+		scratch.hits.push_back({ closestHit.origin, closestHit.normal, -ray.direction, sample, closestHit.materialIndex, throughput });
+	}
+
+	//Return what wasn't used
+	if (numReservedRays > 0)
+		context.pSecondaryRays->numReserved.fetch_sub(numReservedRays);
+	if (numRequestedRays > 0)
+		context.pSecondaryRays->numRequested.fetch_add(numRequestedRays);
+	if (numTracedRays > 0)
+		context.pSecondaryRays->numTraced.fetch_add(numTracedRays);
+
+	//Phase 2: bucket the hits by material (counting sort)
+	scratch.materialOffsets.assign(materials.size() + 1, 0);
+	for (const ShadingHit& hit : scratch.hits)
+		++scratch.materialOffsets[hit.materialIndex + 1];
+	for (size_t i{ 1 }; i < scratch.materialOffsets.size(); ++i)
+		scratch.materialOffsets[i] += scratch.materialOffsets[i - 1];
+
+	scratch.sortedHits.resize(scratch.hits.size());
+	for (const ShadingHit& hit : scratch.hits)
+		scratch.sortedHits[scratch.materialOffsets[hit.materialIndex]++] = hit;
+
+	//Phase 3: shade every material bucket, the BRDFs run over all lit (hit, light) pairs of the bucket at once.
+	//With many lights each hit only shades context.numLightSamples lights from the light tree, weighted by 1 / (count * pdf).
+	constexpr bool needsBRDF = lightingMode == LightingMode::BRDF || lightingMode == LightingMode::Combined;
+	const LightTree& lightTree = *context.pLightTree;
+	const LightGrid& lightGrid = m_LightGrid;
+	size_t bucketBegin{ 0 };
+	for (size_t materialIndex{ 0 }; materialIndex < materials.size(); ++materialIndex)
+	{
+		//The offsets now point at the end of each bucket
+		const size_t bucketEnd = scratch.materialOffsets[materialIndex];
+		if (bucketBegin == bucketEnd)
+			continue;
+
+		const Material& material = materials[materialIndex];
+		scratch.litHits.clear();
+		scratch.normals.clear();
+		scratch.lightDirections.clear();
+		scratch.viewDirections.clear();
+		scratch.cosines.clear();
+		scratch.radiances.clear();
+
+		for (size_t i{ bucketBegin }; i < bucketEnd; ++i)
 		{
-			Vector3 lightDirection{ dae::LightUtils::GetDirectionToLight(light, closestHit.origin) };
-			const float lightDistance = lightDirection.Normalize();
+			const ShadingHit& hit = scratch.sortedHits[i];
+			//Adds a light that reaches the hit, lightPoint is only used by point and area lights
+			const auto addLight = [&](const Light& light, const Vector3& lightPoint, const Vector3& lightDirection, float cosine, float weight)
+				{
+					if constexpr (lightingMode == LightingMode::observationArea)
+					{
+						const float observedArea = cosine * weight;
+						scratch.colors[hit.sample] += ColorRGB(observedArea, observedArea, observedArea);
+					}
+					else if constexpr (lightingMode == LightingMode::Radiance)
+					{
+						scratch.colors[hit.sample] += LightUtils::GetRadiance(light, hit.origin, lightPoint) * weight;
+					}
+					else
+					{
+						scratch.litHits.push_back(static_cast<uint32_t>(i));
+						scratch.normals.push_back(hit.normal);
+						scratch.lightDirections.push_back(lightDirection);
+						scratch.viewDirections.push_back(hit.viewDirection);
+						scratch.cosines.push_back(cosine);
+						if constexpr (lightingMode == LightingMode::BRDF)
+							scratch.radiances.push_back(ColorRGB(weight, weight, weight));
+						else
+							scratch.radiances.push_back(LightUtils::GetRadiance(light, hit.origin, lightPoint) * weight);
+					}
+				};
 
-			const float offset{ 0.0001f };
-			Ray lightRay = Ray{ closestHit.origin + closestHit.normal * offset,
-				lightDirection,
-				0.00001f,
-				lightDistance };
+			//context.areaLightGridSize^2 points on the light, their shadow rays are traced together
+			const auto shadeAreaLight = [&](int lightIndex, const Light& light, float weight)
+				{
+					const uint32_t numSamples = context.areaLightGridSize * context.areaLightGridSize;
+					const float sampleX = scratch.sampleX[hit.sample];
+					const float sampleY = scratch.sampleY[hit.sample];
+					const uint32_t seed = Sampling::Hash(std::bit_cast<uint32_t>(sampleX), std::bit_cast<uint32_t>(sampleY),
+						Sampling::Hash(context.frameIndex, static_cast<uint32_t>(lightIndex)));
+					//Blue noise: every light gets its own rotation on top of the one of the pixel
+					float rotationX{}, rotationY{};
+					if (context.areaLightSampling == AreaLightSampling::BlueNoise)
+					{
+						Sampling::GetR2Sample(static_cast<uint32_t>(lightIndex), rotationX, rotationY);
+						rotationX += Sampling::GetInterleavedGradientNoise(std::floor(sampleX), std::floor(sampleY));
+						rotationY += Sampling::GetInterleavedGradientNoise(std::floor(sampleY), std::floor(sampleX));
+					}
+
+					scratch.areaLightSamples.clear();
+					for (uint32_t sample{ 0 }; sample < numSamples; ++sample)
+					{
+						float u{}, v{};
+						if (context.areaLightSampling == AreaLightSampling::BlueNoise)
+						{
+							Sampling::GetR2Sample(context.frameIndex * numSamples + sample, u, v);
+							u += rotationX;
+							v += rotationY;
+							u = std::min(u - std::floor(u), 0.99999994f);
+							v = std::min(v - std::floor(v), 0.99999994f);
+						}
+						else
+						{
+							Sampling::GetStratifiedSample(sample, context.areaLightGridSize, seed, u, v);
+						}
+
+						const Vector3 point = LightUtils::GetAreaLightPoint(light, hit.origin, u, v);
+						Vector3 direction{ point - hit.origin };
+						const float distance = direction.Normalize();
+						const float cosine{ Vector3::Dot(hit.normal, direction) };
+						if constexpr (lightingMode != LightingMode::Radiance)
+						{
+							if (cosine < 0) continue;
+						}
 
-			if (m_ShadowsEnabled && pScene->DoesHit(lightRay)) continue;
+						scratch.areaLightSamples.push_back({ point, direction, cosine });
+						if constexpr (areShadowsEnabled)
+						{
+							const float offset{ 0.0001f };
+							scratch.shadowRays.push_back(Ray{ hit.origin + hit.normal * offset, direction, 0.00001f, distance });
+						}
+					}
+
+					const size_t numFacingSamples = scratch.areaLightSamples.size();
+					scratch.isOccluded.assign(numFacingSamples, 0);
+					if constexpr (areShadowsEnabled)
+					{
+						pScene->DoesHit(scratch.shadowRays.data(), static_cast<uint32_t>(numFacingSamples), scratch.isOccluded.data());
+						scratch.shadowRays.clear();
+					}
+
+					const float sampleWeight = weight / static_cast<float>(numSamples);
+					for (size_t sample{ 0 }; sample < numFacingSamples; ++sample)
+					{
+						if (scratch.isOccluded[sample])
+							continue;
+						const auto& areaLightSample = scratch.areaLightSamples[sample];
+						addLight(light, areaLightSample.point, areaLightSample.direction, areaLightSample.cosine, sampleWeight);
+					}
+				};
+
+			const auto shadeLight = [&](int lightIndex, float weight)
+				{
+					const Light& light = lights[lightIndex];
+					Vector3 lightDirection{ dae::LightUtils::GetDirectionToLight(light, hit.origin) };
+					//Too far away to be visible, no shadow ray needed
+					if (light.type != LightType::Directional && lightDirection.SqrMagnitude() > lightGrid.GetInfluenceRadiusSquared(lightIndex))
+						return;
+					if (light.IsAreaLight())
+					{
+						shadeAreaLight(lightIndex, light, weight);
+						return;
+					}
+					const float lightDistance = lightDirection.Normalize();
 
-			float lambertCosineObserverdArea{ Vector3::Dot(closestHit.normal, lightDirection) };
+					//Facing away from the light, also before the shadow ray (Radiance doesn't use the cosine)
+					const float lambertCosineObserverdArea{ Vector3::Dot(hit.normal, lightDirection) };
+					if constexpr (lightingMode != LightingMode::Radiance)
+					{
+						if (lambertCosineObserverdArea < 0) return;
+					}
 
+					if constexpr (areShadowsEnabled)
+					{
+						const float offset{ 0.0001f };
+						Ray lightRay = Ray{ hit.origin + hit.normal * offset,
+							lightDirection,
+							0.00001f,
+							lightDistance };
 
-			switch (m_currentLightingMode)
+						if (pScene->DoesHit(lightRay)) return;
+					}
+
+					addLight(light, light.origin, lightDirection, lambertCosineObserverdArea, weight);
+				};
+
+			//Only the lights whose influence sphere overlaps the grid cell of the hit
+			if (context.numLightSamples == 0)
 			{
-			case dae::Renderer::LightingMode::observationArea:
-				if (lambertCosineObserverdArea < 0) continue;
-				finalColor += ColorRGB(lambertCosineObserverdArea, lambertCosineObserverdArea, lambertCosineObserverdArea);
-				break;
-			case dae::Renderer::LightingMode::Radiance:
-				finalColor += LightUtils::GetRadiance(light, closestHit.origin);
-				break;
-			case dae::Renderer::LightingMode::BRDF:
-				if (lambertCosineObserverdArea < 0) continue;
-				finalColor += materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, -rayDirection);
-				break;
-			case dae::Renderer::LightingMode::Combined:
-				if (lambertCosineObserverdArea < 0) continue;
-				finalColor += LightUtils::GetRadiance(light, closestHit.origin)
-					* materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, -rayDirection)
-					* lambertCosineObserverdArea;
-				break;
-			default:
-				//for debugging
-				finalColor += ColorRGB(rayDirection.x, rayDirection.y, rayDirection.z);
-				break;
+				for (int lightIndex : lightGrid.GetLights(hit.origin))
+					shadeLight(lightIndex, 1.f);
+				continue;
+			}
+
+			//Directional lights are not in the tree, there are only ever a few
+			for (int lightIndex : lightTree.GetDirectionalLights())
+				shadeLight(lightIndex, 1.f);
+
+			const uint32_t seed = Sampling::Hash(std::bit_cast<uint32_t>(scratch.sampleX[hit.sample]),
+				std::bit_cast<uint32_t>(scratch.sampleY[hit.sample]), context.frameIndex);
+			//Only the shading that uses the cosine can skip the lights behind the hit
+			const Vector3 normal = lightingMode == LightingMode::Radiance ? Vector3::Zero : hit.normal;
+			for (uint32_t lightSample{ 0 }; lightSample < context.numLightSamples; ++lightSample)
+			{
+				float pdf{};
+				const int lightIndex = lightTree.Sample(hit.origin, normal, Sampling::ToUnitFloat(Sampling::Hash(seed, lightSample)), pdf);
+				//The walk can end in a subtree that turned out to be behind the hit, that sample adds nothing
+				if (lightIndex < 0)
+					continue;
+				shadeLight(lightIndex, 1.f / (static_cast<float>(context.numLightSamples) * pdf));
 			}
 		}
+
+		if (!needsBRDF || scratch.litHits.empty())
+		{
+			bucketBegin = bucketEnd;
+			continue;
+		}
+
+		scratch.shaded.resize(scratch.litHits.size());
+		material.ShadeBatch(scratch.litHits.size(), scratch.normals.data(), scratch.lightDirections.data(),
+			scratch.viewDirections.data(), scratch.shaded.data());
+
+		for (size_t j{ 0 }; j < scratch.litHits.size(); ++j)
+		{
+			const ShadingHit& hit = scratch.sortedHits[scratch.litHits[j]];
+			if constexpr (lightingMode == LightingMode::BRDF)
+				scratch.colors[hit.sample] += scratch.shaded[j] * scratch.radiances[j];
+			else
+				scratch.colors[hit.sample] += scratch.radiances[j] * scratch.shaded[j] * scratch.cosines[j];
+		}
+
+		bucketBegin = bucketEnd;
 	}
-	
-	//Update Color in Buffer
-	finalColor.MaxToOne();
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	//Phase 4: what the mirrors on the way let through
+	for (const ShadingHit& hit : scratch.hits)
+		scratch.colors[hit.sample] *= hit.throughput;
 }
 
-bool Renderer::SaveBufferToImage() const
+void Renderer::FindEdgePixels()
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	//Largest luminance difference with the right and bottom neighbour, marked on both pixels. Different objects always count.
+	const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+	m_Contrasts.assign(numPixels, 0.f);
+	for (int y{ 0 }; y < m_Height; ++y)
+	{
+		for (int x{ 0 }; x < m_Width; ++x)
+		{
+			const size_t pixel = static_cast<size_t>(y) * m_Width + x;
+			const float luminance = GetLuminance(m_pColorBuffer[pixel]);
+
+			const auto compare = [&](size_t neighbour)
+				{
+					const float contrast = m_pObjectIds[pixel] != m_pObjectIds[neighbour] ? 1.f
+						: std::abs(luminance - GetLuminance(m_pColorBuffer[neighbour]));
+					m_Contrasts[pixel] = std::max(m_Contrasts[pixel], contrast);
+					m_Contrasts[neighbour] = std::max(m_Contrasts[neighbour], contrast);
+				};
+			if (x + 1 < m_Width)
+				compare(pixel + 1);
+			if (y + 1 < m_Height)
+				compare(pixel + m_Width);
+		}
+	}
+
+	m_EdgePixels.clear();
+	for (size_t pixel{ 0 }; pixel < numPixels; ++pixel)
+	{
+		if (m_Contrasts[pixel] > m_EdgeContrastThreshold)
+			m_EdgePixels.push_back({ static_cast<uint32_t>(pixel), m_Contrasts[pixel] });
+	}
+
+	//Over budget: only the strongest edges
+	const size_t maxEdgePixels = m_AdaptiveSampleBudget / (m_EdgeGridSize * m_EdgeGridSize);
+	if (m_EdgePixels.size() > maxEdgePixels)
+	{
+		std::nth_element(m_EdgePixels.begin(), m_EdgePixels.begin() + maxEdgePixels, m_EdgePixels.end(),
+			[](const EdgePixel& a, const EdgePixel& b) { return a.contrast > b.contrast; });
+		m_EdgePixels.resize(maxEdgePixels);
+		//Back in scanline order, so the samples of a batch stay close together
+		std::sort(m_EdgePixels.begin(), m_EdgePixels.end(),
+			[](const EdgePixel& a, const EdgePixel& b) { return a.pixel < b.pixel; });
+	}
+}
+
+void Renderer::Denoise()
+{
+	const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+	const auto getPlanes = [numPixels](float* pPlanes, float* (&planes)[3])
+		{
+			for (size_t i{ 0 }; i < 3; ++i)
+				planes[i] = pPlanes + i * numPixels;
+		};
+
+	DenoiseInput input{};
+	for (size_t i{ 0 }; i < 3; ++i)
+	{
+		input.pNormals[i] = m_pDenoiseGuides.get() + i * numPixels;
+		input.pAlbedos[i] = m_pDenoiseGuides.get() + (3 + i) * numPixels;
+	}
+	input.pDepths = m_pDepths.get();
+	input.width = static_cast<uint32_t>(m_Width);
+	input.height = static_cast<uint32_t>(m_Height);
+	input.depthSigma = m_DenoiseDepthSigma;
+	input.albedoSigma = m_DenoiseAlbedoSigma;
+
+	//Every pass reads the whole output of the last one, so the passes can't overlap
+	float* pInputPlanes[3]{};
+	float* pOutputPlanes[3]{};
+	getPlanes(m_pDenoisePlanes[0].get(), pInputPlanes);
+	const std::vector<uint8_t> isWritten(static_cast<size_t>(m_TileSize), 1);
+	for (uint32_t iteration{ 0 }; iteration < m_NumDenoiseIterations; ++iteration)
+	{
+		getPlanes(m_pDenoisePlanes[(iteration + 1) % 2].get(), pOutputPlanes);
+		const bool isLastPass = iteration + 1 == m_NumDenoiseIterations;
+		std::copy_n(pInputPlanes, 3, input.pColors);
+		input.step = 1u << iteration;
+		input.colorSigma = m_DenoiseColorSigma / static_cast<float>(input.step);
+
+		const auto denoiseTile = [&, this](uint32_t tileIndex)
+			{
+				int tileX{}, tileY{}, tileWidth{}, tileHeight{};
+				GetTileRect(tileIndex, tileX, tileY, tileWidth, tileHeight);
+				for (int y{ tileY }; y < tileY + tileHeight; ++y)
+				{
+					const size_t bufferIndex = static_cast<size_t>(y) * m_Width + tileX;
+					g_Kernels.DenoiseRow(input, static_cast<uint32_t>(tileX), static_cast<uint32_t>(y), static_cast<uint32_t>(tileWidth),
+						pOutputPlanes);
+					if (!isLastPass)
+						continue;
+
+					for (size_t pixel{ bufferIndex }; pixel < bufferIndex + tileWidth; ++pixel)
+						m_pDenoisedColors[pixel] = ColorRGB{ pOutputPlanes[0][pixel], pOutputPlanes[1][pixel], pOutputPlanes[2][pixel] };
+					g_Kernels.ResolvePixels(&m_pDenoisedColors[bufferIndex], isWritten.data(), static_cast<uint32_t>(tileWidth),
+						m_PixelLayout, m_pBufferPixels + bufferIndex);
+				}
+			};
+
+		//The first pass reads the frame as planes
+		if (iteration == 0)
+		{
+			for (size_t pixel{ 0 }; pixel < numPixels; ++pixel)
+			{
+				pInputPlanes[0][pixel] = m_pColorBuffer[pixel].r;
+				pInputPlanes[1][pixel] = m_pColorBuffer[pixel].g;
+				pInputPlanes[2][pixel] = m_pColorBuffer[pixel].b;
+			}
+		}
+#if defined(PARALLEL_FOR)
+		concurrency::parallel_for(0u, GetNumTiles(), denoiseTile);
+#else
+		for (uint32_t i{ 0 }; i < GetNumTiles(); ++i)
+		{
+			denoiseTile(i);
+		}
+#endif
+		std::swap(pInputPlanes, pOutputPlanes);
+	}
+}
+
+void Renderer::CaptureFrame(Image& image, bool includeFloatColors) const
+{
+	const size_t numPixels = static_cast<size_t>(m_Width) * m_Height;
+	image.width = static_cast<uint32_t>(m_Width);
+	image.height = static_cast<uint32_t>(m_Height);
+	image.rgb.resize(numPixels * 3);
+
+	for (size_t i{ 0 }; i < numPixels; ++i)
+	{
+		SDL_GetRGB(m_pBufferPixels[i], m_pBuffer->format, &image.rgb[i * 3], &image.rgb[i * 3 + 1], &image.rgb[i * 3 + 2]);
+	}
+
+	if (!includeFloatColors)
+	{
+		image.rgbFloat.clear();
+		return;
+	}
+
+	//What is shown
+	const ColorRGB* pColors = m_IsFrameDenoised ? m_pDenoisedColors.get() : m_pColorBuffer.get();
+	image.rgbFloat.resize(numPixels * 3);
+	for (size_t i{ 0 }; i < numPixels; ++i)
+	{
+		image.rgbFloat[i * 3] = pColors[i].r;
+		image.rgbFloat[i * 3 + 1] = pColors[i].g;
+		image.rgbFloat[i * 3 + 2] = pColors[i].b;
+	}
+}
+
+MemoryUsage Renderer::GetMemoryUsage() const
+{
+	MemoryUsage usage{};
+	usage.frameBuffers = static_cast<size_t>(m_pBuffer->pitch) * m_pBuffer->h;
+	usage.frameBuffers += static_cast<size_t>(m_Width) * m_Height * (sizeof(ColorRGB) + sizeof(uint32_t));
+	usage.frameBuffers += m_Contrasts.capacity() * sizeof(float) + m_EdgePixels.capacity() * sizeof(EdgePixel);
+	if (m_pAccumulationBuffer)
+		usage.frameBuffers += static_cast<size_t>(m_Width) * m_Height * (sizeof(ColorRGB) + sizeof(LuminanceSums));
+	if (m_pDepths)
+		usage.frameBuffers += static_cast<size_t>(m_Width) * m_Height * sizeof(float);
+	if (m_pAges)
+		usage.frameBuffers += static_cast<size_t>(m_Width) * m_Height
+			* (sizeof(float) + 2 * sizeof(uint8_t) + sizeof(ColorRGB) + sizeof(uint32_t)); //history included
+	if (m_pDenoiseGuides)
+		usage.frameBuffers += static_cast<size_t>(m_Width) * m_Height * (12 * sizeof(float) + sizeof(ColorRGB));
+	usage.frameBuffers += GetNumTiles() * sizeof(TileState) + m_RenderedTiles.capacity() * sizeof(uint32_t);
+	usage.lights += m_LightGrid.GetMemoryUsage();
+	return usage;
 }
 
 void Renderer::KeyboardInputs(const SDL_Event& e)
@@ -203,6 +1233,24 @@ void Renderer::KeyboardInputs(const SDL_Event& e)
 	case SDL_SCANCODE_F3:
 		m_currentLightingMode = static_cast<LightingMode>((int(m_currentLightingMode) + 1) % 4);
 		break;
+	case SDL_SCANCODE_F4:
+		m_IsAdaptiveAAEnabled = !m_IsAdaptiveAAEnabled;
+		break;
+	case SDL_SCANCODE_F5:
+		SetProgressive(!m_IsProgressiveEnabled);
+		return;
+	case SDL_SCANCODE_F7:
+		SetDenoiser(!m_IsDenoiserEnabled, m_NumDenoiseIterations);
+		return;
+	case SDL_SCANCODE_F8:
+		SetTemporalReuse(!m_IsTemporalReuseEnabled, m_RefreshInterval);
+		return;
+	default:
+		return;
 	}
+
+	//Every toggle changes the image, the accumulated frames and the history no longer match it
+	m_NumAccumulatedFrames = 0;
+	m_History.isValid = false;
 }
 
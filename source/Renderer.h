@@ -1,18 +1,53 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "ColorRGB.h"
+#include "Kernels.h"
+#include "LightGrid.h"
+#include "Matrix.h"
+#include "MemoryTracker.h"
+
 struct SDL_Window;
 struct SDL_Surface;
+union SDL_Event;
 
 namespace dae
 {
+	//What the last Render did
+	struct RenderStats
+	{
+		uint32_t numPrimarySamples{}; //one per pixel
+		uint32_t numEdgePixels{}; //that got extra samples from the adaptive anti-aliasing
+		uint32_t numExtraSamples{};
+		uint32_t numAccumulatedFrames{}; //progressive mode, 0 when it is off
+		uint32_t numRenderedTiles{}; //that took samples, converged tiles are skipped
+		uint32_t samplesPerPixel{}; //in the rendered tiles
+		uint32_t numConvergedTiles{};
+		bool isConverged{}; //progressive mode is done: every tile converged or the time limit was reached
+		uint32_t numSecondaryRays{}; //reflection rays
+		bool isRayBudgetExhausted{}; //some reflections were cut short
+		uint32_t numReusedPixels{}; //temporal reuse, not shaded again
+		float denoiseTime{}; //milliseconds, not part of the shading
+	};
+
+	//Where the samples on an area light come from
+	enum class AreaLightSampling
+	{
+		Stratified, //jittered grid, new jitter every frame
+		BlueNoise //R2 sequence continued every frame, rotated per pixel by interleaved gradient noise
+	};
+
 	class Timer;
 	class Scene;
 	class Camera;
 	class Light;
+	class LightTree;
 	class Material;
+	struct Image;
 
 	class Renderer final
 	{
@@ -25,11 +60,71 @@ namespace dae
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera,
-			const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
-		bool SaveBufferToImage() const;
+		void Render(Scene* pScene);
+		/**
+		 * \brief Adaptive anti-aliasing: after the regular pass, pixels on object edges or with a high contrast to a neighbour
+		 * get extra stratified samples
+		 * \param sampleBudget maximum number of extra samples per frame, the strongest edges go first
+		 */
+		void SetAdaptiveAA(bool isEnabled, uint32_t sampleBudget);
+		/**
+		 * \brief Progressive accumulation: while the camera and the scene don't change, every frame adds one jittered sample
+		 * per pixel to a running average instead of tracing the same image again
+		 */
+		void SetProgressive(bool isEnabled);
+		/**
+		 * \brief When progressive rendering is done: tiles whose noise dropped below the threshold stop taking samples
+		 * and the noisy tiles get theirs, until every tile converged or the time limit is reached
+		 * \param noiseThreshold largest standard error of a pixel's mean luminance in a converged tile, 0 never converges
+		 * \param timeLimit seconds of rendering since the accumulation started, 0 for none
+		 */
+		void SetConvergence(float noiseThreshold, float timeLimit);
+		/**
+		 * \brief Many-light shading: when a scene has more point lights than this, every shading point only shades (and
+		 * traces shadow rays to) this many, picked from the scene's LightTree by their estimated contribution
+		 * \param numLightSamples point lights per shading point, 0 always shades every light
+		 */
+		void SetLightSampling(uint32_t numLightSamples);
+		/**
+		 * \brief Point lights are ignored where their radiance is below the threshold (no shading, no shadow ray),
+		 * which gives every light an influence radius. A LightGrid over those radii is built every frame.
+		 * \param radianceThreshold brightest channel, 0 lets every light reach everywhere
+		 */
+		void SetLightCutoff(float radianceThreshold);
+		/**
+		 * \brief Soft shadows: every shading point traces this many shadow rays (as one batch) to each area light it shades
+		 * \param numSamples rounded up to a square, so the stratified samples form a grid
+		 */
+		void SetAreaLightSampling(uint32_t numSamples, AreaLightSampling sampling);
+		/**
+		 * \brief Reflections are followed up to maxDepth mirrors deep, from m_MinRouletteDepth on a path survives with a
+		 * probability of its remaining throughput (Russian roulette). When the last frame wanted more rays than the
+		 * budget, every reflection also only survives with the budget's share of them, which spreads the cut evenly
+		 * (as noise) over the image. Paths that stop at the depth limit, or at the hard limit of the budget, shade the mirror itself.
+		 * \param secondaryRayBudget reflection rays per frame over all pixels, 0 for no limit
+		 */
+		void SetReflections(uint32_t maxDepth, uint32_t secondaryRayBudget);
+		/**
+		 * \brief Temporal reuse: a view ray hit is reprojected into the previous frame and takes the color shaded there
+		 * when it is the same object at the same depth, the object didn't move and no light changed. Mirrors are always
+		 * shaded. Not while accumulating, the accumulation already reuses everything.
+		 * \param refreshInterval every pixel is shaded again at least this often (in frames), staggered over the pixels.
+		 * Shadows cast by moving objects and highlights that follow the camera lag behind by up to this many frames.
+		 */
+		void SetTemporalReuse(bool isEnabled, uint32_t refreshInterval);
+		/**
+		 * \brief Edge-aware a-trous wavelet denoiser run over the finished frame: every pass blurs with taps twice as far apart
+		 * as the last one, weighted by how alike the luminance, normal, depth and albedo of the view ray hits are.
+		 * Only what is shown is denoised, accumulation, edge detection and temporal reuse keep working on the noisy colors.
+		 * \param numIterations passes, the filter reaches 2^(numIterations + 1) pixels
+		 */
+		void SetDenoiser(bool isEnabled, uint32_t numIterations);
+		const RenderStats& GetStats() const { return m_Stats; }
+		//Copies the last rendered frame for the ImageWriter, the unclamped colors are only copied when requested (PFM)
+		void CaptureFrame(Image& image, bool includeFloatColors = false) const;
+		MemoryUsage GetMemoryUsage() const;
 		
+		//F2 shadows, F3 lighting mode, F4 adaptive AA, F5 progressive, F7 denoiser, F8 temporal reuse (F6 is the benchmark in main)
 		void KeyboardInputs(const SDL_Event& e);
 
 	private:
@@ -37,9 +132,16 @@ namespace dae
 
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
+		//Final colors before clamping, for HDR output
+		std::unique_ptr<ColorRGB[]> m_pColorBuffer{};
+		//Object hit by the view ray of each pixel, for the edge detection
+		std::unique_ptr<uint32_t[]> m_pObjectIds{};
+		PixelLayout m_PixelLayout{};
 
 		int m_Width{};
 		int m_Height{};
+
+		static constexpr int m_TileSize{ 16 };
 		
 		enum class LightingMode
 		{
@@ -51,5 +153,168 @@ namespace dae
 
 		LightingMode m_currentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+		uint32_t m_NumLightSamples{ 4 };
+		float m_LightCutoff{ 0.001f };
+		LightGrid m_LightGrid{};
+		uint32_t m_AreaLightGridSize{ 2 }; //samples per area light: m_AreaLightGridSize^2
+		AreaLightSampling m_AreaLightSampling{ AreaLightSampling::Stratified };
+
+		//Reflections
+		uint32_t m_MaxReflectionDepth{ 4 };
+		uint32_t m_SecondaryRayBudget{ 640 * 480 };
+		float m_SecondaryRayDemand{}; //reflection rays the last frame would have traced without the budget
+		static constexpr uint32_t m_MinRouletteDepth{ 2 };
+
+		//Temporal reuse
+		bool m_IsTemporalReuseEnabled{ false };
+		uint32_t m_RefreshInterval{ 8 };
+		static constexpr float m_ReuseDepthTolerance{ 0.01f }; //relative
+		std::unique_ptr<float[]> m_pDepths{}; //length of each pixel's view ray path, to its first hit unless that is a mirror
+		std::unique_ptr<uint8_t[]> m_pAges{}; //frames since the color of each pixel was shaded
+		//The previous frame, read by the tiles while they write the current one
+		struct FrameHistory
+		{
+			std::unique_ptr<ColorRGB[]> pColors{};
+			std::unique_ptr<float[]> pDepths{};
+			std::unique_ptr<uint32_t[]> pObjectIds{};
+			std::unique_ptr<uint8_t[]> pAges{};
+			Matrix worldToCamera{};
+			float fov{};
+			uint32_t sceneVersion{};
+			bool isValid{ false };
+		};
+		FrameHistory m_History{};
+
+		//Denoiser, m_pDepths is shared with the temporal reuse
+		bool m_IsDenoiserEnabled{ false };
+		uint32_t m_NumDenoiseIterations{ 4 };
+		static constexpr float m_DenoiseColorSigma{ 0.5f }; //luminance, halved every pass
+		static constexpr float m_DenoiseDepthSigma{ 0.02f }; //relative, per pixel
+		static constexpr float m_DenoiseAlbedoSigma{ 0.1f };
+		//Planes (one float per pixel) for the kernel
+		std::unique_ptr<float[]> m_pDenoiseGuides{}; //normal x, y, z and albedo r, g, b of the view ray hit of each pixel
+		std::unique_ptr<float[]> m_pDenoisePlanes[2]{}; //r, g, b, the passes alternate between them
+		std::unique_ptr<ColorRGB[]> m_pDenoisedColors{}; //what is shown
+		bool m_IsFrameDenoised{ false };
+
+		//Adaptive anti-aliasing
+		bool m_IsAdaptiveAAEnabled{ false };
+		uint32_t m_AdaptiveSampleBudget{ 640 * 480 / 4 };
+		static constexpr uint32_t m_EdgeGridSize{ 2 }; //extra samples per edge pixel: m_EdgeGridSize^2 strata
+		static constexpr float m_EdgeContrastThreshold{ 0.1f }; //luminance
+
+		struct EdgePixel
+		{
+			uint32_t pixel{};
+			float contrast{}; //1 between different objects
+		};
+		std::vector<float> m_Contrasts{};
+		std::vector<EdgePixel> m_EdgePixels{};
+
+		//Progressive accumulation
+		bool m_IsProgressiveEnabled{ false };
+		std::unique_ptr<ColorRGB[]> m_pAccumulationBuffer{}; //sum of the samples since the last reset
+		uint32_t m_NumAccumulatedFrames{}; //0 restarts the accumulation
+		//What the accumulated frames saw
+		Vector3 m_AccumulatedCameraOrigin{};
+		float m_AccumulatedFovAngle{};
+		uint32_t m_AccumulatedSceneVersion{};
+
+		//Convergence of the accumulation
+		struct LuminanceSums
+		{
+			float sum{};
+			float squares{};
+
+			//Of the mean luminance, FLT_MAX for less than 2 samples
+			float GetStandardError(uint32_t numSamples) const;
+		};
+		std::unique_ptr<LuminanceSums[]> m_pLuminanceSums{}; //per pixel, for the variance
+		struct TileState
+		{
+			uint32_t numSamples{}; //per pixel since the accumulation started
+			float noise{}; //largest standard error of the mean luminance of its pixels
+		};
+		std::unique_ptr<TileState[]> m_pTileStates{};
+		std::vector<uint32_t> m_RenderedTiles{}; //this frame
+		float m_NoiseThreshold{ 0.f };
+		float m_TimeLimit{ 0.f };
+		float m_AccumulatedTime{}; //seconds
+		bool m_IsConverged{ false };
+		static constexpr uint32_t m_MinConvergenceSamples{ 8 }; //the variance of fewer samples is too unreliable
+		static constexpr uint32_t m_MaxSamplesPerFrame{ 16 }; //per pixel, when only a few tiles are left
+
+		uint32_t m_FrameIndex{};
+		RenderStats m_Stats{};
+
+		//Reflection rays of a frame, shared by its tiles
+		struct SecondaryRayCounters
+		{
+			std::atomic<uint32_t> numReserved{}; //can overshoot the budget
+			std::atomic<uint32_t> numRequested{}; //paths that reached a mirror
+			std::atomic<uint32_t> numTraced{};
+			std::atomic<bool> isBudgetExhausted{};
+		};
+
+		//Everything the tiles of a frame share
+		struct FrameContext
+		{
+			Scene* pScene{};
+			const Camera* pCamera{};
+			const std::vector<Light>* pLights{};
+			const std::vector<Material>* pMaterials{};
+			const LightTree* pLightTree{};
+			uint32_t numLightSamples{}; //per shading point, 0 shades every light
+			uint32_t areaLightGridSize{ 1 };
+			AreaLightSampling areaLightSampling{};
+			uint32_t maxReflectionDepth{};
+			uint32_t secondaryRayBudget{}; //0 for no limit
+			float budgetSurvivalProbability{ 1.f }; //of every reflection, budget / last frame's demand
+			SecondaryRayCounters* pSecondaryRays{};
+			const FrameHistory* pHistory{}; //nullptr when nothing can be reused
+			uint32_t refreshInterval{};
+			float fov{};
+			float aspectRatio{};
+			uint32_t frameIndex{}; //seeds the sample jitter
+			uint32_t numAccumulatedFrames{}; //including this one, 0 when not accumulating
+			uint32_t samplesPerPixel{ 1 }; //of every rendered tile, more than 1 only when accumulating
+		};
+		struct SampleScratch;
+
+		using RenderBatchFunction = void (Renderer::*)(const FrameContext& context, uint32_t index) const;
+		struct RenderFunctions
+		{
+			RenderBatchFunction renderTile{};
+			RenderBatchFunction renderEdgePixels{};
+		};
+
+		//Traces context.samplesPerPixel samples per pixel of the tile
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		void RenderTile(const FrameContext& context, uint32_t tileIndex) const;
+		//Traces the extra samples of a batch of m_EdgePixels and averages them in
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		void RenderEdgePixels(const FrameContext& context, uint32_t batchIndex) const;
+		//Intersects all view rays of the scratch samples first, then shades the hits bucketed by material
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		void ShadeSamples(const FrameContext& context, SampleScratch& scratch) const;
+
+		template<LightingMode lightingMode, bool areShadowsEnabled>
+		static RenderFunctions MakeRenderFunctions()
+		{
+			return { &Renderer::RenderTile<lightingMode, areShadowsEnabled>, &Renderer::RenderEdgePixels<lightingMode, areShadowsEnabled> };
+		}
+		//The instantiations for the current lighting mode and shadow toggle, picked once per frame
+		RenderFunctions GetRenderFunctions() const;
+
+		uint32_t GetNumTiles() const;
+		//Position and size of a tile in pixels, the tiles on the right and bottom edge can be smaller
+		void GetTileRect(uint32_t tileIndex, int& x, int& y, int& width, int& height) const;
+		bool IsTileConverged(const TileState& tile) const;
+		//Fills m_RenderedTiles with the tiles that still need samples, returns how many each pixel of them gets
+		uint32_t SelectTiles();
+		//Fills m_EdgePixels from the colors and object ids of the regular pass, within m_AdaptiveSampleBudget
+		void FindEdgePixels();
+		//Filters m_pColorBuffer tile by tile, every pass in parallel, and shows the result
+		void Denoise();
 	};
 }
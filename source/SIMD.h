@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <emmintrin.h> //SSE2, always available on x64
+
+#include "Vector3.h"
+#include "Matrix.h"
+
+namespace dae
+{
+	//Four Vector3's in SoA layout, one SSE lane each
+	struct Vector3x4
+	{
+		__m128 x{};
+		__m128 y{};
+		__m128 z{};
+
+		//Reads p[0..3] with three unaligned loads and transposes them, p must be 4 tightly packed Vector3's
+		static Vector3x4 LoadPacked(const Vector3* p)
+		{
+			const float* pFloats = &p->x;
+			const __m128 a = _mm_loadu_ps(pFloats); //x0 y0 z0 x1
+			const __m128 b = _mm_loadu_ps(pFloats + 4); //y1 z1 x2 y2
+			const __m128 c = _mm_loadu_ps(pFloats + 8); //z2 x3 y3 z3
+
+			const __m128 x21 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+			const __m128 y01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+			const __m128 y23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+			const __m128 z01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+			return {
+				_mm_shuffle_ps(a, x21, _MM_SHUFFLE(2, 0, 3, 0)),
+				_mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_ps(z01, c, _MM_SHUFFLE(3, 0, 2, 0)) };
+		}
+
+		//Inverse of LoadPacked, writes p[0..3]
+		void StorePacked(Vector3* p) const
+		{
+			const __m128 a0 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+			const __m128 a1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+			const __m128 b0 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+			const __m128 b1 = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+			const __m128 c0 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+			const __m128 c1 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+
+			float* pFloats = &p->x;
+			_mm_storeu_ps(pFloats, _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(pFloats + 4, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(pFloats + 8, _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+	};
+	static_assert(sizeof(Vector3) == 3 * sizeof(float), "LoadPacked/StorePacked expect tightly packed Vector3's");
+
+	//Batch versions of Matrix::TransformPoint, Matrix::TransformVector + Normalized and Vector3::Dot. They go through the
+	//kernel table (Kernels.h, defined in Kernels.cpp), so they run on the widest CPUPath that was selected.
+
+	//pOut[i] = transform.TransformPoint(pIn[i]), pIn and pOut must not overlap
+	void TransformPoints(const Matrix& transform, const Vector3* pIn, Vector3* pOut, size_t count);
+	//pOut[i] = normalTransform.TransformVector(pIn[i]).Normalized(), normalTransform should be the inverse-transpose
+	void TransformNormals(const Matrix& normalTransform, const Vector3* pIn, Vector3* pOut, size_t count);
+	//pOut[i] = Vector3::Dot(pA[i], pB[i])
+	void DotBatch(const Vector3* pA, const Vector3* pB, float* pOut, size_t count);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+#include "MathHelpers.h"
+
+namespace dae
+{
+	//Stateless random numbers for sample positions, the same inputs always give the same sample so frames are reproducible
+	namespace Sampling
+	{
+		//PCG output permutation, a good 32-bit hash
+		constexpr uint32_t Hash(uint32_t value)
+		{
+			const uint32_t state = value * 747796405u + 2891336453u;
+			const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+			return (word >> 22u) ^ word;
+		}
+
+		constexpr uint32_t Hash(uint32_t a, uint32_t b)
+		{
+			return Hash(a ^ Hash(b));
+		}
+
+		constexpr uint32_t Hash(uint32_t a, uint32_t b, uint32_t c)
+		{
+			return Hash(a ^ Hash(b ^ Hash(c)));
+		}
+
+		//[0, 1) from the upper 24 bits
+		constexpr float ToUnitFloat(uint32_t bits)
+		{
+			return static_cast<float>(bits >> 8) * (1.f / 16777216.f);
+		}
+
+		/**
+		 * \brief Jittered position inside cell 'stratum' of a gridSize x gridSize grid over [0, 1)^2
+		 * \param seed different seeds give different jitter within the cells
+		 */
+		constexpr void GetStratifiedSample(uint32_t stratum, uint32_t gridSize, uint32_t seed, float& x, float& y)
+		{
+			const float cellSize = 1.f / static_cast<float>(gridSize);
+			x = (static_cast<float>(stratum % gridSize) + ToUnitFloat(Hash(seed, stratum, 0u))) * cellSize;
+			y = (static_cast<float>(stratum / gridSize) + ToUnitFloat(Hash(seed, stratum, 1u))) * cellSize;
+		}
+
+		//Point 'index' of the R2 low-discrepancy sequence (Roberts), every prefix covers [0, 1)^2 evenly
+		inline void GetR2Sample(uint32_t index, float& x, float& y)
+		{
+			//1 / g and 1 / g^2, g the plastic number
+			constexpr double alphaX{ 0.7548776662466927 };
+			constexpr double alphaY{ 0.5698402909980532 };
+			x = static_cast<float>(std::fmod(0.5 + alphaX * index, 1.0));
+			y = static_cast<float>(std::fmod(0.5 + alphaY * index, 1.0));
+		}
+
+		//Interleaved gradient noise (Jimenez) of a pixel in [0, 1), neighbouring pixels get very different values (blue noise-like)
+		inline float GetInterleavedGradientNoise(float pixelX, float pixelY)
+		{
+			const float value = 52.9829189f * std::fmod(0.06711056f * pixelX + 0.00583715f * pixelY, 1.f);
+			return value - std::floor(value);
+		}
+
+		//Maps [0, 1)^2 on the unit disk keeping the relative areas (Shirley-Chiu), so stratified samples stay stratified
+		inline void ToConcentricDisk(float x, float y, float& diskX, float& diskY)
+		{
+			const float a = 2.f * x - 1.f;
+			const float b = 2.f * y - 1.f;
+			if (a == 0.f && b == 0.f)
+			{
+				diskX = diskY = 0.f;
+				return;
+			}
+
+			float radius{}, angle{};
+			if (std::abs(a) > std::abs(b))
+			{
+				radius = a;
+				angle = PI_DIV_4 * (b / a);
+			}
+			else
+			{
+				radius = b;
+				angle = PI_DIV_2 - PI_DIV_4 * (a / b);
+			}
+			diskX = radius * std::cos(angle);
+			diskY = radius * std::sin(angle);
+		}
+	}
+}
@@ -1,5 +1,11 @@
 #include "Scene.h"
 #include "Utils.h"
+#include "MeshCache.h"
+#include "MeshAssetCache.h"
+
+#include <algorithm>
+#include <iostream>
+#include <ppl.h> //parallel_for
 #include "Material.h"
 
 namespace dae {
@@ -7,24 +13,16 @@ namespace dae {
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
 	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+		m_Materials({ Material::CreateSolidColor({1,0,0}) })
 	{
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_MeshInstances.reserve(32);
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
-	{
-		for(auto& pMaterial : m_Materials)
-		{
-			delete pMaterial;
-			pMaterial = nullptr;
-		}
-
-		m_Materials.clear();
-	}
+	Scene::~Scene() = default;
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
@@ -33,20 +31,33 @@ namespace dae {
 		//HitRecord closestHit = 
 		Ray closestRay{ ray };
 
-		for (const Sphere& sphere : GetSphereGeometries())
+		//Objects are numbered in the order they are tested: spheres, planes, triangles, meshes, instances, paged meshes
+		uint32_t objectId{ 0 };
+
+		const std::vector<Sphere>& spheres = GetSphereGeometries();
+		float sphereT{};
+		const int sphereIndex = g_Kernels.IntersectSpheres(closestRay, spheres.data(), static_cast<uint32_t>(spheres.size()), false, sphereT);
+		if (sphereIndex >= 0)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, closestRay, closestHit))
-			{
-				closestRay.max = closestHit.t;
-			}
+			const Sphere& sphere = spheres[sphereIndex];
+			closestHit.didHit = true;
+			closestHit.materialIndex = sphere.materialIndex;
+			closestHit.objectId = static_cast<uint32_t>(sphereIndex);
+			closestHit.t = sphereT;
+			closestHit.origin = ray.origin + sphereT * ray.direction;
+			closestHit.normal = Vector3(sphere.origin, closestHit.origin).Normalized();
+			closestRay.max = sphereT;
 		}
+		objectId += static_cast<uint32_t>(spheres.size());
 
 		for (const Plane& plane : GetPlaneGeometries())
 		{
 			if (GeometryUtils::HitTest_Plane(plane, closestRay, closestHit))
 			{
 				closestRay.max = closestHit.t;
+				closestHit.objectId = objectId;
 			}
+			++objectId;
 		}
 
 		for (const Triangle& triangle : GetTriangleGeometries())
@@ -54,7 +65,9 @@ namespace dae {
 			if (GeometryUtils::HitTest_Triangle(triangle, closestRay, closestHit))
 			{
 				closestRay.max = closestHit.t;
+				closestHit.objectId = objectId;
 			}
+			++objectId;
 		}
 
 		for (const TriangleMesh& triangleMesh : GetTriangleMeshGeometries())
@@ -62,7 +75,29 @@ namespace dae {
 			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, closestRay, closestHit))
 			{
 				closestRay.max = closestHit.t;
+				closestHit.objectId = objectId;
+			}
+			++objectId;
+		}
+
+		for (const MeshInstance& instance : GetMeshInstances())
+		{
+			if (GeometryUtils::HitTest_MeshInstance(instance, closestRay, closestHit))
+			{
+				closestRay.max = closestHit.t;
+				closestHit.objectId = objectId;
+			}
+			++objectId;
+		}
+
+		for (const auto& pPagedMesh : m_PageCache.GetMeshes())
+		{
+			if (GeometryUtils::HitTest_PagedMesh(*pPagedMesh, closestRay, closestHit))
+			{
+				closestRay.max = closestHit.t;
+				closestHit.objectId = objectId;
 			}
+			++objectId;
 		}
 	}
 
@@ -72,12 +107,10 @@ namespace dae {
 		/*assert(false && "No Implemented Yet!");
 		return false;*/
 
-		for (const Sphere& sphere : GetSphereGeometries())
+		float sphereT{};
+		if (g_Kernels.IntersectSpheres(ray, GetSphereGeometries().data(), static_cast<uint32_t>(GetSphereGeometries().size()), true, sphereT) >= 0)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
-			{
-				return true;
-			}
+			return true;
 		}
 
 		/*for (const Plane& plane : GetPlaneGeometries())
@@ -104,9 +137,113 @@ namespace dae {
 			}
 		}
 
+		for (const MeshInstance& instance : GetMeshInstances())
+		{
+			if (GeometryUtils::HitTest_MeshInstance(instance, ray))
+			{
+				return true;
+			}
+		}
+
+		for (const auto& pPagedMesh : m_PageCache.GetMeshes())
+		{
+			if (GeometryUtils::HitTest_PagedMesh(*pPagedMesh, ray))
+			{
+				return true;
+			}
+		}
+
 		return false;
 	}
 
+	void Scene::DoesHit(const Ray* pRays, uint32_t numRays, uint8_t* pIsOccluded) const
+	{
+		uint32_t numUnoccluded{ numRays };
+		//Tests the rays that are still unoccluded, stops early once all of them are
+		const auto testRays = [&](const auto& doesHit)
+			{
+				for (uint32_t i{ 0 }; i < numRays && numUnoccluded > 0; ++i)
+				{
+					if (!pIsOccluded[i] && doesHit(pRays[i]))
+					{
+						pIsOccluded[i] = 1;
+						--numUnoccluded;
+					}
+				}
+				return numUnoccluded == 0;
+			};
+
+		const std::vector<Sphere>& spheres = GetSphereGeometries();
+		std::fill(pIsOccluded, pIsOccluded + numRays, uint8_t{ 0 });
+		if (testRays([&](const Ray& ray)
+			{
+				float sphereT{};
+				return g_Kernels.IntersectSpheres(ray, spheres.data(), static_cast<uint32_t>(spheres.size()), true, sphereT) >= 0;
+			}))
+			return;
+
+		for (const Triangle& triangle : GetTriangleGeometries())
+		{
+			if (testRays([&](const Ray& ray) { return GeometryUtils::HitTest_Triangle(triangle, ray); }))
+				return;
+		}
+
+		for (const TriangleMesh& triangleMesh : GetTriangleMeshGeometries())
+		{
+			if (testRays([&](const Ray& ray) { return GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray); }))
+				return;
+		}
+
+		for (const MeshInstance& instance : GetMeshInstances())
+		{
+			if (testRays([&](const Ray& ray) { return GeometryUtils::HitTest_MeshInstance(instance, ray); }))
+				return;
+		}
+
+		for (const auto& pPagedMesh : m_PageCache.GetMeshes())
+		{
+			if (testRays([&](const Ray& ray) { return GeometryUtils::HitTest_PagedMesh(*pPagedMesh, ray); }))
+				return;
+		}
+	}
+
+	MemoryUsage Scene::GetMemoryUsage() const
+	{
+		MemoryUsage usage{};
+
+		usage.geometry += m_SphereGeometries.capacity() * sizeof(Sphere);
+		usage.geometry += m_PlaneGeometries.capacity() * sizeof(Plane);
+		usage.geometry += m_Triangles.capacity() * sizeof(Triangle);
+		//Unused slots of the mesh vector are counted as well, the used ones report their own size
+		usage.geometry += (m_TriangleMeshGeometries.capacity() - m_TriangleMeshGeometries.size()) * sizeof(TriangleMesh);
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			usage.geometry += mesh.GetMemoryUsage();
+		}
+
+		//Shared mesh data is only counted once, no matter how many instances use it
+		usage.geometry += m_MeshInstances.capacity() * sizeof(MeshInstance);
+		std::vector<const void*> countedData{};
+		for (const MeshInstance& instance : m_MeshInstances)
+		{
+			const void* pData = instance.pData ? static_cast<const void*>(instance.pData.get()) : instance.pCompactData.get();
+			if (pData && std::find(countedData.begin(), countedData.end(), pData) == countedData.end())
+			{
+				countedData.push_back(pData);
+				usage.geometry += instance.pData ? instance.pData->GetMemoryUsage() : instance.pCompactData->GetMemoryUsage();
+			}
+		}
+
+		//Cluster tables and resident pages
+		usage.geometry += m_PageCache.GetMemoryUsage();
+
+		usage.lights += m_Lights.capacity() * sizeof(Light) + m_LightTree.GetMemoryUsage();
+
+		usage.materials += m_Materials.capacity() * sizeof(Material);
+
+		return usage;
+	}
+
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
@@ -140,6 +277,135 @@ namespace dae {
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddTriangleMeshAsync(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex,
+		const Vector3& placeholderMinAABB, const Vector3& placeholderMaxAABB)
+	{
+		TriangleMesh* pMesh = AddTriangleMesh(cullMode, materialIndex);
+		pMesh->minAABB = placeholderMinAABB;
+		pMesh->maxAABB = placeholderMaxAABB;
+
+		PendingMesh pending{};
+		pending.meshIndex = m_TriangleMeshGeometries.size() - 1;
+		pending.filename = filename;
+		pending.result = Utils::LoadMeshAsync(filename);
+		m_PendingMeshes.emplace_back(std::move(pending));
+
+		return pMesh;
+	}
+
+	MeshInstance* Scene::AddMeshInstance(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex,
+		MeshStorage storage)
+	{
+		if (storage == MeshStorage::Compact)
+		{
+			std::shared_ptr<const CompactMeshData> pCompactData = MeshAssetCache::GetInstance().LoadCompact(filename);
+			if (pCompactData)
+				return AddMeshInstance(std::move(pCompactData), cullMode, materialIndex);
+		}
+		else
+		{
+			std::shared_ptr<const MeshData> pData = MeshAssetCache::GetInstance().Load(filename);
+			if (pData)
+				return AddMeshInstance(std::move(pData), cullMode, materialIndex);
+		}
+
+		std::cout << "[Scene] Could not load " << filename << std::endl;
+		return nullptr;
+	}
+
+	MeshInstance* Scene::AddMeshInstance(std::shared_ptr<const MeshData> pData, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		m_MeshInstances.emplace_back(std::move(pData), cullMode, materialIndex);
+		return &m_MeshInstances.back();
+	}
+
+	MeshInstance* Scene::AddMeshInstance(std::shared_ptr<const CompactMeshData> pCompactData, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		m_MeshInstances.emplace_back(std::move(pCompactData), cullMode, materialIndex);
+		return &m_MeshInstances.back();
+	}
+
+	PagedMesh* Scene::AddPagedMesh(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex,
+		uint32_t trianglesPerCluster)
+	{
+		auto pMesh = std::make_unique<PagedMesh>(cullMode, materialIndex);
+		if (!pMesh->Open(filename, trianglesPerCluster))
+		{
+			std::cout << "[Scene] Could not load " << filename << std::endl;
+			return nullptr;
+		}
+
+		return m_PageCache.Add(std::move(pMesh));
+	}
+
+	void Scene::UpdateMeshTransforms()
+	{
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (mesh.isTransformDirty)
+				MarkObjectChanged(GetObjectId(mesh));
+		}
+
+		//Unchanged meshes return right away, the rest are independent so each one can go to its own thread
+		concurrency::parallel_for(size_t{ 0 }, m_TriangleMeshGeometries.size(), [this](size_t i)
+			{
+				m_TriangleMeshGeometries[i].UpdateTransforms();
+			});
+	}
+
+	uint32_t Scene::GetObjectId(const TriangleMesh& mesh) const
+	{
+		return static_cast<uint32_t>(m_SphereGeometries.size() + m_PlaneGeometries.size() + m_Triangles.size()
+			+ (&mesh - m_TriangleMeshGeometries.data()));
+	}
+
+	uint32_t Scene::GetObjectId(const MeshInstance& instance) const
+	{
+		return static_cast<uint32_t>(m_SphereGeometries.size() + m_PlaneGeometries.size() + m_Triangles.size()
+			+ m_TriangleMeshGeometries.size() + (&instance - m_MeshInstances.data()));
+	}
+
+	uint32_t Scene::GetObjectId(const PagedMesh& mesh) const
+	{
+		const auto& pMeshes = m_PageCache.GetMeshes();
+		const auto it = std::find_if(pMeshes.begin(), pMeshes.end(), [&mesh](const auto& pMesh) { return pMesh.get() == &mesh; });
+		return static_cast<uint32_t>(m_SphereGeometries.size() + m_PlaneGeometries.size() + m_Triangles.size()
+			+ m_TriangleMeshGeometries.size() + m_MeshInstances.size() + (it - pMeshes.begin()));
+	}
+
+	void Scene::UpdatePendingMeshes()
+	{
+		for (size_t i = 0; i < m_PendingMeshes.size();)
+		{
+			PendingMesh& pending = m_PendingMeshes[i];
+			if (pending.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++i;
+				continue;
+			}
+
+			MeshLoadResult result = pending.result.get();
+			if (result.succeeded)
+			{
+				TriangleMesh& mesh = m_TriangleMeshGeometries[pending.meshIndex];
+				mesh.positions = std::move(result.mesh.positions);
+				mesh.normals = std::move(result.mesh.normals);
+				mesh.indices = std::move(result.mesh.indices);
+				mesh.minAABB = result.mesh.minAABB;
+				mesh.maxAABB = result.mesh.maxAABB;
+				mesh.isTransformDirty = true;
+				mesh.UpdateTransforms();
+				MarkChanged();
+			}
+			else
+			{
+				std::cout << "[Scene] Could not load " << pending.filename << std::endl;
+			}
+
+			m_PendingMeshes.erase(m_PendingMeshes.begin() + i);
+		}
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -149,6 +415,7 @@ namespace dae {
 		l.type = LightType::Point;
 
 		m_Lights.emplace_back(l);
+		m_IsLightTreeDirty = true;
 		return &m_Lights.back();
 	}
 
@@ -161,12 +428,43 @@ namespace dae {
 		l.type = LightType::Directional;
 
 		m_Lights.emplace_back(l);
+		m_IsLightTreeDirty = true;
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	Light* Scene::AddRectLight(const Vector3& center, const Vector3& edgeU, const Vector3& edgeV, float intensity, const ColorRGB& color)
 	{
-		m_Materials.push_back(pMaterial);
+		Light l;
+		l.origin = center;
+		l.direction = Vector3::Cross(edgeU, edgeV).Normalized();
+		l.edgeU = edgeU;
+		l.edgeV = edgeV;
+		l.intensity = intensity;
+		l.color = color;
+		l.type = LightType::Rect;
+
+		m_Lights.emplace_back(l);
+		m_IsLightTreeDirty = true;
+		return &m_Lights.back();
+	}
+
+	Light* Scene::AddSphereLight(const Vector3& center, float radius, float intensity, const ColorRGB& color)
+	{
+		Light l;
+		l.origin = center;
+		l.radius = radius;
+		l.intensity = intensity;
+		l.color = color;
+		l.type = LightType::Sphere;
+
+		m_Lights.emplace_back(l);
+		m_IsLightTreeDirty = true;
+		return &m_Lights.back();
+	}
+
+	unsigned char Scene::AddMaterial(const Material& material)
+	{
+		m_Materials.push_back(material);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 #pragma endregion
@@ -177,11 +475,11 @@ namespace dae {
 	{
 				//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::CreateSolidColor(colors::Blue));
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::CreateSolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::CreateSolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::CreateSolidColor(colors::Magenta));
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -203,11 +501,11 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 		//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::CreateSolidColor(colors::Blue));
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::CreateSolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::CreateSolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::CreateSolidColor(colors::Magenta));
 
 		//Plane
 		AddPlane({ -5.f,0.f,0.f }, { 1., 0.f, 0.f }, matId_Solid_Green);
@@ -235,9 +533,9 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 
 		//default: Material id0 >> SolidColor Material (RED)
-		const unsigned char matLambert_Red = AddMaterial(new Material_Lambert{ colors::Red, 1.f });
-		const unsigned char matLambertPhong_Blue = AddMaterial(new Material_LambertPhong{ colors::Blue, 1.f, 1.f, 60.f });
-		const unsigned char matLambert_Yellow = AddMaterial(new Material_Lambert{ colors::Yellow, 1.f });
+		const unsigned char matLambert_Red = AddMaterial(Material::CreateLambert(colors::Red, 1.f));
+		const unsigned char matLambertPhong_Blue = AddMaterial(Material::CreateLambertPhong(colors::Blue, 1.f, 1.f, 60.f));
+		const unsigned char matLambert_Yellow = AddMaterial(Material::CreateLambert(colors::Yellow, 1.f));
 
 		//Plane
 		AddPlane({ 0.f,0.f,0.f }, { 0.f, 1.f, 0.f }, matLambert_Yellow);
@@ -257,9 +555,9 @@ namespace dae {
 	//	m_Camera.fovAngle = 45.f;
 
 	//	//default: Material id0 >> SolidColor Material (RED)
-	//	const unsigned char matLambert_Red = AddMaterial(new Material_Lambert{ colors::Red, 1 });
-	//	const unsigned char matLambert_Blue = AddMaterial(new Material_Lambert{ colors::Blue, 1 });
-	//	const unsigned char matLambert_Yellow = AddMaterial(new Material_Lambert{ colors::Yellow, 1 });
+	//	const unsigned char matLambert_Red = AddMaterial(Material::CreateLambert(colors::Red, 1));
+	//	const unsigned char matLambert_Blue = AddMaterial(Material::CreateLambert(colors::Blue, 1));
+	//	const unsigned char matLambert_Yellow = AddMaterial(Material::CreateLambert(colors::Yellow, 1));
 
 	//	//Plane
 	//	AddPlane({ 0.f,0.f,0.f }, { 0.f, 1.f, 0.f }, matLambert_Yellow);
@@ -280,14 +578,14 @@ namespace dae {
 		m_Camera.origin = { 0.f, 3.0f, -9.0f };
 		m_Camera.fovAngle = 45.0f;
 		//default: Materials 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 1.0f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 1.0f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.1f));
-
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CreateCookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 1.0f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CreateCookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CreateCookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CreateCookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 1.0f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CreateCookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CreateCookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.1f));
+
+		const auto matLambert_GrayBlue = AddMaterial(Material::CreateLambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
 		//Plane
 		AddPlane({ 0.0f,0.0f,10.0f }, { 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue); //BLACK
 		AddPlane({ 0.0f, 0.0f,0.0f }, { 0.0f, 1.0f, 0.0f }, matLambert_GrayBlue); //BOTTOM
@@ -296,9 +594,9 @@ namespace dae {
 		AddPlane({ -5.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, matLambert_GrayBlue); //LEFT
 
 		//TMP phong test spheres
-		/*const auto matLamertPhong1 = AddMaterial(new Material_LambertPhong(colors::Blue, .5f, .5f, 3.f));
-		const auto matLamertPhong2 = AddMaterial(new Material_LambertPhong(colors::Blue, .5f, .5f, 15.f));
-		const auto matLamertPhong3 = AddMaterial(new Material_LambertPhong(colors::Blue, .5f, .5f, 50.f));
+		/*const auto matLamertPhong1 = AddMaterial(Material::CreateLambertPhong(colors::Blue, .5f, .5f, 3.f));
+		const auto matLamertPhong2 = AddMaterial(Material::CreateLambertPhong(colors::Blue, .5f, .5f, 15.f));
+		const auto matLamertPhong3 = AddMaterial(Material::CreateLambertPhong(colors::Blue, .5f, .5f, 50.f));
 		AddSphere({ -1.75f,1.0f,0.0f }, .75f, matLamertPhong1);
 		AddSphere({ 0.0f,1.0f,0.0f }, .75f, matLamertPhong2);
 		AddSphere({ 1.75f,1.0f,0.0f }, .75f, matLamertPhong3);*/
@@ -329,8 +627,8 @@ namespace dae {
 
 		m_Camera.fovAngle = 45.0f;
 		//default: Materials 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::CreateLambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::CreateLambert(colors::White, 1.f));
 
 
 		
@@ -364,18 +662,16 @@ namespace dae {
 		//pMesh->UpdateTransforms();
 
 		//CUBE
-		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj",
-			pMesh->positions, 
-			pMesh->normals, 
-			pMesh->indices);
-		
-		pMesh->Scale({ 2.f, 2.f, 2.f });
-		//pMesh->Translate({ .0f, 1.f, 0.f });
+		//Skipped (AddMeshInstance logs it) when the OBJ can't be loaded
+		m_pBunny = AddMeshInstance("Resources/lowpoly_bunny2.obj", TriangleCullMode::BackFaceCulling, matLambert_White);
+		if (m_pBunny)
+		{
+			m_pBunny->Scale({ 2.f, 2.f, 2.f });
+			//m_pBunny->Translate({ .0f, 1.f, 0.f });
 
-		//No need to calc normals, they are calculated in ParseOBJ
-		pMesh->UpdateAABB();
-		pMesh->UpdateTransforms();
+			//No need to calc normals or bounds, they come from the shared asset
+			m_pBunny->UpdateTransforms();
+		}
 		
 		//Light
 		AddPointLight({ 0.0f,5.0f,5.0f }, 50.0f, ColorRGB{ 1.0f, 0.61f, 0.45f }); //BACKLIGHT
@@ -386,8 +682,11 @@ namespace dae {
 	{
 		Scene::Update(pTimer);
 
-		pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
-		pMesh->UpdateTransforms();
+		if (!m_pBunny)
+			return;
+
+		m_pBunny->RotateY(PI_DIV_2 * pTimer->GetTotal());
+		UpdateMeshTransforms(*m_pBunny);
 	}
 #pragma endregion
 
@@ -398,15 +697,15 @@ namespace dae {
 		m_Camera.origin = { 0.f, 3.0f, -9.0f };
 		m_Camera.fovAngle = 45.0f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({.972f, .960f, .915f}, 1.f, 1.f ));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 0.6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CreateCookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CreateCookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, 0.6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::CreateLambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::CreateLambert(colors::White, 1.f));
 
 		//Plane
 		AddPlane({ 0.0f,0.0f,10.0f }, { 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue); //BLACK
@@ -460,8 +759,8 @@ namespace dae {
 		for (const auto m : m_Meshes)
 		{
 			m->RotateY(yawAngle);
-			m->UpdateTransforms();
 		}
+		UpdateMeshTransforms();
 	}
 #pragma endregion
 
@@ -473,8 +772,8 @@ namespace dae {
 		m_Camera.fovAngle = 45.0f;
 
 		//default: Materials 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::CreateLambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::CreateLambert(colors::White, 1.f));
 
 		//Plane
 		AddPlane({ 0.0f,0.0f,10.0f }, { 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue); //BLACK
@@ -483,18 +782,30 @@ namespace dae {
 		AddPlane({ 5.0f, 0.0f,0.0f }, { -1.0f, 0.0f,  0.0f }, matLambert_GrayBlue); //RIGHT
 		AddPlane({ -5.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, matLambert_GrayBlue); //LEFT
 
-		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj",
-			pMesh->positions,
-			pMesh->normals,
-			pMesh->indices);
+		if (m_IsPaged)
+		{
+			//Small pages, so even the low poly bunny is spread over a few clusters that load as they are hit
+			m_pPagedBunny = AddPagedMesh("Resources/lowpoly_bunny2.obj", TriangleCullMode::BackFaceCulling, matLambert_White, 32);
+			if (m_pPagedBunny)
+			{
+				m_pPagedBunny->Scale({ 2.f, 2.f, 2.f });
+				m_pPagedBunny->UpdateTransforms();
+			}
+		}
 
-		pMesh->Scale({ 2.f, 2.f, 2.f });
+		//Also the fallback when the page file couldn't be opened or built
+		if (!m_pPagedBunny)
+		{
+			//Skipped (AddMeshInstance logs it) when the OBJ can't be loaded
+			m_pBunny = AddMeshInstance("Resources/lowpoly_bunny2.obj", TriangleCullMode::BackFaceCulling, matLambert_White, m_Storage);
+			if (m_pBunny)
+			{
+				m_pBunny->Scale({ 2.f, 2.f, 2.f });
 
-		//No need to calc normals, they are calculated in ParseOBJ
-		
-		pMesh->UpdateAABB();
-		pMesh->UpdateTransforms();
+				//No need to calc normals or bounds, they come from the shared asset
+				m_pBunny->UpdateTransforms();
+			}
+		}
 
 		//Light
 		AddPointLight({ 0.0f,5.0f,5.0f }, 50.0f, ColorRGB{ 1.0f, 0.61f, 0.45f }); //BACKLIGHT
@@ -506,8 +817,16 @@ namespace dae {
 		Scene::Update(pTimer);
 
 		const auto yawAngle = (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2;
-		pMesh->RotateY(yawAngle);
-		pMesh->UpdateTransforms();
+		if (m_pPagedBunny)
+		{
+			m_pPagedBunny->RotateY(yawAngle);
+			UpdateMeshTransforms(*m_pPagedBunny);
+		}
+		else if (m_pBunny)
+		{
+			m_pBunny->RotateY(yawAngle);
+			UpdateMeshTransforms(*m_pBunny);
+		}
 	}
 #pragma endregion
 
@@ -519,17 +838,17 @@ namespace dae {
 		m_Camera.fovAngle = 45.0f;
 
 		//default: Materials 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material::CreateLambert({ 0.49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material::CreateLambert(colors::White, 1.f));
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 0.6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material::CreateCookTorrence({ .972f, .960f, .915f }, 1.f, 1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material::CreateCookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material::CreateCookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, 0.6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material::CreateCookTorrence({ .75f, .75f, .75f }, .0f, .1f));
 
-		const auto matCT_Mirror = AddMaterial(new Material_Mirror({ .75f, .75f, .75f }, .0f, 1.f));
+		const auto matCT_Mirror = AddMaterial(Material::CreateMirror({ .75f, .75f, .75f }, .0f, 1.f));
 
 		////Plane
 		//AddPlane({ 0.0f,0.0f,10.0f }, { 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue); //BLACK
@@ -539,10 +858,10 @@ namespace dae {
 		//AddPlane({ -5.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, matLambert_GrayBlue); //LEFT
 
 
-		const auto matCT_BlueRoughPlastic = AddMaterial(new Material_CookTorrence({ 67 / 255.f, 60 / 255.f, 149 / 255.f }, .0f, 1.f));
-		const auto matCT_GroundRoughPlastic = AddMaterial(new Material_CookTorrence({ 165/ 255.f, 183 / 255.f, 215 / 255.f }, .0f, 1.f));
-		const auto matCT_TealRoughPlastic = AddMaterial(new Material_CookTorrence({ 146 / 255.f, 253 / 255.f, 253 / 255.f }, .0f, 1.f));
-		const auto matCT_YellowRoughPlastic = AddMaterial(new Material_CookTorrence({ 255 / 255.f, 255 / 255.f, 27 / 255.f }, .0f, 1.f));
+		const auto matCT_BlueRoughPlastic = AddMaterial(Material::CreateCookTorrence({ 67 / 255.f, 60 / 255.f, 149 / 255.f }, .0f, 1.f));
+		const auto matCT_GroundRoughPlastic = AddMaterial(Material::CreateCookTorrence({ 165/ 255.f, 183 / 255.f, 215 / 255.f }, .0f, 1.f));
+		const auto matCT_TealRoughPlastic = AddMaterial(Material::CreateCookTorrence({ 146 / 255.f, 253 / 255.f, 253 / 255.f }, .0f, 1.f));
+		const auto matCT_YellowRoughPlastic = AddMaterial(Material::CreateCookTorrence({ 255 / 255.f, 255 / 255.f, 27 / 255.f }, .0f, 1.f));
 		
 		AddPlane({ 0.0f, 0.0f,0.0f }, { 0.0f, 1.0f, 0.0f }, matCT_GroundRoughPlastic); //BOTTOM
 		
@@ -560,13 +879,11 @@ namespace dae {
 		files[8] = "lowpoly_fish.obj";
 		files[9] = "lowpoly_background.obj";
 		
+		//All meshes load concurrently, they pop in (within the placeholder bounds) as soon as they are ready
 		for (size_t i = 0; i < 9; i++)
 		{
-			m_Meshes[i] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matCT_GrayRoughPlastic);
-			Utils::ParseOBJ_Test(path + files[i],
-				m_Meshes[i]->positions,
-				m_Meshes[i]->normals,
-				m_Meshes[i]->indices);
+			m_Meshes[i] = AddTriangleMeshAsync(path + files[i], TriangleCullMode::BackFaceCulling, matCT_GrayRoughPlastic,
+				{ -2.f, 0.f, -2.f }, { 2.f, 4.f, 2.f });
 		}
 		/*m_Meshes[6] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matCT_YellowRoughPlastic);
 		Utils::ParseOBJ_Test(path + files[6],
@@ -586,19 +903,15 @@ namespace dae {
 			m_Meshes[8]->normals,
 			m_Meshes[8]->indices);*/
 		
-		m_Meshes[9] = AddTriangleMesh(TriangleCullMode::NoCulling, matCT_Mirror);
-		Utils::ParseOBJ_Test(path + files[9],
-			m_Meshes[9]->positions,
-			m_Meshes[9]->normals,
-			m_Meshes[9]->indices);
+		m_Meshes[9] = AddTriangleMeshAsync(path + files[9], TriangleCullMode::NoCulling, matCT_Mirror,
+			{ -10.f, 0.f, -10.f }, { 10.f, 10.f, 10.f });
 
 		m_Meshes[9]->Translate({ 0, 0, -1.5f });
 
-		//No need to calc normals, they are calculated in ParseOBJ
+		//No need to calc normals or bounds, they come from LoadMesh (AddTriangleMeshAsync)
 		for (const auto m : m_Meshes)
 		{
 			m->RotateY(M_PI);
-			m->UpdateAABB();
 			m->UpdateTransforms();
 		}
 
@@ -609,7 +922,10 @@ namespace dae {
 		//AddPointLight({ 0.f, 2.f, -3.0f }, 10.0f, ColorRGB{ 1.0f, 1.0f, 1.0f });//Front
 		//AddPointLight({ 0.0f,5.0f,10.0f }, 80.0f, ColorRGB{ 1.0f, 1.0f, 1.0f });//Back
 		
-		AddPointLight({ 0.f, 2.f, -3.0f }, 10.0f, ColorRGB{ 1.0f, 0.61f, 0.45f });//Front
+		if (m_IsFrontLightArea)
+			AddSphereLight({ 0.f, 2.f, -3.0f }, 0.3f, 10.0f, ColorRGB{ 1.0f, 0.61f, 0.45f });//Front, soft shadows
+		else
+			AddPointLight({ 0.f, 2.f, -3.0f }, 10.0f, ColorRGB{ 1.0f, 0.61f, 0.45f });//Front
 		AddPointLight({ 0.0f,5.0f,10.0f }, 80.0f, ColorRGB{ 0.34f, 0.47f, 0.68f });//Back
 	}
 	void Scene_Extra::Update(Timer* pTimer)
@@ -631,12 +947,8 @@ namespace dae {
 			m_Meshes[i]->RotateY(z * M_PI/2 + M_PI);
 		}
 		m_Meshes[8]->Translate({ x, 0, 0 });
-		
-		for (const auto m : m_Meshes)
-		{
-			m->UpdateTransforms();
-		}
-		
+
+		UpdateMeshTransforms();
 	}
 #pragma endregion
 }
@@ -1,20 +1,32 @@
 #pragma once
+#include <future>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "LightTree.h"
+#include "Material.h"
+#include "MemoryTracker.h"
+#include "MeshCache.h"
+#include "PagedMesh.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
 
+	//How the shared data of a mesh instance is stored
+	enum class MeshStorage
+	{
+		Full, //float positions and normals, 32-bit indices
+		Compact //quantized, see CompactMeshData
+	};
+
 	//Scene Base Class
 	class Scene
 	{
@@ -31,42 +43,134 @@ namespace dae
 		virtual void Update(dae::Timer* pTimer)
 		{
 			m_Camera.Update(pTimer);
+			UpdatePendingMeshes();
+			if (m_PageCache.Update())
+				MarkChanged();
+			if (m_IsLightTreeDirty)
+			{
+				m_LightTree.Build(m_Lights);
+				m_IsLightTreeDirty = false;
+				MarkChanged();
+			}
 		}
 
+		bool IsLoadingAssets() const { return !m_PendingMeshes.empty(); }
+		//Changes whenever geometry moved or appeared since the last Update, the camera is not included
+		uint32_t GetVersion() const { return m_Version; }
+		//Version of the last change that can affect every object: lights, geometry that appeared
+		uint32_t GetSceneWideVersion() const { return m_SceneWideVersion; }
+		//Version of the last time the object (id as in GetClosestHit) moved, 0 if it never did
+		uint32_t GetObjectVersion(uint32_t objectId) const { return objectId < m_ObjectVersions.size() ? m_ObjectVersions[objectId] : 0; }
+
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
 		bool DoesHit(const Ray& ray) const;
+		/**
+		 * \brief Shadow rays as a batch (e.g. the samples of an area light): each object is tested against every ray that is
+		 * still unoccluded before moving on to the next, so its data is only brought into the cache once
+		 * \param pIsOccluded one per ray, set to 1 or 0
+		 */
+		void DoesHit(const Ray* pRays, uint32_t numRays, uint8_t* pIsOccluded) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<TriangleMesh>& GetTriangleMeshGeometries() const { return m_TriangleMeshGeometries; }
+		const std::vector<MeshInstance>& GetMeshInstances() const { return m_MeshInstances; }
+		const GeometryPageCache& GetPageCache() const { return m_PageCache; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		//Over the point lights, for picking a few lights per shading point
+		const LightTree& GetLightTree() const { return m_LightTree; }
+		const std::vector<Material>& GetMaterials() const { return m_Materials; }
 
 		//TMP
 		const std::vector<Triangle>& GetTriangleGeometries() const { return m_Triangles; }
 
+		MemoryUsage GetMemoryUsage() const;
+
 	protected:
 		std::string	sceneName;
 
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<MeshInstance> m_MeshInstances{};
+		GeometryPageCache m_PageCache{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		LightTree m_LightTree{};
+		bool m_IsLightTreeDirty{ false }; //set when lights are added, scenes that move a light set it too
+		std::vector<Material> m_Materials{};
 
 		//TEMP (Individual Triangle Testing)
 		std::vector<Triangle> m_Triangles{};
+
+		//Meshes that are still being loaded by AddTriangleMeshAsync
+		struct PendingMesh
+		{
+			size_t meshIndex{};
+			std::string filename{};
+			std::future<MeshLoadResult> result{};
+		};
+		std::vector<PendingMesh> m_PendingMeshes{};
 		
 		Camera m_Camera{};
 
+		uint32_t m_Version{};
+		uint32_t m_SceneWideVersion{};
+		std::vector<uint32_t> m_ObjectVersions{};
+		//Something that can change how every object looks
+		void MarkChanged()
+		{
+			++m_Version;
+			m_SceneWideVersion = m_Version;
+		}
+		//Only this object changed
+		void MarkObjectChanged(uint32_t objectId)
+		{
+			++m_Version;
+			if (objectId >= m_ObjectVersions.size())
+				m_ObjectVersions.resize(objectId + 1);
+			m_ObjectVersions[objectId] = m_Version;
+		}
+		//The id GetClosestHit gives the object
+		uint32_t GetObjectId(const TriangleMesh& mesh) const;
+		uint32_t GetObjectId(const MeshInstance& instance) const;
+		uint32_t GetObjectId(const PagedMesh& mesh) const;
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		/**
+		 * \brief Adds a mesh that is loaded from file in the background (see Utils::LoadMeshAsync).
+		 * Until the load finishes the mesh has no triangles and uses the placeholder bounds, transforms can be set right away.
+		 */
+		TriangleMesh* AddTriangleMeshAsync(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex = 0,
+			const Vector3& placeholderMinAABB = {}, const Vector3& placeholderMaxAABB = {});
+		//Places a copy of the (shared) mesh asset, returns nullptr if the file could not be loaded
+		MeshInstance* AddMeshInstance(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex = 0,
+			MeshStorage storage = MeshStorage::Full);
+		MeshInstance* AddMeshInstance(std::shared_ptr<const MeshData> pData, TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		MeshInstance* AddMeshInstance(std::shared_ptr<const CompactMeshData> pCompactData, TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Out-of-core mesh (see PagedMesh), returns nullptr if the file could not be loaded
+		PagedMesh* AddPagedMesh(const std::string& filename, TriangleCullMode cullMode, unsigned char materialIndex = 0,
+			uint32_t trianglesPerCluster = 512);
+		//Updates the transformed vertices of every triangle mesh whose transform changed, in parallel across meshes
+		void UpdateMeshTransforms();
+		//For single meshes and instances, marks the object as changed when the transform was recomputed
+		template<typename TMesh>
+		void UpdateMeshTransforms(TMesh& mesh)
+		{
+			if (mesh.UpdateTransforms())
+				MarkObjectChanged(GetObjectId(mesh));
+		}
+		//Moves finished loads into their meshes, called from Update (between frames) so rendering never sees a half filled mesh
+		void UpdatePendingMeshes();
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		//Emits from the side edgeU x edgeV points to, intensity is along that normal
+		Light* AddRectLight(const Vector3& center, const Vector3& edgeU, const Vector3& edgeV, float intensity, const ColorRGB& color);
+		Light* AddSphereLight(const Vector3& center, float radius, float intensity, const ColorRGB& color);
+		unsigned char AddMaterial(const Material& material);
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -142,7 +246,7 @@ namespace dae
 		void Update(Timer* pTimer) override;
 		
 	private:
-		TriangleMesh* pMesh{ nullptr };
+		MeshInstance* m_pBunny{ nullptr };
 	};
 
 	class Scene_W4_ReferenceScene final : public Scene
@@ -166,7 +270,9 @@ namespace dae
 	class Scene_W4_BunnyScene final : public Scene
 	{
 	public:
-		Scene_W4_BunnyScene() = default;
+		//storage of the bunny, to compare the storages on the same mesh, isPaged loads it out-of-core instead (storage is only the fallback)
+		explicit Scene_W4_BunnyScene(MeshStorage storage = MeshStorage::Full, bool isPaged = false) :
+			m_Storage{ storage }, m_IsPaged{ isPaged } {}
 		~Scene_W4_BunnyScene() override = default;
 
 		Scene_W4_BunnyScene(const Scene_W4_BunnyScene&) = delete;
@@ -178,13 +284,17 @@ namespace dae
 		void Update(Timer* pTimer) override;
 
 	private:
-		TriangleMesh* pMesh{ nullptr };
+		MeshStorage m_Storage;
+		bool m_IsPaged;
+		MeshInstance* m_pBunny{ nullptr };
+		PagedMesh* m_pPagedBunny{ nullptr };
 	};
 
 	class Scene_Extra final : public Scene
 	{
 	public:
-		Scene_Extra() = default;
+		//isFrontLightArea makes the front light a small sphere light, for soft shadows
+		explicit Scene_Extra(bool isFrontLightArea = false) : m_IsFrontLightArea{ isFrontLightArea } {}
 		~Scene_Extra() override = default;
 
 		Scene_Extra(const Scene_Extra&) = delete;
@@ -196,6 +306,7 @@ namespace dae
 		void Update(Timer* pTimer) override;
 
 	private:
+		bool m_IsFrontLightArea;
 		TriangleMesh* m_Meshes[10]{nullptr};
 	};
 }
@@ -3,33 +3,41 @@
 #include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "Kernels.h"
+#include "PagedMesh.h"
+#include "Sampling.h"
 
 //#define DISABLE_OBJ
 
 namespace dae
 {
-	inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+	inline bool SlabTest_AABB(const Vector3& minAABB, const Vector3& maxAABB, const Ray& ray)
 	{
-		float tx1 = (mesh.transformedMaxAABB.x - ray.origin.x) / ray.direction.x;
-		float tx2 = (mesh.transformedMinAABB.x - ray.origin.x) / ray.direction.x;
+		float tx1 = (maxAABB.x - ray.origin.x) / ray.direction.x;
+		float tx2 = (minAABB.x - ray.origin.x) / ray.direction.x;
 
 		float tmin = std::min(tx1, tx2);
 		float tmax = std::max(tx1, tx2);
 
-		float ty1 = (mesh.transformedMaxAABB.y - ray.origin.y) / ray.direction.y;
-		float ty2 = (mesh.transformedMinAABB.y - ray.origin.y) / ray.direction.y;
+		float ty1 = (maxAABB.y - ray.origin.y) / ray.direction.y;
+		float ty2 = (minAABB.y - ray.origin.y) / ray.direction.y;
 
 		tmin = std::max(tmin, std::min(ty1, ty2));
 		tmax = std::min(tmax, std::max(ty1, ty2));
 
-		float tz1 = (mesh.transformedMaxAABB.z - ray.origin.z) / ray.direction.z;
-		float tz2 = (mesh.transformedMinAABB.z - ray.origin.z) / ray.direction.z;
+		float tz1 = (maxAABB.z - ray.origin.z) / ray.direction.z;
+		float tz2 = (minAABB.z - ray.origin.z) / ray.direction.z;
 
 		tmin = std::max(tmin, std::min(tz1, tz2));
 		tmax = std::min(tmax, std::max(tz1, tz2));
 
 		return tmax > 0 && tmax >= tmin;
 	}
+
+	inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+	{
+		return SlabTest_AABB(mesh.transformedMinAABB, mesh.transformedMaxAABB, ray);
+	}
 	namespace GeometryUtils
 	{
 #pragma region Sphere HitTest
@@ -185,45 +193,47 @@ namespace dae
 		}
 #pragma endregion
 #pragma region Triangle HitTest
+		/**
+		 * \brief Calls function.template operator()<cullMode, isAnyHit>() with the runtime values as template arguments,
+		 * so a mesh branches on them once instead of once per triangle
+		 */
+		template<typename TFunction>
+		inline bool DispatchTriangleTest(TriangleCullMode cullMode, bool isAnyHit, const TFunction& function)
+		{
+			switch (cullMode)
+			{
+			case TriangleCullMode::BackFaceCulling:
+				return isAnyHit ? function.template operator()<TriangleCullMode::BackFaceCulling, true>()
+					: function.template operator()<TriangleCullMode::BackFaceCulling, false>();
+			case TriangleCullMode::FrontFaceCulling:
+				return isAnyHit ? function.template operator()<TriangleCullMode::FrontFaceCulling, true>()
+					: function.template operator()<TriangleCullMode::FrontFaceCulling, false>();
+			default:
+				return isAnyHit ? function.template operator()<TriangleCullMode::NoCulling, true>()
+					: function.template operator()<TriangleCullMode::NoCulling, false>();
+			}
+		}
+
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief triangle.cullMode is ignored, cullMode is used instead
+		 * \tparam isAnyHit shadow ray, only tells if there is a hit (this also flips the culling)
+		 */
+		template<TriangleCullMode cullMode, bool isAnyHit>
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord)
 		{
-			//todo W5
-			/*assert(false && "No Implemented Yet!");
-			return false;*/
-			
 			const float viewAngle{ Vector3::Dot(triangle.normal, ray.direction) };
 			if (viewAngle == 0 ) return false; // Ray is parallel to the triangle
 
-			switch (triangle.cullMode)
+			if constexpr (cullMode == TriangleCullMode::BackFaceCulling)
 			{
-			case TriangleCullMode::BackFaceCulling:
-				if (!ignoreHitRecord)
-				{
-					if (viewAngle > 0) return false;
-				}
-				else
-				{
-					if (viewAngle < 0) return false;
-				}
-				
-				break;
-			case TriangleCullMode::FrontFaceCulling:
-				if (!ignoreHitRecord)
-				{
-					if (viewAngle < 0) return false;
-				}
-				else
-				{
-					if (viewAngle > 0) return false;
-				}
-				break;
-			case TriangleCullMode::NoCulling:
-				break;
+				if (isAnyHit ? viewAngle < 0 : viewAngle > 0) return false;
+			}
+			else if constexpr (cullMode == TriangleCullMode::FrontFaceCulling)
+			{
+				if (isAnyHit ? viewAngle > 0 : viewAngle < 0) return false;
 			}
-			
 
-			
 			const Vector3 center{ (triangle.v0 + triangle.v1 + triangle.v2) / 3 };
 			const Vector3 L{ center - ray.origin };
 			const float t{ Vector3::Dot(L, triangle.normal) / Vector3::Dot(ray.direction, triangle.normal) };
@@ -244,7 +254,7 @@ namespace dae
 			if (Vector3::Dot(triangle.normal, Vector3::Cross(c, pointToSide)) < 0) return false; // Point is not in tiangle
 
 
-			if (ignoreHitRecord) return true;
+			if constexpr (isAnyHit) return true;
 
 			hitRecord.didHit = true;
 			hitRecord.materialIndex = triangle.materialIndex;
@@ -255,6 +265,14 @@ namespace dae
 			return true;
 		}
 
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			return DispatchTriangleTest(triangle.cullMode, ignoreHitRecord, [&]<TriangleCullMode cullMode, bool isAnyHit>()
+				{
+					return HitTest_Triangle<cullMode, isAnyHit>(triangle, ray, hitRecord);
+				});
+		}
+
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
 			HitRecord temp{};
@@ -264,40 +282,190 @@ namespace dae
 #pragma region TriangeMesh HitTest
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
-			//todo W5
-			/*assert(false && "No Implemented Yet!");
-			return false;*/
-
 			// slabtest
 			if (!SlabTest_TriangleMesh(mesh, ray)) return false;
-			
-			Ray newRay = ray;
-			
+
+			float t{};
+			const int triangleIndex = g_Kernels.IntersectTriangles(ray, mesh.transformedPositions.data(), mesh.indices.data(),
+				mesh.transformedNormals.data(), static_cast<uint32_t>(mesh.transformedNormals.size()), mesh.cullMode, ignoreHitRecord, t);
+			if (triangleIndex < 0) return false;
+			if (ignoreHitRecord) return true; // for shadows that don't care about hitrecord distance
+
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = mesh.materialIndex;
+			hitRecord.t = t;
+			hitRecord.origin = ray.origin + t * ray.direction;
+			hitRecord.normal = mesh.transformedNormals[triangleIndex];
+			return true;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleMesh(mesh, ray, temp, true);
+		}
+#pragma endregion
+#pragma region MeshInstance HitTest
+		//Object space ray, the direction is not normalized so t stays the same as in world space
+		inline Ray ToObjectSpace(const Ray& ray, const Matrix& worldToObject)
+		{
+			Ray objectRay = ray;
+			objectRay.origin = worldToObject.TransformPoint(ray.origin);
+			objectRay.direction = worldToObject.TransformVector(ray.direction);
+			return objectRay;
+		}
+
+		/**
+		 * \brief Hit test of a transformed object: TTestTriangles(objectRay) tests the object space triangles against the
+		 * object space ray and returns whether any was hit, the closest hit is brought back to world space
+		 */
+		template<bool isAnyHit, typename TTestTriangles>
+		inline bool HitTest_ObjectSpace(const Matrix& worldToObject, const Matrix& normalToWorld, const Ray& ray, HitRecord& hitRecord,
+			const TTestTriangles& testTriangles)
+		{
+			Ray objectRay = ToObjectSpace(ray, worldToObject);
+			if (!testTriangles(objectRay)) return false;
+			if constexpr (isAnyHit) return true; // for shadows that don't care about hitrecord distance
+
+			//Back to world space
+			hitRecord.origin = ray.origin + hitRecord.t * ray.direction;
+			hitRecord.normal = normalToWorld.TransformVector(hitRecord.normal).Normalized();
+			return true;
+		}
+
+		//Closest (or any) hit against object space triangles, TGetTriangle(index, triangle) fills in vertices and normal.
+		//objectRay.max shrinks to the closest hit, so further calls only find closer ones.
+		template<TriangleCullMode cullMode, bool isAnyHit, typename TGetTriangle>
+		inline bool HitTest_ObjectSpaceTriangles(size_t numTriangles, const TGetTriangle& getTriangle, unsigned char materialIndex,
+			Ray& objectRay, HitRecord& hitRecord)
+		{
+			bool didHit = false;
+
 			Triangle triangle;
-			for (size_t i = 0; i < mesh.transformedNormals.size(); i++)
+			triangle.materialIndex = materialIndex;
+			for (size_t i = 0; i < numTriangles; i++)
 			{
-				triangle.cullMode = mesh.cullMode;
-				triangle.materialIndex = mesh.materialIndex;
-				triangle.normal = mesh.transformedNormals[i];
-				
-				int startIndex = i * 3;
-				triangle.v0 = mesh.transformedPositions[mesh.indices[startIndex]];
-				triangle.v1 = mesh.transformedPositions[mesh.indices[++startIndex]];
-				triangle.v2 = mesh.transformedPositions[mesh.indices[++startIndex]];
-				
-				if (HitTest_Triangle(triangle, newRay, hitRecord, ignoreHitRecord))
+				getTriangle(i, triangle);
+
+				if (HitTest_Triangle<cullMode, isAnyHit>(triangle, objectRay, hitRecord))
 				{
-					if (ignoreHitRecord) return true; // for shadows that don't care about hitrecord distance
-					newRay.max = hitRecord.t;
+					if constexpr (isAnyHit) return true;
+					objectRay.max = hitRecord.t;
+					didHit = true;
 				}
 			}
-			return hitRecord.didHit;
+			return didHit;
 		}
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		inline bool HitTest_MeshInstance(const MeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (!SlabTest_AABB(instance.transformedMinAABB, instance.transformedMaxAABB, ray)) return false;
+
+			if (instance.pData)
+			{
+				//Indexed like a TriangleMesh, so it can go through the kernel
+				const MeshData& data = *instance.pData;
+				const Ray objectRay = ToObjectSpace(ray, instance.worldToObject);
+
+				float t{};
+				const int triangleIndex = g_Kernels.IntersectTriangles(objectRay, data.positions.data(), data.indices.data(),
+					data.normals.data(), static_cast<uint32_t>(data.normals.size()), instance.cullMode, ignoreHitRecord, t);
+				if (triangleIndex < 0) return false;
+				if (ignoreHitRecord) return true;
+
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = instance.materialIndex;
+				hitRecord.t = t;
+				hitRecord.origin = ray.origin + t * ray.direction;
+				hitRecord.normal = instance.normalToWorld.TransformVector(data.normals[triangleIndex]).Normalized();
+				return true;
+			}
+
+			if (instance.pCompactData)
+			{
+				//Decoded on the fly
+				const CompactMeshData& data = *instance.pCompactData;
+				const auto getTriangle = [&data](size_t i, Triangle& triangle)
+					{
+						triangle.normal = data.GetNormal(i);
+						triangle.v0 = data.GetPosition(data.GetIndex(i * 3));
+						triangle.v1 = data.GetPosition(data.GetIndex(i * 3 + 1));
+						triangle.v2 = data.GetPosition(data.GetIndex(i * 3 + 2));
+					};
+				return DispatchTriangleTest(instance.cullMode, ignoreHitRecord, [&]<TriangleCullMode cullMode, bool isAnyHit>()
+					{
+						return HitTest_ObjectSpace<isAnyHit>(instance.worldToObject, instance.normalToWorld, ray, hitRecord, [&](Ray& objectRay)
+							{
+								return HitTest_ObjectSpaceTriangles<cullMode, isAnyHit>(data.GetNumTriangles(), getTriangle, instance.materialIndex,
+									objectRay, hitRecord);
+							});
+					});
+			}
+
+			return false;
+		}
+
+		inline bool HitTest_MeshInstance(const MeshInstance& instance, const Ray& ray)
 		{
 			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			return HitTest_MeshInstance(instance, ray, temp, true);
+		}
+#pragma endregion
+#pragma region PagedMesh HitTest
+		//Clusters without a resident page are skipped (and queued), they appear once the page cache has loaded them
+		template<TriangleCullMode cullMode, bool isAnyHit>
+		inline bool HitTest_PagedMeshClusters(const PagedMesh& mesh, Ray& objectRay, HitRecord& hitRecord)
+		{
+			//All cluster bounds in one go
+			const std::vector<MeshCluster>& clusters = mesh.GetClusters();
+			thread_local std::vector<uint8_t> isClusterHit{};
+			isClusterHit.resize(clusters.size());
+			if (!clusters.empty())
+				g_Kernels.SlabTest(objectRay, &clusters[0].minAABB, &clusters[0].maxAABB, sizeof(MeshCluster),
+					static_cast<uint32_t>(clusters.size()), isClusterHit.data());
+
+			bool didHit = false;
+			for (uint32_t c = 0; c < clusters.size(); c++)
+			{
+				if (!isClusterHit[c]) continue;
+
+				const PagedTriangle* pPage = mesh.GetPage(c);
+				if (!pPage) continue;
+
+				const auto getTriangle = [pPage](size_t i, Triangle& triangle)
+					{
+						triangle.v0 = pPage[i].v0;
+						triangle.v1 = pPage[i].v1;
+						triangle.v2 = pPage[i].v2;
+						triangle.normal = pPage[i].normal;
+					};
+				if (HitTest_ObjectSpaceTriangles<cullMode, isAnyHit>(clusters[c].numTriangles, getTriangle, mesh.GetMaterialIndex(),
+					objectRay, hitRecord))
+				{
+					if constexpr (isAnyHit) return true;
+					didHit = true;
+				}
+			}
+			return didHit;
+		}
+
+		inline bool HitTest_PagedMesh(const PagedMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (!SlabTest_AABB(mesh.GetTransformedMinAABB(), mesh.GetTransformedMaxAABB(), ray)) return false;
+
+			return DispatchTriangleTest(mesh.GetCullMode(), ignoreHitRecord, [&]<TriangleCullMode cullMode, bool isAnyHit>()
+				{
+					return HitTest_ObjectSpace<isAnyHit>(mesh.GetWorldToObject(), mesh.GetNormalToWorld(), ray, hitRecord, [&](Ray& objectRay)
+						{
+							return HitTest_PagedMeshClusters<cullMode, isAnyHit>(mesh, objectRay, hitRecord);
+						});
+				});
+		}
+
+		inline bool HitTest_PagedMesh(const PagedMesh& mesh, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_PagedMesh(mesh, ray, temp, true);
 		}
 #pragma endregion
 	}
@@ -319,20 +487,71 @@ namespace dae
 			return light.origin - origin;
 		}
 
-		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		//Radiance arriving at target from a point on the light (the origin of a point light), rects only light their front side
+		inline ColorRGB GetRadiance(const Light& light, const Vector3& target, const Vector3& lightPoint)
 		{
-			//todo W3
-			/*assert(false && "No Implemented Yet!");
-			return {};*/
-
 			if (light.type == LightType::Directional)
 			{
 				return light.color * light.intensity;
 			}
 
+			const Vector3 toTarget{ target - lightPoint };
+			const float distanceSquared = toTarget.SqrMagnitude();
+			float intensity{ light.intensity };
+			if (light.type == LightType::Rect)
+				intensity *= std::max(Vector3::Dot(light.direction, toTarget) / sqrtf(distanceSquared), 0.f);
 
 			// light color * irradiance
-			return light.color * (light.intensity / (light.origin - target).SqrMagnitude());
+			return light.color * (intensity / distanceSquared);
+		}
+
+		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		{
+			//todo W3
+			/*assert(false && "No Implemented Yet!");
+			return {};*/
+
+			return GetRadiance(light, target, light.origin);
+		}
+
+		//Largest distance of a point on the light from its origin, 0 for point lights
+		inline float GetAreaLightExtent(const Light& light)
+		{
+			if (light.type == LightType::Rect)
+				return 0.5f * sqrtf(light.edgeU.SqrMagnitude() + light.edgeV.SqrMagnitude());
+			if (light.type == LightType::Sphere)
+				return light.radius;
+			return 0.f;
+		}
+
+		//Distance where the radiance (brightest channel) drops below the threshold, plus the extent of area lights.
+		//FLT_MAX for directional lights or a threshold of 0
+		inline float GetInfluenceRadius(const Light& light, float radianceThreshold)
+		{
+			if (light.type == LightType::Directional || radianceThreshold <= 0.f)
+				return FLT_MAX;
+
+			const float brightestChannel = std::max(light.color.r, std::max(light.color.g, light.color.b));
+			return sqrtf(light.intensity * brightestChannel / radianceThreshold) + GetAreaLightExtent(light);
+		}
+
+		/**
+		 * \brief Point on an area light for the sample (u, v) in [0, 1)^2. Spheres are sampled on their disk that faces
+		 * the target, the shadow they cast is the same as that of the whole sphere.
+		 */
+		inline Vector3 GetAreaLightPoint(const Light& light, const Vector3& target, float u, float v)
+		{
+			if (light.type == LightType::Rect)
+				return light.origin + light.edgeU * (u - 0.5f) + light.edgeV * (v - 0.5f);
+
+			const Vector3 axis{ (target - light.origin).Normalized() };
+			const Vector3 helper{ std::abs(axis.x) > 0.9f ? Vector3::UnitY : Vector3::UnitX };
+			const Vector3 tangent{ Vector3::Cross(helper, axis).Normalized() };
+			const Vector3 bitangent{ Vector3::Cross(axis, tangent) };
+
+			float diskX{}, diskY{};
+			Sampling::ToConcentricDisk(u, v, diskX, diskY);
+			return light.origin + (tangent * diskX + bitangent * diskY) * light.radius;
 		}
 	}
 
@@ -367,12 +586,12 @@ namespace dae
 				}
 				else if (sCommand == "f")
 				{
-					float i0, i1, i2;
+					int i0, i1, i2;
 					file >> i0 >> i1 >> i2;
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
+					indices.push_back(i0 - 1);
+					indices.push_back(i1 - 1);
+					indices.push_back(i2 - 1);
 				}
 				//read till end of line and ignore all remaining chars
 				file.ignore(1000, '\n');
@@ -5,15 +5,253 @@
 #undef main
 
 //Standard includes
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "MemoryTracker.h"
+#include "ImageWriter.h"
+#include "FrameStream.h"
+#include "MathBenchmark.h"
+#include "Kernels.h"
 
 using namespace dae;
 
+//Command line options
+struct Options
+{
+	bool writeSequence{ false }; //write every frame
+	std::string outputName{ "RayTracing_Buffer" };
+	ImageFormat format{ ImageFormat::BMP };
+	uint32_t numFrames{ 0 }; //0 = until the window is closed
+
+	std::string streamTarget{}; //file or pipe, "-" for stdout, empty = no streaming
+	StreamFormat streamFormat{ StreamFormat::RGB24 };
+	uint32_t streamFPS{ 30 };
+
+	bool benchMath{ false }; //run the math benchmark and exit
+	bool isBunnyScene{ false }; //render the bunny scene instead of the extra scene
+	MeshStorage bunnyStorage{ MeshStorage::Full };
+	bool isBunnyPaged{ false }; //out-of-core instead of bunnyStorage
+
+	bool isAdaptiveAAEnabled{ false };
+	uint32_t adaptiveSampleBudget{ 640 * 480 / 4 }; //extra samples per frame
+
+	bool isProgressive{ false }; //accumulate while nothing changes
+	float noiseThreshold{ 0.f }; //progressive stops once every tile is below it, 0 = never
+	float timeLimit{ 0.f }; //seconds, progressive stops after this, 0 = no limit
+
+	uint32_t numLightSamples{ 4 }; //point lights shaded per hit in scenes with more lights, 0 = every light
+	float lightCutoff{ 0.001f }; //radiance below which a light is skipped, 0 = never
+	uint32_t numAreaLightSamples{ 4 }; //shadow rays per area light and hit
+	AreaLightSampling areaLightSampling{ AreaLightSampling::Stratified };
+	bool isFrontLightArea{ false }; //the extra scene's front light as a sphere light
+	uint32_t maxReflectionDepth{ 4 }; //mirrors followed per view ray
+	uint32_t secondaryRayBudget{ 640 * 480 }; //reflection rays per frame, 0 = no limit
+	bool isTemporalReuseEnabled{ false }; //keep the colors of last frame's hits that didn't change
+	uint32_t refreshInterval{ 8 }; //frames a reused color is kept at most
+	bool isDenoiserEnabled{ false };
+	uint32_t numDenoiseIterations{ 4 }; //a-trous passes
+
+	bool forceCPUPath{ false }; //use cpuPath instead of the fastest path the CPU supports
+	CPUPath cpuPath{ CPUPath::SSE2 };
+};
+
+//The whole argument has to be a number, so typos and negative counts are rejected instead of thrown or wrapped
+template<typename T>
+bool ParseNumber(const char* arg, T& value)
+{
+	const char* pEnd = arg + std::strlen(arg);
+	const auto [pLast, error] = std::from_chars(arg, pEnd, value);
+	if (error != std::errc{} || pLast != pEnd)
+	{
+		std::cout << "Invalid number " << arg << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [--sequence <name>] [--format bmp|ppm|pfm|png|png-stored] [--frames <count>]\n"
+		<< "                 [--stream <file|pipe|-> [--stream-format rgb|rgba|y4m] [--stream-fps <fps>]]\n"
+		<< "                 [--adaptive-aa <extra samples per frame>]\n"
+		<< "                 [--progressive] [--noise-threshold <luminance error>] [--time-limit <seconds>]\n"
+		<< "                 [--light-samples <lights per hit, 0 = all>] [--light-cutoff <radiance, 0 = off>]\n"
+		<< "                 [--area-samples <shadow rays per area light>] [--area-sampling stratified|bluenoise]\n"
+		<< "                 [--sphere-light]\n"
+		<< "                 [--max-depth <reflections>] [--ray-budget <reflection rays per frame, 0 = no limit>]\n"
+		<< "                 [--temporal-reuse <refresh interval in frames>] [--denoise <passes>]\n"
+		<< "                 [--bunny full|compact|paged] [--bench-math] [--cpu-path sse2|sse42|avx2|avx512]\n"
+		<< "Keys: F2 shadows, F3 lighting mode, F4 adaptive AA, F5 progressive, F6 benchmark, F7 denoiser, F8 temporal reuse,\n"
+		<< "      X screenshot" << std::endl;
+}
+
+//Returns false on anything it doesn't understand, the caller prints the usage
+bool ParseOptions(int argc, char* args[], Options& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (std::strcmp(args[i], "--sequence") == 0 && hasValue)
+		{
+			options.writeSequence = true;
+			options.outputName = args[++i];
+		}
+		else if (std::strcmp(args[i], "--format") == 0 && hasValue)
+		{
+			if (!ImageWriter::ParseFormat(args[++i], options.format))
+			{
+				std::cout << "Unknown image format " << args[i] << " (bmp, ppm, pfm, png, png-stored)" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(args[i], "--frames") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.numFrames))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--stream") == 0 && hasValue)
+		{
+			options.streamTarget = args[++i];
+		}
+		else if (std::strcmp(args[i], "--stream-format") == 0 && hasValue)
+		{
+			if (!FrameStream::ParseFormat(args[++i], options.streamFormat))
+			{
+				std::cout << "Unknown stream format " << args[i] << " (rgb, rgba, y4m)" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(args[i], "--stream-fps") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.streamFPS))
+				return false;
+			//F0:1 is not a valid Y4M frame rate
+			if (options.streamFPS < 1)
+			{
+				std::cout << "--stream-fps has to be at least 1" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(args[i], "--bench-math") == 0)
+		{
+			options.benchMath = true;
+		}
+		else if (std::strcmp(args[i], "--bunny") == 0 && hasValue)
+		{
+			++i;
+			options.isBunnyScene = true;
+			if (std::strcmp(args[i], "full") == 0)
+				options.bunnyStorage = MeshStorage::Full;
+			else if (std::strcmp(args[i], "compact") == 0)
+				options.bunnyStorage = MeshStorage::Compact;
+			else if (std::strcmp(args[i], "paged") == 0)
+				options.isBunnyPaged = true;
+			else
+			{
+				std::cout << "Unknown mesh storage " << args[i] << " (full, compact, paged)" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(args[i], "--adaptive-aa") == 0 && hasValue)
+		{
+			options.isAdaptiveAAEnabled = true;
+			if (!ParseNumber(args[++i], options.adaptiveSampleBudget))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--progressive") == 0)
+		{
+			options.isProgressive = true;
+		}
+		else if (std::strcmp(args[i], "--noise-threshold") == 0 && hasValue)
+		{
+			options.isProgressive = true;
+			if (!ParseNumber(args[++i], options.noiseThreshold))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--time-limit") == 0 && hasValue)
+		{
+			options.isProgressive = true;
+			if (!ParseNumber(args[++i], options.timeLimit))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--light-samples") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.numLightSamples))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--light-cutoff") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.lightCutoff))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--area-samples") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.numAreaLightSamples))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--area-sampling") == 0 && hasValue)
+		{
+			++i;
+			if (std::strcmp(args[i], "stratified") == 0)
+				options.areaLightSampling = AreaLightSampling::Stratified;
+			else if (std::strcmp(args[i], "bluenoise") == 0)
+				options.areaLightSampling = AreaLightSampling::BlueNoise;
+			else
+			{
+				std::cout << "Unknown area light sampling " << args[i] << " (stratified, bluenoise)" << std::endl;
+				return false;
+			}
+		}
+		else if (std::strcmp(args[i], "--sphere-light") == 0)
+		{
+			options.isFrontLightArea = true;
+		}
+		else if (std::strcmp(args[i], "--max-depth") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.maxReflectionDepth))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--ray-budget") == 0 && hasValue)
+		{
+			if (!ParseNumber(args[++i], options.secondaryRayBudget))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--temporal-reuse") == 0 && hasValue)
+		{
+			options.isTemporalReuseEnabled = true;
+			if (!ParseNumber(args[++i], options.refreshInterval))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--denoise") == 0 && hasValue)
+		{
+			options.isDenoiserEnabled = true;
+			if (!ParseNumber(args[++i], options.numDenoiseIterations))
+				return false;
+		}
+		else if (std::strcmp(args[i], "--cpu-path") == 0 && hasValue)
+		{
+			if (!ParseCPUPath(args[++i], options.cpuPath))
+			{
+				std::cout << "Unknown cpu path " << args[i] << " (sse2, sse42, avx2, avx512)" << std::endl;
+				return false;
+			}
+			options.forceCPUPath = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
@@ -22,9 +260,28 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	Options options{};
+	if (!ParseOptions(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (options.benchMath)
+	{
+		RunMathBenchmark(std::cout);
+		return 0;
+	}
+
+	//stdout carries the video, everything that would be logged there goes to stderr instead
+	if (options.streamTarget == "-")
+		std::cout.rdbuf(std::cerr.rdbuf());
+
+	//Kernels already picked the fastest path during static initialization
+	const CPUPath detectedPath = DetectCPUPath();
+	if (options.forceCPUPath && !SelectKernels(options.cpuPath))
+		std::cout << "[Kernels] This CPU doesn't support the " << GetCPUPathName(options.cpuPath) << " path" << std::endl;
+	std::cout << "[Kernels] Using the " << GetCPUPathName(g_Kernels.path) << " path (detected " << GetCPUPathName(detectedPath) << ")" << std::endl;
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -44,15 +301,45 @@ int main(int argc, char* args[])
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
+	pRenderer->SetAdaptiveAA(options.isAdaptiveAAEnabled, options.adaptiveSampleBudget);
+	pRenderer->SetProgressive(options.isProgressive);
+	pRenderer->SetConvergence(options.noiseThreshold, options.timeLimit);
+	pRenderer->SetLightSampling(options.numLightSamples);
+	pRenderer->SetLightCutoff(options.lightCutoff);
+	pRenderer->SetAreaLightSampling(options.numAreaLightSamples, options.areaLightSampling);
+	pRenderer->SetReflections(options.maxReflectionDepth, options.secondaryRayBudget);
+	pRenderer->SetTemporalReuse(options.isTemporalReuseEnabled, options.refreshInterval);
+	pRenderer->SetDenoiser(options.isDenoiserEnabled, options.numDenoiseIterations);
 
-	const auto pScene = new Scene_Extra();
+	Scene* const pScene = options.isBunnyScene ? static_cast<Scene*>(new Scene_W4_BunnyScene(options.bunnyStorage, options.isBunnyPaged)) : new Scene_Extra(options.isFrontLightArea);
 	pScene->Initialize();
 
+	//Screenshots and sequences are written in the background
+	ImageWriter imageWriter{};
+	imageWriter.SetSequence(options.outputName, options.format);
+	Image frame{};
+
+	FrameStream frameStream{};
+	Image streamFrame{}; //reused every frame
+	if (!options.streamTarget.empty() &&
+		!frameStream.Open(options.streamTarget, options.streamFormat, width, height, options.streamFPS))
+	{
+		std::cout << "Could not open " << options.streamTarget << " for streaming" << std::endl;
+	}
+
+	MemoryTracker memoryTracker{};
+	memoryTracker.Sample(pScene, pRenderer);
+	memoryTracker.Report(std::cout, "Scene loaded");
+	MemoryTracker::ReportMeshes(std::cout, pScene);
+
 	//Start loop
 	pTimer->Start();
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool isLoadingAssets = pScene->IsLoadingAssets();
+	uint32_t numFramesRendered = 0;
+	bool wasConverged = false;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -77,31 +364,85 @@ int main(int argc, char* args[])
 
 		//--------- Update ---------
 		pScene->Update(pTimer);
+		if (isLoadingAssets && !pScene->IsLoadingAssets())
+		{
+			isLoadingAssets = false;
+			memoryTracker.ResetBaseline();
+			memoryTracker.Sample(pScene, pRenderer);
+			memoryTracker.Report(std::cout, "Assets loaded");
+			MemoryTracker::ReportMeshes(std::cout, pScene);
+		}
 
 		//--------- Render ---------
 		pRenderer->Render(pScene);
 
+		memoryTracker.Sample(pScene, pRenderer);
+
+		//Once per accumulation, the renderer only presents the final image after this
+		const RenderStats& renderStats = pRenderer->GetStats();
+		if (renderStats.isConverged && !wasConverged)
+		{
+			std::cout << "[Progressive] Done after " << renderStats.numAccumulatedFrames << " frames, "
+				<< renderStats.numConvergedTiles << " tiles converged" << std::endl;
+		}
+		wasConverged = renderStats.isConverged;
+
 		//--------- Timer ---------
 		pTimer->Update();
 		printTimer += pTimer->GetElapsed();
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+			const RenderStats& stats = pRenderer->GetStats();
+			std::cout << "dFPS: " << pTimer->GetdFPS();
+			if (stats.numEdgePixels > 0)
+				std::cout << " (AA: " << stats.numEdgePixels << " edge pixels, " << stats.numExtraSamples << " extra samples)";
+			if (stats.numAccumulatedFrames > 0)
+			{
+				std::cout << " (" << stats.numAccumulatedFrames << " accumulated frames, " << stats.numConvergedTiles
+					<< " converged tiles, " << stats.numRenderedTiles << " tiles at " << stats.samplesPerPixel << " spp)";
+			}
+			if (stats.numSecondaryRays > 0)
+			{
+				std::cout << " (" << stats.numSecondaryRays << " reflection rays"
+					<< (stats.isRayBudgetExhausted ? ", budget reached)" : ")");
+			}
+			if (stats.numReusedPixels > 0)
+				std::cout << " (" << stats.numReusedPixels << " pixels reused)";
+			if (stats.denoiseTime > 0.f)
+				std::cout << " (denoised in " << stats.denoiseTime << " ms)";
+			std::cout << std::endl;
+		}
+
+		if (frameStream.IsOpen())
+		{
+			pRenderer->CaptureFrame(streamFrame);
+			if (!frameStream.Submit(streamFrame))
+				frameStream.Close();
 		}
 
 		//Save screenshot after full render
-		if (takeScreenshot)
+		if (takeScreenshot || options.writeSequence)
 		{
-			if (!pRenderer->SaveBufferToImage())
-				std::cout << "Screenshot saved!" << std::endl;
-			else
-				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
+			pRenderer->CaptureFrame(frame, imageWriter.GetSequenceFormat() == ImageFormat::PFM);
+			const std::string filename = imageWriter.SubmitFrame(std::move(frame));
+			if (takeScreenshot)
+				std::cout << "Saving screenshot to " << filename << std::endl;
 			takeScreenshot = false;
 		}
+
+		if (options.numFrames > 0 && ++numFramesRendered >= options.numFrames)
+			isLooping = false;
 	}
 	pTimer->Stop();
 
+	frameStream.Close();
+	imageWriter.Flush();
+	if (imageWriter.GetNumFailed() > 0)
+		std::cout << "Something went wrong. " << imageWriter.GetNumFailed() << " image(s) not saved!" << std::endl;
+
+	memoryTracker.Report(std::cout, "Exit");
+
 	//Shutdown "framework"
 	delete pScene;
 	delete pRenderer;